@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <atomic>
+#include <assert.h>
+
+#include "batch.h"
+
+//
+
+struct RenderPool::Batch {
+	std::vector<RenderRequest> requests;
+	std::vector<u32> order; // submission indices, in the order rendered.
+	std::vector<const SpanBitmap*> bitmaps; // by submission index.
+	RenderCallback onRendered;
+	std::atomic<size_t> remaining;
+	std::atomic<bool> failed = false; // set by the first chunk to throw.
+	std::promise<std::vector<const SpanBitmap*>> done;
+};
+
+RenderPool::RenderPool(std::shared_ptr<const Font> pFont, const size_t pThreadCount)
+	: m_font(std::move(pFont))
+{
+	assert(pThreadCount > 0);
+
+	for (size_t k = 0; k < pThreadCount; ++k) {
+		m_workers.emplace_back(&RenderPool::WorkerMain, this);
+	}
+}
+
+RenderPool::~RenderPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_queueLock);
+		m_stopping = true;
+	}
+	m_queueReady.notify_all();
+
+	for (auto& worker : m_workers) {
+		worker.join();
+	}
+}
+
+void
+RenderPool::WorkerMain()
+{
+	// Contexts aren't thread-safe, so each worker keeps its own for life.
+	RenderContext context(m_font);
+
+	for (;;) {
+		std::function<void(RenderContext&)> task;
+		{
+			std::unique_lock<std::mutex> lock(m_queueLock);
+			m_queueReady.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+
+			// Queued work is finished before stopping, so no future is
+			// left without a value.
+			if (m_queue.empty()) {
+				return;
+			}
+
+			task = std::move(m_queue.front());
+			m_queue.pop_front();
+		}
+
+		task(context);
+	}
+}
+
+std::future<std::vector<const SpanBitmap*>>
+RenderPool::Submit(std::vector<RenderRequest> pRequests, RenderCallback pOnRendered)
+{
+	auto batch = std::make_shared<Batch>();
+	batch->requests = std::move(pRequests);
+	batch->bitmaps.resize(batch->requests.size());
+	batch->onRendered = std::move(pOnRendered);
+
+	std::future<std::vector<const SpanBitmap*>> result = batch->done.get_future();
+
+	// Glyph ids the font doesn't have are never queued, and keep a null
+	// bitmap.
+	const Parser& parser = m_font->GetParser();
+	std::vector<u32>& order = batch->order;
+	for (u32 k = 0; k < batch->requests.size(); ++k) {
+		if (batch->requests[k].glyphID < parser.numGlyphs) {
+			order.push_back(k);
+		}
+	}
+
+	batch->remaining = order.size();
+
+	if (order.empty()) {
+		batch->done.set_value(std::move(batch->bitmaps));
+		return result;
+	}
+
+	// Order the work by where each glyph lives in glyf, then by size, so a
+	// worker's chunk reads neighbouring glyph data.
+	std::vector<u32> offsets(batch->requests.size());
+	for (const u32 k : order) {
+		u32 length;
+		parser.GetGlyphLocation(batch->requests[k].glyphID, offsets[k], length);
+	}
+
+	std::sort(order.begin(), order.end(), [&](const u32 a, const u32 b) {
+		if (offsets[a] != offsets[b]) {
+			return offsets[a] < offsets[b];
+		}
+		return batch->requests[a].pointSize < batch->requests[b].pointSize;
+	});
+
+	{
+		std::lock_guard<std::mutex> lock(m_queueLock);
+
+		for (size_t start = 0; start < order.size(); start += kChunkSize) {
+			const size_t end = std::min(start + kChunkSize, order.size());
+
+			m_queue.emplace_back([batch, start, end](RenderContext& pContext) {
+				// A throw fails the whole batch, through its future, rather
+				// than the worker; later chunks skip their work but still
+				// count down, so the pool is never left waiting on them.
+				try {
+					for (size_t k = start; k < end && !batch->failed; ++k) {
+						const u32 index = batch->order[k];
+						const RenderRequest& request = batch->requests[index];
+
+						const SpanBitmap* bitmap = pContext.RenderGlyph(request.glyphID, request.pointSize, request.preference);
+						batch->bitmaps[index] = bitmap;
+
+						if (batch->onRendered) {
+							batch->onRendered(index, bitmap);
+						}
+					}
+				}
+				catch (...) {
+					if (!batch->failed.exchange(true)) {
+						batch->done.set_exception(std::current_exception());
+					}
+				}
+
+				// The last chunk to finish completes the batch; the acq_rel
+				// ordering makes every chunk's bitmaps visible to it.
+				if (batch->remaining.fetch_sub(end - start, std::memory_order_acq_rel) == end - start && !batch->failed) {
+					batch->done.set_value(std::move(batch->bitmaps));
+				}
+			});
+		}
+	}
+	m_queueReady.notify_all();
+
+	return result;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+#include "base.h"
+#include "libfnt.h"
+
+//
+
+struct RenderRequest {
+    RenderRequest(const GlyphID pGlyphID, const float pPointSize, const RenderPreference pPreference = RenderPreference::Balanced)
+        : glyphID(pGlyphID), pointSize(pPointSize), preference(pPreference)
+    {
+    }
+
+    //
+
+    GlyphID glyphID;
+    float pointSize;
+    RenderPreference preference;
+};
+
+// Called from a worker thread as each glyph of a batch is ready, with the
+// request's index in the batch.
+using RenderCallback = std::function<void(const size_t pIndex, const SpanBitmap* pBitmap)>;
+
+// A fixed set of worker threads rendering glyphs of one font, each through
+// its own RenderContext. Bitmaps land in the font's shared glyph cache and
+// are owned by it, exactly as with RenderContext::RenderGlyph.
+class RenderPool {
+    /* === Methods === */
+public:
+    RenderPool(std::shared_ptr<const Font> pFont, const size_t pThreadCount);
+
+    // Waits for every submitted batch to finish.
+    ~RenderPool();
+
+    RenderPool(const RenderPool&) = delete;
+    RenderPool& operator=(const RenderPool&) = delete;
+
+    // Queues a batch and returns at once. pOnRendered, if given, sees each
+    // glyph as it completes, in no particular order; the future yields
+    // every bitmap in submission order once the whole batch is done.
+    // Requests are rendered sorted by glyf offset and size rather than in
+    // the order given, so neighbouring glyph data is decoded together.
+    // Requests for glyph ids the font doesn't have yield nullptr, and are
+    // never passed to pOnRendered. If a render or pOnRendered throws, the
+    // future rethrows the first exception and the rest of the batch is
+    // abandoned.
+    std::future<std::vector<const SpanBitmap*>> Submit(std::vector<RenderRequest> pRequests, RenderCallback pOnRendered = nullptr);
+
+private:
+    struct Batch;
+
+    void WorkerMain();
+
+    /* === Variables === */
+private:
+    // Requests handed to a worker at a time; small enough to spread a batch
+    // across the pool, large enough to keep the sorted runs together.
+    static constexpr size_t kChunkSize = 16;
+
+    std::shared_ptr<const Font> m_font;
+    std::vector<std::thread> m_workers;
+
+    std::mutex m_queueLock;
+    std::condition_variable m_queueReady;
+    std::deque<std::function<void(RenderContext&)>> m_queue;
+    bool m_stopping = false;
+};
@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "cache.h"
+
+// GlyphCache lookups against the mutex-guarded unordered_map it replaced,
+// from 1 to 64 threads sharing one cache. Each run starts from a warm cache
+// of every printable ASCII glyph at a spread of sizes and modes; the
+// "mixed" runs also insert a fresh key once in every 100 operations, so the
+// lock-free table grows while it is read. Build from the repository root
+// with the library sources, e.g.
+//     g++ -std=c++20 -O2 -I. bench/glyph_cache.cpp <library .cpp files> -lpthread
+// and run as
+//     glyph_cache [operations per thread]
+// Scaling only shows on a machine with as many cores as threads; the core
+// count is printed first.
+
+// The cache as it was: one map behind one lock.
+class MutexGlyphCache {
+public:
+	const SpanBitmap* Find(const GlyphKey pKey) const
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		const auto it = m_bitmaps.find(pKey);
+		return (it != m_bitmaps.end()) ? it->second : nullptr;
+	}
+
+	const SpanBitmap* Insert(const GlyphKey pKey, const SpanBitmap* pBitmap)
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		return m_bitmaps.emplace(pKey, pBitmap).first->second;
+	}
+
+private:
+	mutable std::mutex m_lock;
+	std::unordered_map<GlyphKey, const SpanBitmap*> m_bitmaps; // not owned.
+};
+
+static u32
+NextRandom(u32& pState)
+{
+	pState ^= pState << 13;
+	pState ^= pState >> 17;
+	pState ^= pState << 5;
+	return pState;
+}
+
+// Millions of operations per second over all threads. Every thread looks up
+// warm keys at random; with pInsertEvery set, each also inserts a key of its
+// own that often. Inserted bitmaps are pBitmap, or when that is null (for a
+// cache that owns its bitmaps), ones allocated before the clock starts.
+template <typename Cache>
+static double
+Run(Cache& pCache, const std::vector<GlyphKey>& pKeys, const size_t pThreadCount, const size_t pOperations, const size_t pInsertEvery,
+	const SpanBitmap* pBitmap)
+{
+	std::atomic<size_t> ready = 0;
+	std::atomic<bool> go = false;
+	std::atomic<size_t> found = 0;
+	std::vector<std::thread> threads;
+
+	for (size_t t = 0; t < pThreadCount; ++t) {
+		threads.emplace_back([&, t]() {
+			u32 state = 0x9E3779B9u * (u32)(t + 1);
+			size_t hits = 0;
+			u16 nextInstance = 1;
+
+			std::vector<const SpanBitmap*> bitmaps;
+			if (pInsertEvery && !pBitmap) {
+				for (size_t k = 0; k < pOperations; k += pInsertEvery) {
+					bitmaps.push_back(new SpanBitmap(1, 1));
+				}
+			}
+
+			++ready;
+			while (!go.load(std::memory_order_acquire)) {
+				std::this_thread::yield();
+			}
+
+			for (size_t k = 0; k < pOperations; ++k) {
+				if (pInsertEvery && k % pInsertEvery == 0) {
+					// Instances no warm key uses, unique to this thread.
+					const GlyphKey key = MakeGlyphKey((GlyphID)t, 12.0f, nextInstance);
+					pCache.Insert(key, pBitmap ? pBitmap : bitmaps[nextInstance - 1]);
+					++nextInstance;
+					continue;
+				}
+
+				hits += pCache.Find(pKeys[NextRandom(state) % pKeys.size()]) != nullptr;
+			}
+
+			found += hits;
+		});
+	}
+
+	while (ready.load() != pThreadCount) {
+		std::this_thread::yield();
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	go.store(true, std::memory_order_release);
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// Keeps the lookups from being optimized away.
+	if (found.load() == 0) {
+		std::printf("no hits\n");
+	}
+
+	return pThreadCount * pOperations / seconds / 1e6;
+}
+
+int
+main(int argc, char** argv)
+{
+	// Capped so each thread's inserted keys fit in the instance ids.
+	const size_t operations = std::min<size_t>((argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 2000000, 6000000);
+
+	std::vector<GlyphKey> keys;
+	for (const float pointSize : { 9.0f, 10.0f, 11.0f, 12.0f, 14.0f, 16.0f, 18.0f, 24.0f, 32.0f, 48.0f }) {
+		for (GlyphID glyphID = 3; glyphID < 98; ++glyphID) {
+			keys.push_back(MakeGlyphKey(glyphID, pointSize, 0, RenderMode::Unhinted));
+			keys.push_back(MakeGlyphKey(glyphID, pointSize, 0, RenderMode::Hinted));
+		}
+	}
+
+	// The mutex cache holds the same bitmap for every key; the lock-free
+	// one owns its bitmaps, so each key gets its own.
+	const SpanBitmap shared(1, 1);
+
+	std::printf("%u hardware threads, %zu warm keys, %zu operations per thread\n",
+		std::thread::hardware_concurrency(), keys.size(), operations);
+	std::printf("%8s %12s %12s %12s %12s\n", "threads", "lock-free", "mutex", "lf mixed", "mutex mixed");
+
+	for (const size_t threadCount : { 1, 2, 4, 8, 16, 32, 64 }) {
+		double results[4];
+
+		for (size_t insertEvery : { 0, 100 }) {
+			GlyphCache lockFree;
+			MutexGlyphCache locked;
+			for (const GlyphKey key : keys) {
+				lockFree.Insert(key, new SpanBitmap(1, 1));
+				locked.Insert(key, &shared);
+			}
+
+			const size_t column = insertEvery ? 2 : 0;
+			results[column] = Run(lockFree, keys, threadCount, operations, insertEvery, nullptr);
+			results[column + 1] = Run(locked, keys, threadCount, operations, insertEvery, &shared);
+		}
+
+		std::printf("%8zu %12.1f %12.1f %12.1f %12.1f\n", threadCount, results[0], results[1], results[2], results[3]);
+	}
+
+	return 0;
+}
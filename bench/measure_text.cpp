@@ -0,0 +1,127 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "libfnt.h"
+
+// MeasureText against measuring the way it was done before it existed: a
+// linear scan of the cmap segments per character, then the advance and
+// kerning of each glyph. Build from the repository root with the library
+// sources, e.g.
+//     g++ -std=c++20 -O2 -I. bench/measure_text.cpp <library .cpp files> -lpthread
+// and run as
+//     measure_text <font.ttf>
+
+// The cmap lookup as it was before the segments were binary searched.
+static GlyphID
+LinearGetGlyphID(const BasicUnicodeEncoder& pEncoder, const CharCode pCharCode)
+{
+	for (const auto& segment : pEncoder.segments_) {
+		if (pCharCode < segment.startCharCode || pCharCode > segment.endCharCode) {
+			continue;
+		}
+
+		const u16 idRangeOffset = Stream::GetField<u16>(segment.idRangeOffsetPtr);
+		if (idRangeOffset) {
+			const u8* glyphIdPtr = (const u8*)segment.idRangeOffsetPtr + (idRangeOffset + 2 * (pCharCode - segment.startCharCode));
+			return Stream::GetField<u16>(glyphIdPtr);
+		}
+
+		return (segment.idDelta + pCharCode) & 0xffff;
+	}
+
+	return 0;
+}
+
+static float
+MeasureLinear(const Parser& pParser, std::string_view pText, const float pPixelsPerEm)
+{
+	s64 width = 0;
+	GlyphID prevGlyphID = 0;
+
+	const char* cursor = pText.data();
+	const char* end = cursor + pText.size();
+	while (cursor < end) {
+		const GlyphID glyphID = LinearGetGlyphID(*pParser.encoder, DecodeUTF8(cursor, end));
+		width += pParser.advanceWidths[glyphID];
+
+		if (prevGlyphID) {
+			width += pParser.kerning.GetKerning(prevGlyphID, glyphID);
+		}
+		prevGlyphID = glyphID;
+	}
+
+	return width * (pPixelsPerEm / pParser.upem);
+}
+
+template <typename F>
+static double
+TimeBest(const int pRuns, F pFunc)
+{
+	double best = 1e30;
+	for (int k = 0; k < pRuns; ++k) {
+		const auto start = std::chrono::steady_clock::now();
+		pFunc();
+		const auto stop = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double>(stop - start).count());
+	}
+
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2) {
+		std::fprintf(stderr, "usage: %s <font.ttf>\n", argv[0]);
+		return 1;
+	}
+
+	library lib(argv[1]);
+
+
+	// Mostly ASCII prose with some Latin-1 and typographic punctuation, and
+	// Greek and Cyrillic, whose lookups go past the Latin-1 table to the
+	// cmap segments.
+	const std::pair<const char*, std::string> paragraphs[] = {
+		{ "latin", "The quick brown fox jumps over the lazy dog. Pack my box with five dozen liquor jugs! "
+			"AVA Tow WAVE yo; \xe2\x80\x9cKerning\xe2\x80\x9d pairs, caf\xc3\xa9 na\xc3\xafve \xe2\x80\x94 "
+			"0123456789 (brackets) [and] {braces}.\n" },
+		{ "greek/cyrillic", "\xce\x93\xce\xb1\xce\xb6\xce\xad\xce\xb5\xcf\x82 \xce\xba\xce\xb1\xe1\xbd\xb6 "
+			"\xce\xbc\xcf\x85\xcf\x81\xcf\x84\xce\xb9\xe1\xbd\xb2\xcf\x82 \xd0\xa1\xd1\x8a\xd0\xb5\xd1\x88\xd1\x8c "
+			"\xd0\xb6\xd0\xb5 \xd0\xb5\xd1\x89\xd1\x91 \xd1\x8d\xd1\x82\xd0\xb8\xd1\x85 \xd0\xbc\xd1\x8f\xd0\xb3\xd0\xba\xd0\xb8\xd1\x85.\n" },
+	};
+
+	const float pointSize = 12.0f;
+	bool widthsMatch = true;
+
+	for (const auto& [name, paragraph] : paragraphs) {
+		std::string text;
+		while (text.size() < (4u << 20)) {
+			text += paragraph;
+		}
+
+		size_t charCount = 0;
+		for (const char* cursor = text.data(); cursor < text.data() + text.size(); ++charCount) {
+			DecodeUTF8(cursor, text.data() + text.size());
+		}
+
+		float linearWidth = 0.0f, measuredWidth = 0.0f;
+		const double linearTime = TimeBest(5, [&]() {
+			linearWidth = MeasureLinear(*lib.parser, text, GetPixelsPerEm(pointSize));
+		});
+		const double measureTime = TimeBest(5, [&]() {
+			measuredWidth = lib.MeasureText(text, pointSize).width;
+		});
+
+		std::printf("%s: %zu characters, %zu bytes\n", name, charCount, text.size());
+		std::printf("    linear cmap scan: %8.2f ms  %7.1f M chars/s\n", linearTime * 1e3, charCount / linearTime * 1e-6);
+		std::printf("    MeasureText:      %8.2f ms  %7.1f M chars/s\n", measureTime * 1e3, charCount / measureTime * 1e-6);
+
+		if (linearWidth != measuredWidth) {
+			std::printf("    width mismatch: %f vs %f\n", linearWidth, measuredWidth);
+			widthsMatch = false;
+		}
+	}
+
+	return widthsMatch ? 0 : 1;
+}
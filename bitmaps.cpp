@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <assert.h>
+
+#include "bitmaps.h"
+
+//
+
+#define bitmapSizeRecordSize 48
+#define bigMetricsSize 8
+#define smallMetricsSize 5
+
+static void
+ReadSmallMetrics(Stream& pData, BitmapMetrics& pMetrics)
+{
+	pMetrics.height = pData.GetField<u8>();
+	pMetrics.width = pData.GetField<u8>();
+	pMetrics.bearingX = pData.GetField<s8>();
+	pMetrics.bearingY = pData.GetField<s8>();
+	pMetrics.advance = pData.GetField<u8>();
+}
+
+static void
+ReadBigMetrics(Stream& pData, BitmapMetrics& pMetrics)
+{
+	ReadSmallMetrics(pData, pMetrics); // the horizontal metrics lead.
+	pData.Skip(3); // skip vertical metrics
+}
+
+void
+EmbeddedBitmaps::Load(Stream pLocationTable, Stream pDataTable)
+{
+	const u8* locationTop = (const u8*)pLocationTable.get();
+	m_data = (const u8*)pDataTable.get();
+
+	pLocationTable.Skip(4); // skip version
+	const u32 sizeCount = pLocationTable.GetField<u32>();
+
+	for (size_t k = 0; k < sizeCount; ++k) {
+		Stream size(locationTop + 8 + k * bitmapSizeRecordSize);
+
+		const u32 arrayOffset = size.GetField<u32>();
+		size.SkipField<u32>(); // skip index tables size
+		const u32 subtableCount = size.GetField<u32>();
+		size.Skip(4 + 12 + 12 + 4); // skip colorRef, line metrics & glyph range
+
+		Strike strike;
+		strike.ppemX = size.GetField<u8>();
+		strike.ppemY = size.GetField<u8>();
+		strike.bitDepth = size.GetField<u8>();
+
+		// Only greyscale depths can be read; colour strikes (32, in CBLC)
+		// and malformed ones are left out.
+		if (strike.bitDepth != 1 && strike.bitDepth != 2 && strike.bitDepth != 4 && strike.bitDepth != 8) {
+			continue;
+		}
+
+		const u8* arrayTop = locationTop + arrayOffset;
+		Stream array(arrayTop);
+		for (size_t s = 0; s < subtableCount; ++s) {
+			IndexRange range;
+			range.firstGlyph = array.GetField<u16>();
+			range.lastGlyph = array.GetField<u16>();
+
+			Stream subtable(arrayTop + array.GetField<u32>());
+			range.indexFormat = subtable.GetField<u16>();
+			range.imageFormat = subtable.GetField<u16>();
+			range.imageDataOffset = subtable.GetField<u32>();
+			range.subtable = (const u8*)subtable.get();
+
+			strike.ranges.push_back(range);
+		}
+
+		std::sort(strike.ranges.begin(), strike.ranges.end(),
+			[](const IndexRange& a, const IndexRange& b) { return a.firstGlyph < b.firstGlyph; });
+
+		// Index strikes by their vertical ppem, keeping the first strike
+		// listed for a size.
+		if (m_strikeByPpem[strike.ppemY] == kNoStrike && m_strikes.size() < kNoStrike) {
+			m_strikeByPpem[strike.ppemY] = (u8)m_strikes.size();
+			m_strikes.push_back(std::move(strike));
+		}
+	}
+}
+
+bool
+EmbeddedBitmaps::Locate(const IndexRange& pRange, const GlyphID pGlyphID, u32& pOffset, u32& pLength) const
+{
+	const u32 glyphIdx = pGlyphID - pRange.firstGlyph;
+	Stream subtable(pRange.subtable);
+
+	switch (pRange.indexFormat) {
+		case 1: // 32-bit offsets
+		case 3: // 16-bit offsets
+		{
+			const bool isWide = (pRange.indexFormat == 1);
+			subtable.Skip(glyphIdx * (isWide ? 4 : 2));
+			const u32 start = isWide ? subtable.GetField<u32>() : subtable.GetField<u16>();
+			const u32 end = isWide ? subtable.GetField<u32>() : subtable.GetField<u16>();
+
+			pOffset = pRange.imageDataOffset + start;
+			pLength = end - start;
+		}
+		return pLength != 0;
+
+		case 2: // fixed size images, all glyphs present
+		{
+			const u32 imageSize = subtable.GetField<u32>();
+			pOffset = pRange.imageDataOffset + glyphIdx * imageSize;
+			pLength = imageSize;
+		}
+		return true;
+
+		case 4: // sparse, (glyph, offset) pairs
+		{
+			const u32 glyphCount = subtable.GetField<u32>();
+			const u8* pairs = (const u8*)subtable.get();
+
+			// The pairs are sorted by glyph id, with a sentinel at the end.
+			size_t lo = 0, hi = glyphCount;
+			while (lo < hi) {
+				const size_t mid = (lo + hi) / 2;
+				const u16 glyph = Stream::GetField<u16>(pairs + mid * 4);
+				if (glyph < pGlyphID) {
+					lo = mid + 1;
+				}
+				else {
+					hi = mid;
+				}
+			}
+
+			if (lo == glyphCount || Stream::GetField<u16>(pairs + lo * 4) != pGlyphID) {
+				return false;
+			}
+
+			const u16 start = Stream::GetField<u16>(pairs + lo * 4 + 2);
+			const u16 end = Stream::GetField<u16>(pairs + (lo + 1) * 4 + 2);
+			pOffset = pRange.imageDataOffset + start;
+			pLength = end - start;
+		}
+		return pLength != 0;
+
+		case 5: // sparse, fixed size images
+		{
+			const u32 imageSize = subtable.GetField<u32>();
+			subtable.Skip(bigMetricsSize);
+			const u32 glyphCount = subtable.GetField<u32>();
+			const u8* glyphIDs = (const u8*)subtable.get();
+
+			size_t lo = 0, hi = glyphCount;
+			while (lo < hi) {
+				const size_t mid = (lo + hi) / 2;
+				if (Stream::GetField<u16>(glyphIDs + mid * 2) < pGlyphID) {
+					lo = mid + 1;
+				}
+				else {
+					hi = mid;
+				}
+			}
+
+			if (lo == glyphCount || Stream::GetField<u16>(glyphIDs + lo * 2) != pGlyphID) {
+				return false;
+			}
+
+			pOffset = pRange.imageDataOffset + (u32)lo * imageSize;
+			pLength = imageSize;
+		}
+		return true;
+	}
+
+	return false; // @err: unknown index format.
+}
+
+const RasterTarget*
+EmbeddedBitmaps::Render(const u16 pPpem, const GlyphID pGlyphID, BitmapMetrics& pMetrics) const
+{
+	if (!HasStrike(pPpem)) {
+		return nullptr;
+	}
+
+	const Strike& strike = m_strikes[m_strikeByPpem[pPpem]];
+
+	const auto it = std::upper_bound(strike.ranges.begin(), strike.ranges.end(), pGlyphID,
+		[](const GlyphID glyph, const IndexRange& range) { return glyph < range.firstGlyph; });
+	if (it == strike.ranges.begin()) {
+		return nullptr;
+	}
+
+	const IndexRange& range = *(it - 1);
+	if (pGlyphID > range.lastGlyph) {
+		return nullptr;
+	}
+
+	u32 offset, length;
+	if (!Locate(range, pGlyphID, offset, length)) {
+		return nullptr;
+	}
+
+	Stream image(m_data + offset);
+
+	bool isBitAligned = false;
+	switch (range.imageFormat) {
+		case 1: ReadSmallMetrics(image, pMetrics); break;
+		case 2: ReadSmallMetrics(image, pMetrics); isBitAligned = true; break;
+		case 6: ReadBigMetrics(image, pMetrics); break;
+		case 7: ReadBigMetrics(image, pMetrics); isBitAligned = true; break;
+		case 5:
+		{
+			// Metrics are shared by the whole range, and live in the index.
+			Stream metrics(range.subtable + 4);
+			ReadBigMetrics(metrics, pMetrics);
+			isBitAligned = true;
+		}
+		break;
+
+		default:
+			// @todo: component (8, 9) and PNG (17-19, CBDT) images.
+			return nullptr;
+	}
+
+	const u32 depth = strike.bitDepth;
+	assert(depth == 1 || depth == 2 || depth == 4 || depth == 8); // checked on load.
+	const u32 maxValue = (1u << depth) - 1;
+	const size_t width = pMetrics.width;
+	const size_t height = pMetrics.height;
+
+	RasterTarget* target = new RasterTarget(width, height);
+
+	const u8* bits = (const u8*)image.get();
+	size_t bitPos = 0;
+
+	for (size_t row = 0; row < height; ++row) {
+		if (!isBitAligned) {
+			bitPos = (bitPos + 7) & ~(size_t)7; // rows start on a byte boundary.
+		}
+
+		// Embedded bitmaps are stored top row first.
+		const size_t y = height - 1 - row;
+
+		for (size_t x = 0; x < width; ++x) {
+			u32 value = 0;
+			for (u32 b = 0; b < depth; ++b, ++bitPos) {
+				value = (value << 1) | ((bits[bitPos >> 3] >> (7 - (bitPos & 7))) & 1);
+			}
+
+			target->store(x, y, (uint8_t)(value * 0xff / maxValue));
+		}
+	}
+
+	return target;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "base.h"
+#include "stream.h"
+#include "encodings.h"
+#include "raster.h"
+
+//
+
+// Glyph placement for an embedded bitmap, in pixels.
+struct BitmapMetrics {
+    u8 width, height;
+    s8 bearingX; // left edge, relative to the pen position.
+    s8 bearingY; // top edge, relative to the baseline.
+    u8 advance;
+};
+
+// Hand-tuned bitmaps for specific pixel sizes, from EBLC/EBDT (or the
+// identically laid out CBLC/CBDT). Strikes are indexed by ppem at load, and
+// each strike's index subtables are kept sorted by glyph range so a glyph
+// is located with a single binary search.
+class EmbeddedBitmaps {
+    /* === Methods === */
+public:
+    EmbeddedBitmaps() { m_strikeByPpem.fill(kNoStrike); }
+
+    void Load(Stream pLocationTable, Stream pDataTable);
+
+    bool HasStrike(const u16 pPpem) const { return pPpem < m_strikeByPpem.size() && m_strikeByPpem[pPpem] != kNoStrike; }
+
+    // Decodes the glyph's bitmap from the strike for pPpem into 8-bit
+    // coverage, bottom row first like the rasterizer's output. Returns
+    // nullptr when the strike has no bitmap for the glyph, or stores it in
+    // an unsupported format.
+    const RasterTarget* Render(const u16 pPpem, const GlyphID pGlyphID, BitmapMetrics& pMetrics) const;
+
+private:
+    struct IndexRange {
+        u16 firstGlyph, lastGlyph;
+        u16 indexFormat, imageFormat;
+        u32 imageDataOffset;
+        const u8* subtable; // index subtable, just past its header.
+    };
+
+    struct Strike {
+        u8 ppemX, ppemY;
+        u8 bitDepth;
+        std::vector<IndexRange> ranges;
+    };
+
+    bool Locate(const IndexRange& pRange, const GlyphID pGlyphID, u32& pOffset, u32& pLength) const;
+
+    /* === Variables === */
+private:
+    static constexpr u8 kNoStrike = 0xff;
+
+    std::vector<Strike> m_strikes;
+    std::array<u8, 256> m_strikeByPpem;
+    const u8* m_data = nullptr;
+};
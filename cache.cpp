@@ -0,0 +1,319 @@
+#include <algorithm>
+#include <cmath>
+
+#include "cache.h"
+#include "raster.h"
+
+//
+
+size_t
+OutlineCache::GetEntrySize(const FlattenedOutline& pOutline)
+{
+	return sizeof(u32) + sizeof(FlattenedOutline) + pOutline.segments.capacity() * sizeof(LineSegment);
+}
+
+const FlattenedOutline&
+OutlineCache::Get(const GlyphID pGlyphID, const float pPixelsPerEm, const VariationInstance& pInstance)
+{
+	const float requiredTolerance = kFlattenTolerancePx / pPixelsPerEm;
+
+	const u32 key = MakeKey(pInstance.id, pGlyphID);
+
+	auto it = m_outlines.find(key);
+	if (it != m_outlines.end()) {
+		if (it->second.tolerance <= requiredTolerance) {
+			++m_stats.hits;
+			return it->second;
+		}
+
+		// The cached outline is too coarse for this size. A finer one
+		// still serves every smaller size, so it simply replaces it.
+		++m_stats.reflattens;
+		m_stats.memoryBytes -= GetEntrySize(it->second);
+		m_outlines.erase(it);
+		--m_stats.entries;
+	}
+
+	++m_stats.misses;
+
+	const float tolerance = std::min(requiredTolerance, kFlattenTolerancePx / kOutlineCacheReferencePpem);
+
+	// A precompiled font's default outlines are flattened where they lie,
+	// with nothing decoded; other instances need glyf for their deltas.
+	FlattenedOutline outline = (pInstance.IsDefault() && !m_parser.outlines.IsEmpty())
+		? FlattenOutline(m_parser.outlines.Get(pGlyphID), m_parser.GetGlyphBounds(pGlyphID), m_parser.upem, tolerance)
+		: FlattenOutline(m_parser.LoadGlyph(pGlyphID, pInstance), m_parser.upem, tolerance);
+	outline.segments.shrink_to_fit();
+
+	m_stats.memoryBytes += GetEntrySize(outline);
+	++m_stats.entries;
+
+	return m_outlines.emplace(key, std::move(outline)).first->second;
+}
+
+void
+OutlineCache::Clear()
+{
+	m_outlines.clear();
+	m_stats.entries = 0;
+	m_stats.memoryBytes = 0;
+}
+
+//
+
+GlyphKey
+MakeGlyphKey(const GlyphID pGlyphID, const float pPointSize, const u16 pInstance, const RenderMode pMode)
+{
+	const u32 size = (u32)std::lround(pPointSize * 64.0f) & 0xffffff;
+	return ((GlyphKey)pInstance << 48) | ((GlyphKey)(pGlyphID & 0xffff) << 32) | ((GlyphKey)pMode << 24) | size;
+}
+
+void
+SplitGlyphKey(const GlyphKey pKey, GlyphID& pGlyphID, float& pPointSize, u16& pInstance, RenderMode& pMode)
+{
+	pInstance = (u16)(pKey >> 48);
+	pGlyphID = (GlyphID)(pKey >> 32);
+	pMode = (RenderMode)((pKey >> 24) & 0xff);
+	pPointSize = (pKey & 0xffffff) / 64.0f;
+}
+
+GlyphCache::Table::Table(const size_t pCapacity)
+	: mask(pCapacity - 1), slots(new Slot[pCapacity])
+{
+	for (size_t k = 0; k < pCapacity; ++k) {
+		slots[k].key.store(kEmptyKey, std::memory_order_relaxed);
+		slots[k].bitmap.store(nullptr, std::memory_order_relaxed);
+		slots[k].uses.store(0, std::memory_order_relaxed);
+	}
+}
+
+const SpanBitmap GlyphCache::kUnrenderable(0, 0);
+
+GlyphCache::GlyphCache()
+{
+	m_tables.push_back(std::make_unique<Table>(kInitialCapacity));
+	m_table.store(m_tables.back().get(), std::memory_order_release);
+}
+
+GlyphCache::~GlyphCache()
+{
+	// Every bitmap appears once in the current table; older tables only
+	// hold copies of the pointers.
+	const Table& table = *m_tables.back();
+	for (size_t k = 0; k <= table.mask; ++k) {
+		const SpanBitmap* bitmap = table.slots[k].bitmap.load(std::memory_order_relaxed);
+		if (bitmap != &kUnrenderable) {
+			delete bitmap;
+		}
+	}
+}
+
+size_t
+GlyphCache::Hash(const GlyphKey pKey)
+{
+	// Keys differ mostly in their low bits (size, then glyph), so mix them
+	// all in before masking.
+	u64 h = pKey ^ (pKey >> 33);
+	h *= 0xff51afd7ed558ccdull;
+	return (size_t)(h ^ (h >> 33));
+}
+
+GlyphCache::Slot&
+GlyphCache::Probe(const Table& pTable, const GlyphKey pKey)
+{
+	for (size_t k = Hash(pKey);; ++k) {
+		Slot& slot = pTable.slots[k & pTable.mask];
+		const GlyphKey key = slot.key.load(std::memory_order_acquire);
+		if (key == pKey || key == kEmptyKey) {
+			return slot;
+		}
+	}
+}
+
+const SpanBitmap*
+GlyphCache::Find(const GlyphKey pKey, const bool pCountUse) const
+{
+	const SpanBitmap* bitmap = Lookup(pKey, pCountUse);
+	return (bitmap != &kUnrenderable) ? bitmap : nullptr;
+}
+
+const SpanBitmap*
+GlyphCache::Lookup(const GlyphKey pKey, const bool pCountUse) const
+{
+	const Slot& slot = Probe(*m_table.load(std::memory_order_acquire), pKey);
+
+	// An empty slot may have been filled since Probe looked at it, so the
+	// key is loaded again; acquiring it orders the bitmap load after the
+	// writer's store.
+	if (slot.key.load(std::memory_order_acquire) != pKey) {
+		return nullptr;
+	}
+
+	if (pCountUse && m_recordUsage.load(std::memory_order_relaxed)) {
+		slot.uses.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	return slot.bitmap.load(std::memory_order_relaxed);
+}
+
+void
+GlyphCache::ForEach(const std::function<void(const GlyphKey pKey, const SpanBitmap& pBitmap)>& pVisit) const
+{
+	const Table& table = *m_table.load(std::memory_order_acquire);
+	for (size_t k = 0; k <= table.mask; ++k) {
+		const GlyphKey key = table.slots[k].key.load(std::memory_order_acquire);
+		if (key == kEmptyKey) {
+			continue;
+		}
+
+		const SpanBitmap* bitmap = table.slots[k].bitmap.load(std::memory_order_relaxed);
+		if (bitmap != &kUnrenderable) {
+			pVisit(key, *bitmap);
+		}
+	}
+}
+
+void
+GlyphCache::GetUsage(std::vector<std::pair<GlyphKey, u32>>& pUsage) const
+{
+	// Growth leaves each key's count where it is, and starts it again from
+	// zero in the new table, so lookups still probing an old table aren't
+	// lost; a key's uses are the sum over every table holding it.
+	std::lock_guard<std::mutex> lock(m_writeLock);
+
+	const Table& table = *m_tables.back();
+	for (size_t k = 0; k <= table.mask; ++k) {
+		const GlyphKey key = table.slots[k].key.load(std::memory_order_relaxed);
+		if (key == kEmptyKey) {
+			continue;
+		}
+
+		u32 uses = 0;
+		for (const auto& published : m_tables) {
+			const Slot& slot = Probe(*published, key);
+			if (slot.key.load(std::memory_order_relaxed) == key) {
+				uses += slot.uses.load(std::memory_order_relaxed);
+			}
+		}
+		pUsage.emplace_back(key, uses);
+	}
+}
+
+bool
+GlyphCache::Contains(const GlyphKey pKey) const
+{
+	const Slot& slot = Probe(*m_table.load(std::memory_order_acquire), pKey);
+	return slot.key.load(std::memory_order_acquire) == pKey;
+}
+
+const SpanBitmap*
+GlyphCache::Insert(const GlyphKey pKey, const SpanBitmap* pBitmap, const bool pCountUse)
+{
+	std::lock_guard<std::mutex> lock(m_writeLock);
+
+	Table* table = m_tables.back().get();
+
+	Slot* slot = &Probe(*table, pKey);
+	if (slot->key.load(std::memory_order_relaxed) == pKey) {
+		if (pBitmap != &kUnrenderable) {
+			delete pBitmap; // another thread rendered it first.
+		}
+
+		const SpanBitmap* resident = slot->bitmap.load(std::memory_order_relaxed);
+		return (resident != &kUnrenderable) ? resident : nullptr;
+	}
+
+	// Grow at half full, so probe sequences stay short.
+	if ((table->count + 1) * 2 > table->mask + 1) {
+		auto grown = std::make_unique<Table>((table->mask + 1) * 2);
+		for (size_t k = 0; k <= table->mask; ++k) {
+			const Slot& old = table->slots[k];
+			const GlyphKey key = old.key.load(std::memory_order_relaxed);
+			if (key != kEmptyKey) {
+				Slot& moved = Probe(*grown, key);
+				moved.bitmap.store(old.bitmap.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				moved.key.store(key, std::memory_order_relaxed);
+			}
+		}
+		grown->count = table->count;
+
+		table = grown.get();
+		m_tables.push_back(std::move(grown));
+		m_table.store(table, std::memory_order_release);
+
+		slot = &Probe(*table, pKey);
+	}
+
+	// The render that led to this insert was itself a use, unless the
+	// caller says otherwise.
+	slot->bitmap.store(pBitmap, std::memory_order_relaxed);
+	slot->uses.store((pCountUse && m_recordUsage.load(std::memory_order_relaxed)) ? 1 : 0, std::memory_order_relaxed);
+	slot->key.store(pKey, std::memory_order_release);
+	++table->count;
+
+	if (pBitmap == &kUnrenderable) {
+		return nullptr;
+	}
+
+	m_memoryBytes.fetch_add(pBitmap->GetMemoryUsage(), std::memory_order_relaxed);
+
+	return pBitmap;
+}
+
+const SpanBitmap*
+GlyphCache::FindOrRender(const GlyphKey pKey, const std::function<const SpanBitmap*()>& pRender, const bool pCountUse)
+{
+	if (const SpanBitmap* bitmap = Lookup(pKey, pCountUse)) {
+		return (bitmap != &kUnrenderable) ? bitmap : nullptr;
+	}
+
+	std::shared_ptr<Flight> flight;
+	{
+		std::unique_lock<std::mutex> lock(m_flightLock);
+
+		// The render may have landed between the lookup and taking the
+		// lock; flights are only retired after their insert.
+		if (const SpanBitmap* bitmap = Lookup(pKey, pCountUse)) {
+			return (bitmap != &kUnrenderable) ? bitmap : nullptr;
+		}
+
+		const auto it = m_flights.find(pKey);
+		if (it != m_flights.end()) {
+			flight = it->second;
+			m_coalesced.fetch_add(1, std::memory_order_relaxed);
+			flight->landed.wait(lock, [&flight]() { return flight->done; });
+			return flight->bitmap;
+		}
+
+		flight = std::make_shared<Flight>();
+		m_flights.emplace(pKey, flight);
+	}
+
+	// The flight must land however the render ends, or its waiters would
+	// never wake.
+	const SpanBitmap* bitmap;
+	try {
+		bitmap = pRender();
+	}
+	catch (...) {
+		Land(pKey, *flight, nullptr);
+		throw;
+	}
+
+	bitmap = Insert(pKey, bitmap ? bitmap : &kUnrenderable, pCountUse);
+	Land(pKey, *flight, bitmap);
+
+	return bitmap;
+}
+
+void
+GlyphCache::Land(const GlyphKey pKey, Flight& pFlight, const SpanBitmap* pBitmap)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_flightLock);
+		pFlight.done = true;
+		pFlight.bitmap = pBitmap;
+		m_flights.erase(pKey);
+	}
+	pFlight.landed.notify_all();
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "base.h"
+#include "outline.h"
+#include "parser.h"
+#include "spans.h"
+#include "hinting.h"
+
+//
+
+// Sizes up to this many pixels-per-em are served by the first flattening of
+// a glyph; only larger sizes force it to be flattened again, more finely.
+constexpr float kOutlineCacheReferencePpem = 128.0f;
+
+// Caches flattened outlines per glyph in ems, so each pixel size is produced
+// by a single scaling pass (see EdgeTable) instead of a full decode and
+// flatten. Entries are kept per variation instance, so returning to an
+// instance doesn't apply its deltas again.
+class OutlineCache {
+    /* === Methods === */
+public:
+    struct Stats {
+        u64 hits = 0;
+        u64 misses = 0;
+        u64 reflattens = 0; // misses caused by a cached outline being too coarse.
+        size_t entries = 0;
+        size_t memoryBytes = 0;
+    };
+
+    OutlineCache(const Parser& pParser)
+        : m_parser(pParser)
+    {
+    }
+
+    const FlattenedOutline& Get(const GlyphID pGlyphID, const float pPixelsPerEm, const VariationInstance& pInstance);
+
+    const Stats& GetStats() const { return m_stats; }
+
+    void Clear();
+
+private:
+    static size_t GetEntrySize(const FlattenedOutline& pOutline);
+
+    static u32 MakeKey(const u16 pInstance, const GlyphID pGlyphID) { return ((u32)pInstance << 16) | (pGlyphID & 0xffff); }
+
+    /* === Variables === */
+private:
+    const Parser& m_parser;
+    std::unordered_map<u32, FlattenedOutline> m_outlines; // keyed by instance and glyph.
+    Stats m_stats;
+};
+
+// Identifies a rendered glyph: the variation instance, the glyph id, the
+// render mode, and the point size in 26.6 fixed point so nearly-equal float
+// sizes share an entry.
+using GlyphKey = u64;
+
+GlyphKey MakeGlyphKey(const GlyphID pGlyphID, const float pPointSize, const u16 pInstance = 0, const RenderMode pMode = RenderMode::Unhinted);
+void SplitGlyphKey(const GlyphKey pKey, GlyphID& pGlyphID, float& pPointSize, u16& pInstance, RenderMode& pMode);
+
+// Rendered glyph bitmaps, stored as spans, shared by every thread rendering
+// a font. Lookups take no lock: the table is open addressed and each slot is
+// written once, bitmap before key, so a reader that sees a key also sees its
+// bitmap. Inserts are serialized but never block readers. When the table
+// fills, the entries are copied into one twice the size, which is then
+// published in a single store; superseded tables are kept until the cache is
+// destroyed, as readers may still be probing them.
+//
+// Misses for a key that is already being rendered are coalesced: only the
+// first thread renders, and the rest wait for its result (see FindOrRender).
+class GlyphCache {
+    /* === Methods === */
+public:
+    GlyphCache();
+    ~GlyphCache();
+
+    GlyphCache(const GlyphCache&) = delete;
+    GlyphCache& operator=(const GlyphCache&) = delete;
+
+    // With pCountUse false the lookup isn't counted as a use (see
+    // SetRecordUsage), as for prewarming; Insert and FindOrRender take it too.
+    const SpanBitmap* Find(const GlyphKey pKey, const bool pCountUse = true) const;
+
+    // Whether pKey is cached, including as failing to render. Unlike Find,
+    // never counts as a use.
+    bool Contains(const GlyphKey pKey) const;
+
+    // Takes ownership of pBitmap, and returns the bitmap now cached under
+    // pKey: an earlier one, should another thread have inserted it first,
+    // or nullptr if pKey is known not to render (see FindOrRender).
+    const SpanBitmap* Insert(const GlyphKey pKey, const SpanBitmap* pBitmap, const bool pCountUse = true);
+
+    // The cached bitmap for pKey, calling pRender to produce it on a miss.
+    // Concurrent misses for the same key wait for the first caller's render
+    // rather than repeating it. pRender may return nullptr if it can't
+    // render the glyph; every waiter then gets nullptr too, and so does
+    // every later call, without pRender being run again. Should pRender
+    // throw, the waiters get nullptr, nothing is cached and the exception
+    // reaches the caller.
+    const SpanBitmap* FindOrRender(const GlyphKey pKey, const std::function<const SpanBitmap*()>& pRender, const bool pCountUse = true);
+
+    // Calls pVisit for every cached bitmap (not for keys that failed to
+    // render). Safe to run alongside lookups
+    // and inserts, though bitmaps inserted meanwhile may be missed.
+    void ForEach(const std::function<void(const GlyphKey pKey, const SpanBitmap& pBitmap)>& pVisit) const;
+
+    size_t GetMemoryUsage() const { return m_memoryBytes.load(std::memory_order_relaxed); }
+
+    // Misses that waited for another thread's render instead of rendering.
+    u64 GetCoalescedCount() const { return m_coalesced.load(std::memory_order_relaxed); }
+
+    // Usage recording, off by default as it makes every lookup write to
+    // the shared table. While on, each key counts the lookups and renders
+    // that asked for it, including lookups that landed in a table since
+    // superseded by growth.
+    void SetRecordUsage(const bool pRecord) { m_recordUsage.store(pRecord, std::memory_order_relaxed); }
+
+    // Every cached key with its count, unordered. Blocks inserts while it
+    // runs.
+    void GetUsage(std::vector<std::pair<GlyphKey, u32>>& pUsage) const;
+
+private:
+    struct Slot {
+        std::atomic<GlyphKey> key;
+        std::atomic<const SpanBitmap*> bitmap;
+        mutable std::atomic<u32> uses;
+    };
+
+    struct Table {
+        Table(const size_t pCapacity);
+
+        size_t mask; // capacity - 1; the capacity is a power of two.
+        size_t count = 0;
+        std::unique_ptr<Slot[]> slots;
+    };
+
+    // A render in progress, shared by the thread rendering and any waiting
+    // on it.
+    struct Flight {
+        std::condition_variable landed;
+        bool done = false;
+        const SpanBitmap* bitmap = nullptr;
+    };
+
+    // Never a real key, as instance ids stop short of 0xffff.
+    static constexpr GlyphKey kEmptyKey = ~(GlyphKey)0;
+
+    // Cached in place of a bitmap that failed to render, so the render
+    // isn't tried again; Find and FindOrRender return nullptr for it.
+    static const SpanBitmap kUnrenderable;
+    static constexpr size_t kInitialCapacity = 1024;
+
+    static size_t Hash(const GlyphKey pKey);
+
+    // The slot holding pKey, or the empty slot where it belongs.
+    static Slot& Probe(const Table& pTable, const GlyphKey pKey);
+
+    // As Find, but returns kUnrenderable as it is.
+    const SpanBitmap* Lookup(const GlyphKey pKey, const bool pCountUse) const;
+
+    // Wakes every thread waiting on pFlight with pBitmap, and retires it.
+    void Land(const GlyphKey pKey, Flight& pFlight, const SpanBitmap* pBitmap);
+
+    /* === Variables === */
+private:
+    std::atomic<const Table*> m_table;
+    std::vector<std::unique_ptr<Table>> m_tables; // every table published, the current one last.
+    mutable std::mutex m_writeLock;
+    std::atomic<size_t> m_memoryBytes = 0;
+
+    std::mutex m_flightLock;
+    std::unordered_map<GlyphKey, std::shared_ptr<Flight>> m_flights;
+    std::atomic<u64> m_coalesced = 0;
+    std::atomic<bool> m_recordUsage = false;
+};
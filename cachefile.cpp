@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+#include <system_error>
+#include <vector>
+
+#include "cachefile.h"
+
+//
+
+CacheFile::CacheFile(const std::string& pPath, const u64 pFontHash)
+	: m_file(pPath)
+{
+	if (!m_file.IsOpen() || m_file.GetSize() < sizeof(Header)) {
+		return;
+	}
+
+	const u8* data = m_file.GetData();
+	m_header = (const Header*)data;
+
+	if (m_header->magic != kMagic || m_header->version != kCacheFileVersion
+		|| m_header->entrySize != sizeof(Entry) || m_header->spanSize != sizeof(Span)
+		|| m_header->fontHash != pFontHash || m_header->fileSize != m_file.GetSize()) {
+		return;
+	}
+
+	// The sections must exactly fill the file.
+	const size_t entryBytes = (size_t)m_header->entryCount * sizeof(Entry);
+	const size_t rowBytes = (size_t)m_header->rowCount * sizeof(u32);
+	const size_t spanBytes = (size_t)m_header->spanCount * sizeof(Span);
+	if (sizeof(Header) + entryBytes + rowBytes + spanBytes != m_file.GetSize()) {
+		return;
+	}
+
+	m_entries = (const Entry*)(data + sizeof(Header));
+	m_rows = (const u32*)(data + sizeof(Header) + entryBytes);
+	m_spans = (const Span*)(data + sizeof(Header) + entryBytes + rowBytes);
+	m_valid = true;
+}
+
+size_t
+CacheFile::Populate(GlyphCache& pCache) const
+{
+	if (!m_valid) {
+		return 0;
+	}
+
+	size_t count = 0;
+	for (u32 k = 0; k < m_header->entryCount; ++k) {
+		const Entry& entry = m_entries[k];
+
+		// Only the header was checked up front, so a damaged entry is
+		// skipped rather than trusted.
+		if (!IsEntryValid(entry)) {
+			continue;
+		}
+
+		const std::span<const u32> rows(m_rows + entry.firstRow, entry.height + 1);
+		SpanBitmap* bitmap = new SpanBitmap(entry.width, entry.height, rows, std::span<const Span>(m_spans + entry.firstSpan, rows.back()));
+		bitmap->left = entry.left;
+		bitmap->bottom = entry.bottom;
+
+		pCache.Insert(entry.key, bitmap);
+		++count;
+	}
+
+	return count;
+}
+
+bool
+CacheFile::IsEntryValid(const Entry& pEntry) const
+{
+	if ((u64)pEntry.firstRow + pEntry.height + 1 > m_header->rowCount) {
+		return false;
+	}
+
+	// Row starts run from the entry's first span and never go back, so
+	// each row's spans lie between its start and the next.
+	const std::span<const u32> rows(m_rows + pEntry.firstRow, pEntry.height + 1);
+	if (rows.front() != 0 || !std::is_sorted(rows.begin(), rows.end())) {
+		return false;
+	}
+	if ((u64)pEntry.firstSpan + rows.back() > m_header->spanCount) {
+		return false;
+	}
+
+	// Blit only clips against its target, so every span must also fit
+	// within the bitmap's own width.
+	const std::span<const Span> spans(m_spans + pEntry.firstSpan, rows.back());
+	return std::all_of(spans.begin(), spans.end(), [&pEntry](const Span& pSpan) {
+		return (u32)pSpan.x + pSpan.length <= pEntry.width;
+	});
+}
+
+bool
+CacheFile::Write(const std::string& pPath, const u64 pFontHash, const GlyphCache& pCache)
+{
+	std::vector<std::pair<GlyphKey, const SpanBitmap*>> bitmaps;
+	pCache.ForEach([&bitmaps](const GlyphKey pKey, const SpanBitmap& pBitmap) {
+		if ((pKey >> 48) == 0) { // the default instance.
+			bitmaps.emplace_back(pKey, &pBitmap);
+		}
+	});
+	std::sort(bitmaps.begin(), bitmaps.end());
+
+	Header header = {};
+	header.magic = kMagic;
+	header.version = kCacheFileVersion;
+	header.entrySize = sizeof(Entry);
+	header.spanSize = sizeof(Span);
+	header.fontHash = pFontHash;
+	header.entryCount = (u32)bitmaps.size();
+
+	std::vector<Entry> entries(bitmaps.size());
+	std::vector<u32> rows;
+	std::vector<Span> spans;
+
+	for (size_t k = 0; k < bitmaps.size(); ++k) {
+		const SpanBitmap& bitmap = *bitmaps[k].second;
+
+		Entry& entry = entries[k];
+		entry.key = bitmaps[k].first;
+		entry.firstRow = (u32)rows.size();
+		entry.firstSpan = (u32)spans.size();
+		entry.width = (u16)bitmap.width;
+		entry.height = (u16)bitmap.height;
+		entry.left = bitmap.left;
+		entry.bottom = bitmap.bottom;
+
+		const std::span<const u32> bitmapRows = bitmap.GetRows();
+		const std::span<const Span> bitmapSpans = bitmap.GetSpans();
+		rows.insert(rows.end(), bitmapRows.begin(), bitmapRows.end());
+		spans.insert(spans.end(), bitmapSpans.begin(), bitmapSpans.end());
+	}
+
+	header.rowCount = (u32)rows.size();
+	header.spanCount = (u32)spans.size();
+	header.fileSize = sizeof(Header) + entries.size() * sizeof(Entry) + rows.size() * sizeof(u32) + spans.size() * sizeof(Span);
+
+	const std::string tempPath = pPath + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			return false;
+		}
+
+		file.write((const char*)&header, sizeof(Header));
+		file.write((const char*)entries.data(), entries.size() * sizeof(Entry));
+		file.write((const char*)rows.data(), rows.size() * sizeof(u32));
+		file.write((const char*)spans.data(), spans.size() * sizeof(Span));
+
+		if (!file.good()) {
+			file.close();
+			std::error_code error;
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+	}
+
+	// Unlike std::rename on Windows, this replaces a file from an earlier
+	// save.
+	std::error_code error;
+	std::filesystem::rename(tempPath, pPath, error);
+	return !error;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+
+#include "base.h"
+#include "spans.h"
+#include "cache.h"
+#include "mapping.h"
+
+//
+
+// Bump whenever the file layout, or anything that changes rendered output,
+// changes; files written by other versions are then ignored.
+constexpr u32 kCacheFileVersion = 1;
+
+// Rendered glyphs saved to disk so a restarted process starts with a warm
+// glyph cache. The file is used straight from its mapping: bitmaps loaded
+// from it are views of the mapped spans, not copies (where MappedFile can
+// only read the file in, as on Windows, they view that one copy). Only the
+// default variation instance is saved, as instance ids aren't stable
+// between runs.
+//
+// Layout, in native byte order:
+//     Header
+//     Entry[entryCount], sorted by key
+//     u32 rows[rowCount], each entry's height + 1 row starts
+//     Span spans[spanCount]
+class CacheFile {
+    /* === Methods === */
+public:
+    // Maps pPath and checks its header, which is all IsValid reflects;
+    // a missing file, one written for another font (see
+    // Font::GetContentHash) or by another version, or a truncated one, is
+    // rejected without reading further.
+    CacheFile(const std::string& pPath, const u64 pFontHash);
+
+    bool IsValid() const { return m_valid; }
+
+    // Inserts every saved bitmap into pCache, returning how many there
+    // were. The bitmaps point into this file, which must outlive them.
+    // Entries that would read outside the file or draw outside their own
+    // bounds are skipped.
+    size_t Populate(GlyphCache& pCache) const;
+
+    // Writes pCache's default instance entries to pPath. The file is
+    // written alongside and renamed into place, so a reader never sees it
+    // half written.
+    static bool Write(const std::string& pPath, const u64 pFontHash, const GlyphCache& pCache);
+
+private:
+    struct Header {
+        u32 magic;
+        u32 version;
+        u32 entrySize; // sizeof(Entry) and sizeof(Span), so a file from a
+        u32 spanSize; // platform with another layout is rejected.
+        u64 fontHash;
+        u64 fileSize;
+        u32 entryCount;
+        u32 rowCount;
+        u32 spanCount;
+        u32 reserved;
+    };
+
+    struct Entry {
+        GlyphKey key;
+        u32 firstRow; // into rows.
+        u32 firstSpan; // into spans; the entry's rows index from here.
+        u16 width, height;
+        float left, bottom;
+        u32 reserved;
+    };
+
+    static constexpr u32 kMagic = 0x4c464743; // 'LFGC'
+
+    bool IsEntryValid(const Entry& pEntry) const;
+
+    /* === Variables === */
+private:
+    MappedFile m_file;
+    bool m_valid = false;
+
+    const Header* m_header = nullptr;
+    const Entry* m_entries = nullptr;
+    const u32* m_rows = nullptr;
+    const Span* m_spans = nullptr;
+};
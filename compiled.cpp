@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+#include <system_error>
+#include <cstring>
+#include <vector>
+
+#include "compiled.h"
+#include "parser.h"
+
+//
+
+template <typename T>
+static std::span<const u8>
+AsBytes(std::span<const T> pData)
+{
+	return std::span<const u8>((const u8*)pData.data(), pData.size_bytes());
+}
+
+CompiledFont::CompiledFont(const u8* pData, const size_t pSize)
+{
+	if (!IsCompiledFont(pData, pSize) || pSize < sizeof(Header)) {
+		return;
+	}
+
+	const Header* header = (const Header*)pData;
+	if (header->version != kCompiledFontVersion || header->fileSize != pSize
+		|| header->sectionCount != (u32)Section::Count) {
+		return;
+	}
+
+	for (u32 k = 0; k < (u32)Section::Count; ++k) {
+		const SectionRange& range = header->sections[k];
+		if (range.offset % 8 || range.offset > pSize || range.size > pSize - range.offset) {
+			return;
+		}
+
+		m_sections[k] = std::span<const u8>(pData + range.offset, range.size);
+	}
+
+	m_glyphCount = header->glyphCount;
+	m_valid = HasValidSections();
+}
+
+CompiledFont::CompiledFont(const EmbeddedFont& pEmbedded)
+	: m_glyphCount(pEmbedded.glyphCount)
+{
+	// In Section order.
+	const std::span<const u8> sections[(u32)Section::Count] = {
+		pEmbedded.fontData,
+		AsBytes(pEmbedded.glyphOffsets),
+		AsBytes(pEmbedded.charMap),
+		AsBytes(pEmbedded.charRanges),
+		AsBytes(pEmbedded.advanceWidths),
+		AsBytes(pEmbedded.leftSideBearings),
+		AsBytes(pEmbedded.advanceHeights),
+		AsBytes(pEmbedded.topSideBearings),
+		AsBytes(pEmbedded.glyphBounds),
+		AsBytes(pEmbedded.kernKeys),
+		AsBytes(pEmbedded.kernValues),
+		AsBytes(pEmbedded.kernClassInfo),
+		AsBytes(pEmbedded.kernClasses),
+		AsBytes(pEmbedded.kernClassValues),
+		AsBytes(pEmbedded.outlineStarts),
+		AsBytes(pEmbedded.outlinePoints),
+		AsBytes(pEmbedded.outlineFlags),
+		AsBytes(pEmbedded.contourEnds),
+	};
+	std::copy(std::begin(sections), std::end(sections), m_sections);
+
+	m_valid = HasValidSections();
+}
+
+bool
+CompiledFont::HasValidSections() const
+{
+	// The per-glyph sections must cover every glyph, or be absent where
+	// that is allowed, so lookups by glyph id need no further checks.
+	const size_t glyphCount = m_glyphCount;
+	const auto count = [this](const Section pSection, const size_t pElementSize) {
+		const u64 size = m_sections[(u32)pSection].size();
+		return (size % pElementSize) ? ~(u64)0 : size / pElementSize;
+	};
+
+	if (count(Section::GlyphOffsets, sizeof(u32)) != glyphCount + 1
+		|| count(Section::AdvanceWidths, sizeof(u16)) != glyphCount
+		|| count(Section::LeftSideBearings, sizeof(s16)) != glyphCount
+		|| count(Section::GlyphBounds, sizeof(BoundingBox)) != glyphCount
+		|| count(Section::CharMap, sizeof(u16)) == ~(u64)0
+		|| count(Section::CharRanges, sizeof(CharRange)) == ~(u64)0) {
+		return false;
+	}
+
+	const u64 heights = count(Section::AdvanceHeights, sizeof(u16));
+	if ((heights != 0 && heights != glyphCount) || count(Section::TopSideBearings, sizeof(s16)) != heights) {
+		return false;
+	}
+
+	const u64 keys = count(Section::KernKeys, sizeof(u32));
+	if (count(Section::KernValues, sizeof(s16)) != keys || (keys & (keys - 1))) {
+		return false;
+	}
+
+	const std::span<const KernClassInfo> classInfo = GetSection<KernClassInfo>(Section::KernClassInfo);
+	u64 valueCount = 0;
+	for (const KernClassInfo& info : classInfo) {
+		valueCount += info.valueCount;
+	}
+	if (count(Section::KernClasses, sizeof(u16)) != classInfo.size() * 2 * glyphCount
+		|| count(Section::KernClassValues, sizeof(s16)) != valueCount) {
+		return false;
+	}
+
+	// Only the totals are checked here; the starts between are trusted.
+	const std::span<const DecodedOutlines::Start> starts = GetSection<DecodedOutlines::Start>(Section::OutlineStarts);
+	const u64 points = count(Section::OutlinePoints, sizeof(OutlinePoint));
+	if (count(Section::OutlineStarts, sizeof(DecodedOutlines::Start)) != glyphCount + 1
+		|| count(Section::OutlineFlags, sizeof(u8)) != points
+		|| starts.back().firstPoint != points
+		|| starts.back().firstContour != count(Section::ContourEnds, sizeof(u16))) {
+		return false;
+	}
+
+	return true;
+}
+
+bool
+CompiledFont::IsCompiledFont(const u8* pData, const size_t pSize)
+{
+	u32 magic;
+	if (pSize < sizeof(magic)) {
+		return false;
+	}
+
+	std::memcpy(&magic, pData, sizeof(magic));
+	return magic == kMagic;
+}
+
+DecodedOutlines
+CompiledFont::GetOutlines() const
+{
+	DecodedOutlines outlines;
+	outlines.starts = GetSection<DecodedOutlines::Start>(Section::OutlineStarts);
+	outlines.points = GetSection<OutlinePoint>(Section::OutlinePoints);
+	outlines.flags = GetSection<u8>(Section::OutlineFlags);
+	outlines.contourEnds = GetSection<u16>(Section::ContourEnds);
+
+	return outlines;
+}
+
+EmbeddedFont
+CompiledFont::GetSections() const
+{
+	EmbeddedFont sections;
+	sections.glyphCount = m_glyphCount;
+	sections.fontData = GetFontData();
+	sections.glyphOffsets = GetGlyphOffsets();
+	sections.charMap = GetCharMap();
+	sections.charRanges = GetCharRanges();
+	sections.advanceWidths = GetAdvanceWidths();
+	sections.leftSideBearings = GetLeftSideBearings();
+	sections.advanceHeights = GetAdvanceHeights();
+	sections.topSideBearings = GetTopSideBearings();
+	sections.glyphBounds = GetGlyphBounds();
+	sections.kernKeys = GetSection<u32>(Section::KernKeys);
+	sections.kernValues = GetSection<s16>(Section::KernValues);
+	sections.kernClassInfo = GetSection<KernClassInfo>(Section::KernClassInfo);
+	sections.kernClasses = GetSection<u16>(Section::KernClasses);
+	sections.kernClassValues = GetSection<s16>(Section::KernClassValues);
+	sections.outlineStarts = GetSection<DecodedOutlines::Start>(Section::OutlineStarts);
+	sections.outlinePoints = GetSection<OutlinePoint>(Section::OutlinePoints);
+	sections.outlineFlags = GetSection<u8>(Section::OutlineFlags);
+	sections.contourEnds = GetSection<u16>(Section::ContourEnds);
+
+	return sections;
+}
+
+void
+CompiledFont::LoadKerning(KerningTable& pKerning) const
+{
+	const std::span<const KernClassInfo> classInfo = GetSection<KernClassInfo>(Section::KernClassInfo);
+	const std::span<const u16> classes = GetSection<u16>(Section::KernClasses);
+	const std::span<const s16> values = GetSection<s16>(Section::KernClassValues);
+	const size_t glyphCount = m_glyphCount;
+
+	std::vector<KerningTable::ClassSubtable> subtables;
+	size_t valueStart = 0;
+	for (size_t k = 0; k < classInfo.size(); ++k) {
+		KerningTable::ClassSubtable sub;
+		sub.leftClasses = classes.subspan(2 * k * glyphCount, glyphCount);
+		sub.rightClasses = classes.subspan((2 * k + 1) * glyphCount, glyphCount);
+		sub.values = values.subspan(valueStart, classInfo[k].valueCount);
+		sub.rightClassCount = classInfo[k].rightClassCount;
+		sub.lookup = classInfo[k].lookup;
+		subtables.push_back(sub);
+
+		valueStart += classInfo[k].valueCount;
+	}
+
+	pKerning.LoadFlat(GetSection<u32>(Section::KernKeys), GetSection<s16>(Section::KernValues), std::move(subtables));
+}
+
+std::vector<u8>
+CompiledFont::Compile(const Parser& pParser, std::span<const u8> pFontData)
+{
+	const u32 glyphCount = pParser.numGlyphs;
+
+	std::vector<u32> glyphOffsets(glyphCount + 1);
+	std::vector<BoundingBox> glyphBounds;
+	glyphBounds.reserve(glyphCount);
+	for (GlyphID k = 0; k < glyphCount; ++k) {
+		u32 length;
+		pParser.GetGlyphLocation(k, glyphOffsets[k], length);
+		glyphOffsets[k + 1] = glyphOffsets[k] + length;
+		glyphBounds.push_back(pParser.GetGlyphBounds(k));
+	}
+
+	// The encoder only maps the BMP, so the dense map never needs more than
+	// 64K entries; it is cut short after the last mapped char-code.
+	std::vector<u16> charMap;
+	if (pParser.encoder) {
+		charMap.resize(0x10000);
+		size_t end = 0;
+		for (CharCode c = 0; c < charMap.size(); ++c) {
+			charMap[c] = (u16)pParser.encoder->GetGlyphID(c);
+			if (charMap[c]) {
+				end = c + 1;
+			}
+		}
+		charMap.resize(end);
+	}
+
+	const KerningTable& kerning = pParser.kerning;
+	std::vector<KernClassInfo> classInfo;
+	std::vector<u16> classes;
+	std::vector<s16> classValues;
+	for (const auto& sub : kerning.GetClassSubtables()) {
+		classInfo.push_back({ (u32)sub.values.size(), sub.rightClassCount, sub.lookup });
+		classes.insert(classes.end(), sub.leftClasses.begin(), sub.leftClasses.end());
+		classes.insert(classes.end(), sub.rightClasses.begin(), sub.rightClasses.end());
+		classValues.insert(classValues.end(), sub.values.begin(), sub.values.end());
+	}
+
+	// Every glyph's default outline, for the renderer to flatten in place
+	// of decoding glyf. Empty contours would give nothing to flatten.
+	std::vector<DecodedOutlines::Start> outlineStarts;
+	std::vector<OutlinePoint> outlinePoints;
+	std::vector<u8> outlineFlags;
+	std::vector<u16> contourEnds;
+	outlineStarts.reserve(glyphCount + 1);
+	for (GlyphID k = 0; k < glyphCount; ++k) {
+		outlineStarts.push_back({ (u32)outlinePoints.size(), (u32)contourEnds.size() });
+
+		const GlyphDescription desc = pParser.LoadGlyph(k);
+		const size_t firstPoint = outlinePoints.size();
+		for (const Contour& contour : desc.mesh.contours) {
+			if (contour.flags.empty()) {
+				continue;
+			}
+
+			for (size_t i = 0; i < contour.getTotalPtCount(); ++i) {
+				outlinePoints.push_back({ contour.xs[i], contour.ys[i] });
+			}
+			outlineFlags.insert(outlineFlags.end(), contour.flags.begin(), contour.flags.end());
+			contourEnds.push_back((u16)(outlinePoints.size() - firstPoint - 1));
+		}
+	}
+	outlineStarts.push_back({ (u32)outlinePoints.size(), (u32)contourEnds.size() });
+
+	// Sections in file order, each with its bytes.
+	const std::span<const u8> sections[(u32)Section::Count] = {
+		pFontData,
+		AsBytes<u32>(glyphOffsets),
+		AsBytes<u16>(charMap),
+		{}, // the dense map is written instead.
+		AsBytes<u16>(pParser.advanceWidths),
+		AsBytes<s16>(pParser.leftSideBearings),
+		AsBytes<u16>(pParser.advanceHeights),
+		AsBytes<s16>(pParser.topSideBearings),
+		AsBytes<BoundingBox>(glyphBounds),
+		AsBytes<u32>(kerning.GetPairKeys()),
+		AsBytes<s16>(kerning.GetPairValues()),
+		AsBytes<KernClassInfo>(classInfo),
+		AsBytes<u16>(classes),
+		AsBytes<s16>(classValues),
+		AsBytes<DecodedOutlines::Start>(outlineStarts),
+		AsBytes<OutlinePoint>(outlinePoints),
+		AsBytes<u8>(outlineFlags),
+		AsBytes<u16>(contourEnds),
+	};
+
+	Header header = {};
+	header.magic = kMagic;
+	header.version = kCompiledFontVersion;
+	header.glyphCount = glyphCount;
+	header.sectionCount = (u32)Section::Count;
+
+	u64 offset = sizeof(Header);
+	for (u32 k = 0; k < (u32)Section::Count; ++k) {
+		offset = (offset + 7) & ~(u64)7;
+		header.sections[k].offset = offset;
+		header.sections[k].size = sections[k].size();
+		offset += sections[k].size();
+	}
+	header.fileSize = offset;
+
+	std::vector<u8> compiled(header.fileSize, 0);
+	std::memcpy(compiled.data(), &header, sizeof(Header));
+	for (u32 k = 0; k < (u32)Section::Count; ++k) {
+		std::copy(sections[k].begin(), sections[k].end(), compiled.begin() + header.sections[k].offset);
+	}
+
+	return compiled;
+}
+
+bool
+CompiledFont::Write(const std::string& pPath, const Parser& pParser, std::span<const u8> pFontData)
+{
+	const std::vector<u8> compiled = Compile(pParser, pFontData);
+
+	const std::string tempPath = pPath + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			return false;
+		}
+
+		file.write((const char*)compiled.data(), compiled.size());
+		if (!file.good()) {
+			file.close();
+			std::error_code error;
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+	}
+
+	// Unlike std::rename on Windows, this replaces an existing file.
+	std::error_code error;
+	std::filesystem::rename(tempPath, pPath, error);
+	return !error;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <string>
+#include <span>
+#include <vector>
+
+#include "base.h"
+#include "outline.h"
+#include "kerning.h"
+#include "encodings.h"
+
+//
+
+struct Parser;
+struct EmbeddedFont;
+
+// Bump whenever the file layout, or the meaning of any index in it,
+// changes; files written by other versions are then rejected.
+constexpr u32 kCompiledFontVersion = 4;
+
+// A font with the indexes Parser would otherwise build at startup already
+// built, so that opening it costs the same whatever the font's size: the
+// glyph locations (flattened loca), a dense character map, the unpacked
+// metrics, the kerning hash and class arrays, every glyph's bounds, and its
+// default outline already decoded (see DecodedOutlines). The original font
+// is carried whole for what is still read from its tables: the hinting
+// programs, embedded bitmaps and variations. Written offline (see fntc.cpp)
+// from single fonts only, not collections; Font opens either kind of file.
+//
+// Layout, in native byte order, with each section 8-byte aligned:
+//     Header
+//     the sections listed in Section, at the offsets the header gives
+class CompiledFont {
+    /* === Methods === */
+public:
+    // A view of a compiled font already in memory, which must outlive it.
+    // Only the header and section bounds are checked, which is all IsValid
+    // reflects; the indexes are trusted as written.
+    CompiledFont(const u8* pData, const size_t pSize);
+
+    // A view of a compiled font embedded in the program (see fntgen.cpp).
+    // The arrays are checked as above.
+    CompiledFont(const EmbeddedFont& pEmbedded);
+
+    // Whether pData starts like a compiled font rather than a TrueType one.
+    static bool IsCompiledFont(const u8* pData, const size_t pSize);
+
+    bool IsValid() const { return m_valid; }
+
+    u32 GetGlyphCount() const { return m_glyphCount; }
+
+    std::span<const u8> GetFontData() const { return GetSection<u8>(Section::FontData); }
+    std::span<const u32> GetGlyphOffsets() const { return GetSection<u32>(Section::GlyphOffsets); }
+    std::span<const u16> GetCharMap() const { return GetSection<u16>(Section::CharMap); }
+    std::span<const CharRange> GetCharRanges() const { return GetSection<CharRange>(Section::CharRanges); }
+    std::span<const u16> GetAdvanceWidths() const { return GetSection<u16>(Section::AdvanceWidths); }
+    std::span<const s16> GetLeftSideBearings() const { return GetSection<s16>(Section::LeftSideBearings); }
+    std::span<const u16> GetAdvanceHeights() const { return GetSection<u16>(Section::AdvanceHeights); }
+    std::span<const s16> GetTopSideBearings() const { return GetSection<s16>(Section::TopSideBearings); }
+    std::span<const BoundingBox> GetGlyphBounds() const { return GetSection<BoundingBox>(Section::GlyphBounds); }
+    DecodedOutlines GetOutlines() const;
+
+    // Every section, as the arrays fntgen embeds.
+    EmbeddedFont GetSections() const;
+
+    // Points pKerning at the compiled kerning arrays (see
+    // KerningTable::LoadFlat).
+    void LoadKerning(KerningTable& pKerning) const;
+
+    // Compiles the font pParser was created over, whose whole file is
+    // pFontData. Write saves it to pPath, writing the file alongside and
+    // renaming it into place, so a reader never sees it half written.
+    static std::vector<u8> Compile(const Parser& pParser, std::span<const u8> pFontData);
+    static bool Write(const std::string& pPath, const Parser& pParser, std::span<const u8> pFontData);
+
+    struct KernClassInfo {
+        u32 valueCount;
+        u16 rightClassCount;
+        u16 lookup;
+    };
+
+private:
+    enum class Section : u32 {
+        FontData,
+        GlyphOffsets, // glyphCount + 1 entries.
+        CharMap, // glyph id by char-code, up to the last mapped one.
+        CharRanges, // or the same as runs, in place of the dense map.
+        AdvanceWidths, // glyphCount entries each, as are the others below.
+        LeftSideBearings,
+        AdvanceHeights, // empty without vertical metrics.
+        TopSideBearings,
+        GlyphBounds,
+        KernKeys, // the pair hash.
+        KernValues,
+        KernClassInfo, // a KernClassInfo per class subtable,
+        KernClasses, // whose left then right classes follow here in turn,
+        KernClassValues, // and value matrices here.
+        OutlineStarts, // glyphCount + 1 entries.
+        OutlinePoints,
+        OutlineFlags, // one per point.
+        ContourEnds,
+        Count
+    };
+
+    struct SectionRange {
+        u64 offset;
+        u64 size; // in bytes.
+    };
+
+    struct Header {
+        u32 magic;
+        u32 version;
+        u64 fileSize;
+        u32 glyphCount;
+        u32 sectionCount;
+        SectionRange sections[(u32)Section::Count];
+    };
+
+    // Whether every section is sized for the glyph count.
+    bool HasValidSections() const;
+
+    template <typename T>
+    std::span<const T> GetSection(const Section pSection) const
+    {
+        const std::span<const u8> section = m_sections[(u32)pSection];
+        return std::span<const T>((const T*)section.data(), section.size() / sizeof(T));
+    }
+
+    static constexpr u32 kMagic = 0x4c464346; // 'LFCF'
+
+    /* === Variables === */
+private:
+    std::span<const u8> m_sections[(u32)Section::Count];
+    u32 m_glyphCount = 0;
+    bool m_valid = false;
+};
+
+// A compiled font's sections as separate arrays rather than one file, as
+// fntgen writes them into a program's source. Sections a font lacks are
+// left empty; embedded fonts give their character map as charRanges.
+struct EmbeddedFont {
+    u32 glyphCount;
+    std::span<const u8> fontData;
+    std::span<const u32> glyphOffsets;
+    std::span<const u16> charMap;
+    std::span<const CharRange> charRanges;
+    std::span<const u16> advanceWidths;
+    std::span<const s16> leftSideBearings;
+    std::span<const u16> advanceHeights;
+    std::span<const s16> topSideBearings;
+    std::span<const BoundingBox> glyphBounds;
+    std::span<const u32> kernKeys;
+    std::span<const s16> kernValues;
+    std::span<const CompiledFont::KernClassInfo> kernClassInfo;
+    std::span<const u16> kernClasses;
+    std::span<const s16> kernClassValues;
+    std::span<const DecodedOutlines::Start> outlineStarts;
+    std::span<const OutlinePoint> outlinePoints;
+    std::span<const u8> outlineFlags;
+    std::span<const u16> contourEnds;
+};
@@ -32,23 +32,100 @@ BasicUnicodeEncoder::BasicUnicodeEncoder(const void *pEncodingTable)
     for (size_t k = 0; k < segmentCount; ++k) {
         glyphIndexArray_.emplace_back(stream_.GetField<u16>());
     }
+
+    FillLatin1();
+}
+
+BasicUnicodeEncoder::BasicUnicodeEncoder(std::span<const u16> pDenseMap)
+    : stream_(nullptr), denseMap_(pDenseMap)
+{
+    FillLatin1();
+}
+
+BasicUnicodeEncoder::BasicUnicodeEncoder(std::span<const CharRange> pRanges)
+    : stream_(nullptr), ranges_(pRanges)
+{
+    FillLatin1();
+}
+
+void
+BasicUnicodeEncoder::FillLatin1()
+{
+    for (CharCode c = 0; c < latin1_.size(); ++c) {
+        if (!denseMap_.empty()) {
+            latin1_[c] = (c < denseMap_.size()) ? denseMap_[c] : 0;
+        }
+        else if (!ranges_.empty()) {
+            latin1_[c] = (u16)FindInRanges(c);
+        }
+        else {
+            latin1_[c] = (u16)FindInSegments(c);
+        }
+    }
 }
 
 GlyphID
 BasicUnicodeEncoder::GetGlyphID(const CharCode pCharCode) const
 {
-    // Determine which segment the char-code lies within.
-    const Segment *segment = nullptr;
-    for (size_t k = 0; k < segments_.size(); ++k) {
-        const Segment *seg = &segments_[k];
-
-        if (pCharCode >= seg->startCharCode && pCharCode <= seg->endCharCode) {
-            segment = seg;
-            break;
+    if (pCharCode < latin1_.size()) {
+        return latin1_[pCharCode];
+    }
+
+    if (!denseMap_.empty()) {
+        return (pCharCode < denseMap_.size()) ? denseMap_[pCharCode] : 0;
+    }
+
+    if (!ranges_.empty()) {
+        return FindInRanges(pCharCode);
+    }
+
+    return FindInSegments(pCharCode);
+}
+
+GlyphID
+BasicUnicodeEncoder::FindInRanges(const CharCode pCharCode) const
+{
+    // The first range ending at or after the char-code.
+    size_t lo = 0, hi = ranges_.size();
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (ranges_[mid].last < pCharCode) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    if (lo == ranges_.size() || pCharCode < ranges_[lo].first) {
+        return 0;
+    }
+
+    return ranges_[lo].firstGlyphID + (pCharCode - ranges_[lo].first);
+}
+
+GlyphID
+BasicUnicodeEncoder::FindInSegments(const CharCode pCharCode) const
+{
+    // Determine which segment the char-code lies within. Segments are
+    // sorted by end code, so binary search for the first one ending at or
+    // after the char-code.
+    size_t lo = 0, hi = segments_.size();
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (segments_[mid].endCharCode < pCharCode) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
         }
     }
 
-    assert(segment); // We don't have a mapping for this char-code.
+    if (lo == segments_.size() || pCharCode < segments_[lo].startCharCode) {
+        return 0; // no mapping for this char-code, so use the null glyph.
+    }
+
+    const Segment *segment = &segments_[lo];
 
     //
 
@@ -65,3 +142,56 @@ BasicUnicodeEncoder::GetGlyphID(const CharCode pCharCode) const
 
     return glyphID;
 }
+
+CharCode
+DecodeUTF8(const char*& pCursor, const char* pEnd)
+{
+    constexpr CharCode kReplacementChar = 0xFFFD;
+
+    const u8 lead = (u8)*pCursor++;
+    if (lead < 0x80) {
+        return lead;
+    }
+
+    // Work out the sequence length and initial bits from the lead byte.
+    size_t trailCount = 0;
+    CharCode charCode = 0;
+    CharCode minCharCode = 0; // rejects overlong encodings.
+    if ((lead & 0xE0) == 0xC0) {
+        trailCount = 1;
+        charCode = lead & 0x1F;
+        minCharCode = 0x80;
+    }
+    else if ((lead & 0xF0) == 0xE0) {
+        trailCount = 2;
+        charCode = lead & 0x0F;
+        minCharCode = 0x800;
+    }
+    else if ((lead & 0xF8) == 0xF0) {
+        trailCount = 3;
+        charCode = lead & 0x07;
+        minCharCode = 0x10000;
+    }
+    else {
+        return kReplacementChar;
+    }
+
+    if ((size_t)(pEnd - pCursor) < trailCount) {
+        return kReplacementChar;
+    }
+
+    for (size_t k = 0; k < trailCount; ++k) {
+        const u8 trail = (u8)pCursor[k];
+        if ((trail & 0xC0) != 0x80) {
+            return kReplacementChar;
+        }
+        charCode = (charCode << 6) | (trail & 0x3F);
+    }
+
+    if (charCode < minCharCode || charCode > 0x10FFFF) {
+        return kReplacementChar;
+    }
+
+    pCursor += trailCount;
+    return charCode;
+}
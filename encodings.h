@@ -1,19 +1,50 @@
 #pragma  once
 
 #include <vector>
+#include <array>
+#include <span>
 #include "base.h"
 #include "stream.h"
 
 using CharCode = u32;
 using GlyphID = u32;
 
+// Decodes the code point at pCursor and advances past it. Malformed or
+// truncated sequences decode to U+FFFD and consume a single byte.
+CharCode DecodeUTF8(const char*& pCursor, const char* pEnd);
+
+// A run of consecutive char-codes mapped to consecutive glyph ids, the
+// form an embedded font's character map takes (see EmbeddedFont).
+struct CharRange {
+    CharCode first;
+    CharCode last;
+    GlyphID firstGlyphID;
+};
+
 class BasicUnicodeEncoder {
     public:
 
     BasicUnicodeEncoder(const void* pEncodingTable);
 
+    // A dense map from char-code to glyph id, as precompiled fonts store
+    // (see CompiledFont); char-codes past its end map to the null glyph.
+    BasicUnicodeEncoder(std::span<const u16> pDenseMap);
+
+    // Runs sorted by char-code; char-codes outside them map to the null
+    // glyph.
+    BasicUnicodeEncoder(std::span<const CharRange> pRanges);
+
     GlyphID GetGlyphID(const CharCode pCharCode) const;
 
+    private:
+
+    // The full lookup, binary searching the format 4 segments.
+    GlyphID FindInSegments(const CharCode pCharCode) const;
+    GlyphID FindInRanges(const CharCode pCharCode) const;
+    void FillLatin1();
+
+    public:
+
     //
 
     struct Segment {
@@ -31,4 +62,10 @@ class BasicUnicodeEncoder {
     Stream stream_;
     std::vector<Segment> segments_;
     std::vector<u16> glyphIndexArray_;
+    std::span<const u16> denseMap_;
+    std::span<const CharRange> ranges_;
+
+    // Latin-1 is looked up directly: measured text is mostly ASCII, and a
+    // table lookup beats searching the segments for it.
+    std::array<u16, 256> latin1_;
 };
\ No newline at end of file
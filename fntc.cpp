@@ -0,0 +1,41 @@
+#include <cstdio>
+
+#include "mapping.h"
+#include "parser.h"
+#include "compiled.h"
+
+// Compiles a TrueType font into the precompiled form Font opens without
+// building any indexes (see CompiledFont):
+//     fntc <font.ttf> <output>
+int main(int argc, char *argv[])
+{
+	if (argc != 3) {
+		std::fprintf(stderr, "usage: %s <font.ttf> <output>\n", argv[0]);
+		return 1;
+	}
+
+	MappedFile font(argv[1]);
+	if (!font.IsOpen()) {
+		std::fprintf(stderr, "%s: can't open %s\n", argv[0], argv[1]);
+		return 1;
+	}
+
+	if (CompiledFont::IsCompiledFont(font.GetData(), font.GetSize())) {
+		std::fprintf(stderr, "%s: %s is already compiled\n", argv[0], argv[1]);
+		return 1;
+	}
+
+	// A compiled font holds a single face, and is opened as one.
+	if (Parser::GetFaceDirectories(font.GetData()).front() != 0) {
+		std::fprintf(stderr, "%s: %s is a font collection, which can't be compiled\n", argv[0], argv[1]);
+		return 1;
+	}
+
+	const Parser parser(font.GetData());
+	if (!CompiledFont::Write(argv[2], parser, std::span<const u8>(font.GetData(), font.GetSize()))) {
+		std::fprintf(stderr, "%s: can't write %s\n", argv[0], argv[2]);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,190 @@
+#include <cstdio>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "mapping.h"
+#include "parser.h"
+#include "compiled.h"
+
+// Generates a C++ header embedding a font, precompiled (see CompiledFont),
+// as constexpr arrays that Font and library use where they lie:
+//     fntgen <font.ttf> <name> <output.h>
+// declares k<name>, an EmbeddedFont, for use as e.g. library lib(kLato).
+// Each index is its own typed array: the glyph offsets, metrics and bounds,
+// the character map as ranges, the kerning arrays, and every glyph's
+// outline pre-decoded into points, flags and contour ends. The font itself
+// is carried too, for the tables still read from it at render time. As the
+// arrays are typed, the header builds for targets of either byte order.
+
+// Writes pValues as the constexpr array k<name><pSuffix>, pPerLine to a
+// line, each formatted by pFormat. Nothing is written for an empty section,
+// as C++ has no empty arrays; its span is simply left empty.
+template <typename T>
+static bool
+WriteArray(FILE* pOut, const std::string& pName, const char* pType, const char* pSuffix, std::span<const T> pValues,
+	const size_t pPerLine, const std::function<std::string(const T&)>& pFormat)
+{
+	if (pValues.empty()) {
+		return false;
+	}
+
+	std::fprintf(pOut, "inline constexpr %s k%s%s[%zu] = {", pType, pName.c_str(), pSuffix, pValues.size());
+	for (size_t k = 0; k < pValues.size(); ++k) {
+		std::fprintf(pOut, (k % pPerLine) ? " %s," : "\n\t%s,", pFormat(pValues[k]).c_str());
+	}
+	std::fprintf(pOut, "\n};\n\n");
+
+	return true;
+}
+
+template <typename T>
+static std::string
+FormatInteger(const T& pValue)
+{
+	return std::to_string(pValue);
+}
+
+static std::string
+FormatFloat(const float pValue)
+{
+	// Enough digits to read back the same float.
+	char text[32];
+	std::snprintf(text, sizeof(text), "%.9g", pValue);
+	return text;
+}
+
+// The dense map as runs of consecutive char-codes mapped to consecutive
+// glyph ids; unmapped char-codes are left out.
+static std::vector<CharRange>
+GetCharRanges(std::span<const u16> pCharMap)
+{
+	std::vector<CharRange> ranges;
+	for (CharCode c = 0; c < pCharMap.size(); ++c) {
+		if (!pCharMap[c]) {
+			continue;
+		}
+
+		if (!ranges.empty() && ranges.back().last + 1 == c
+			&& ranges.back().firstGlyphID + (c - ranges.back().first) == pCharMap[c]) {
+			ranges.back().last = c;
+		}
+		else {
+			ranges.push_back({ c, c, pCharMap[c] });
+		}
+	}
+
+	return ranges;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 4) {
+		std::fprintf(stderr, "usage: %s <font.ttf> <name> <output.h>\n", argv[0]);
+		return 1;
+	}
+
+	const std::string name = argv[2];
+	bool isIdentifier = !name.empty() && !std::isdigit((u8)name[0]);
+	for (const char c : name) {
+		isIdentifier &= (std::isalnum((u8)c) || c == '_');
+	}
+	if (!isIdentifier) {
+		std::fprintf(stderr, "%s: %s isn't a valid identifier\n", argv[0], argv[2]);
+		return 1;
+	}
+
+	MappedFile font(argv[1]);
+	if (!font.IsOpen()) {
+		std::fprintf(stderr, "%s: can't open %s\n", argv[0], argv[1]);
+		return 1;
+	}
+
+	// A font already compiled by fntc is embedded as it is.
+	std::vector<u8> data(font.GetData(), font.GetData() + font.GetSize());
+	if (!CompiledFont::IsCompiledFont(font.GetData(), font.GetSize())) {
+		if (Parser::GetFaceDirectories(font.GetData()).front() != 0) {
+			std::fprintf(stderr, "%s: %s is a font collection, which can't be embedded\n", argv[0], argv[1]);
+			return 1;
+		}
+
+		const Parser parser(font.GetData());
+		data = CompiledFont::Compile(parser, std::span<const u8>(font.GetData(), font.GetSize()));
+	}
+
+	const CompiledFont compiled(data.data(), data.size());
+	if (!compiled.IsValid()) {
+		std::fprintf(stderr, "%s: %s isn't a compiled font of this version\n", argv[0], argv[1]);
+		return 1;
+	}
+
+	FILE* out = std::fopen(argv[3], "w");
+	if (!out) {
+		std::fprintf(stderr, "%s: can't write %s\n", argv[0], argv[3]);
+		return 1;
+	}
+
+	std::fprintf(out, "// Generated by fntgen from %s; do not edit.\n", argv[1]);
+	std::fprintf(out, "#pragma once\n\n#include \"compiled.h\"\n\n//\n\n");
+
+	// Each section given, in EmbeddedFont order, as the initializer that
+	// points the field at its array.
+	std::vector<std::string> fields;
+	const auto section = [&](const char* pField, const char* pSuffix, const bool pWritten) {
+		if (pWritten) {
+			fields.push_back(std::string(".") + pField + " = k" + name + pSuffix);
+		}
+	};
+
+	const EmbeddedFont sections = compiled.GetSections();
+
+	section("fontData", "FontData", WriteArray<u8>(out, name, "u8", "FontData", sections.fontData, 16, FormatInteger<u8>));
+	section("glyphOffsets", "GlyphOffsets", WriteArray<u32>(out, name, "u32", "GlyphOffsets", sections.glyphOffsets, 8, FormatInteger<u32>));
+
+	const std::vector<CharRange> charRanges = GetCharRanges(sections.charMap);
+	section("charRanges", "CharRanges", WriteArray<CharRange>(out, name, "CharRange", "CharRanges", charRanges, 4, [](const CharRange& pRange) {
+		return "{ " + std::to_string(pRange.first) + ", " + std::to_string(pRange.last) + ", " + std::to_string(pRange.firstGlyphID) + " }";
+	}));
+
+	section("advanceWidths", "AdvanceWidths", WriteArray<u16>(out, name, "u16", "AdvanceWidths", sections.advanceWidths, 16, FormatInteger<u16>));
+	section("leftSideBearings", "LeftSideBearings", WriteArray<s16>(out, name, "s16", "LeftSideBearings", sections.leftSideBearings, 16, FormatInteger<s16>));
+	section("advanceHeights", "AdvanceHeights", WriteArray<u16>(out, name, "u16", "AdvanceHeights", sections.advanceHeights, 16, FormatInteger<u16>));
+	section("topSideBearings", "TopSideBearings", WriteArray<s16>(out, name, "s16", "TopSideBearings", sections.topSideBearings, 16, FormatInteger<s16>));
+	section("glyphBounds", "GlyphBounds", WriteArray<BoundingBox>(out, name, "BoundingBox", "GlyphBounds", sections.glyphBounds, 4, [](const BoundingBox& pBB) {
+		return "{ " + FormatFloat(pBB.xMin) + ", " + FormatFloat(pBB.yMin) + ", " + FormatFloat(pBB.xMax) + ", " + FormatFloat(pBB.yMax) + " }";
+	}));
+
+	section("kernKeys", "KernKeys", WriteArray<u32>(out, name, "u32", "KernKeys", sections.kernKeys, 8, FormatInteger<u32>));
+	section("kernValues", "KernValues", WriteArray<s16>(out, name, "s16", "KernValues", sections.kernValues, 16, FormatInteger<s16>));
+	section("kernClassInfo", "KernClassInfo", WriteArray<CompiledFont::KernClassInfo>(out, name, "CompiledFont::KernClassInfo", "KernClassInfo",
+		sections.kernClassInfo, 4, [](const CompiledFont::KernClassInfo& pInfo) {
+			return "{ " + std::to_string(pInfo.valueCount) + ", " + std::to_string(pInfo.rightClassCount) + ", " + std::to_string(pInfo.lookup) + " }";
+		}));
+	section("kernClasses", "KernClasses", WriteArray<u16>(out, name, "u16", "KernClasses", sections.kernClasses, 16, FormatInteger<u16>));
+	section("kernClassValues", "KernClassValues", WriteArray<s16>(out, name, "s16", "KernClassValues", sections.kernClassValues, 16, FormatInteger<s16>));
+
+	section("outlineStarts", "OutlineStarts", WriteArray<DecodedOutlines::Start>(out, name, "DecodedOutlines::Start", "OutlineStarts",
+		sections.outlineStarts, 8, [](const DecodedOutlines::Start& pStart) {
+			return "{ " + std::to_string(pStart.firstPoint) + ", " + std::to_string(pStart.firstContour) + " }";
+		}));
+	section("outlinePoints", "OutlinePoints", WriteArray<OutlinePoint>(out, name, "OutlinePoint", "OutlinePoints", sections.outlinePoints, 8, [](const OutlinePoint& pPoint) {
+		return "{ " + std::to_string(pPoint.x) + ", " + std::to_string(pPoint.y) + " }";
+	}));
+	section("outlineFlags", "OutlineFlags", WriteArray<u8>(out, name, "u8", "OutlineFlags", sections.outlineFlags, 16, FormatInteger<u8>));
+	section("contourEnds", "ContourEnds", WriteArray<u16>(out, name, "u16", "ContourEnds", sections.contourEnds, 16, FormatInteger<u16>));
+
+	std::fprintf(out, "inline constexpr EmbeddedFont k%s = {\n\t.glyphCount = %u,\n", name.c_str(), compiled.GetGlyphCount());
+	for (const std::string& field : fields) {
+		std::fprintf(out, "\t%s,\n", field.c_str());
+	}
+	std::fprintf(out, "};\n");
+
+	const bool written = (std::ferror(out) == 0);
+	if (std::fclose(out) != 0 || !written) {
+		std::fprintf(stderr, "%s: can't write %s\n", argv[0], argv[3]);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,1969 @@
+#include <algorithm>
+#include <assert.h>
+#include <bit>
+#include <cmath>
+
+#include "hinting.h"
+#include "raster.h"
+
+//
+
+#define phantomPointCount 4
+
+// a * b / c, rounded to nearest.
+static s32
+MulDiv(const s32 a, const s32 b, const s32 c)
+{
+	const s64 p = (s64)a * b;
+	if (c == 0) {
+		return (p < 0) ? -0x7fffffff : 0x7fffffff;
+	}
+
+	const s64 absP = (p < 0) ? -p : p;
+	const s64 absC = (c < 0) ? -(s64)c : c;
+	const s64 q = (absP + absC / 2) / absC;
+
+	return (s32)(((p < 0) != (c < 0)) ? -q : q);
+}
+
+// Scales design units by a 16.16 factor, rounded to nearest.
+static s32
+ScaleValue(const s32 pValue, const s32 pScale)
+{
+	return MulDiv(pValue, pScale, 0x10000);
+}
+
+static s32
+PixelRound(const s32 pValue)
+{
+	return (pValue + 32) & -64;
+}
+
+// Length in bytes of the instruction at pIp, including inline data.
+static size_t
+GetInstructionLength(const u8* pIp, const u8* pEnd)
+{
+	const u8 opcode = *pIp;
+
+	if (opcode == 0x40) { // NPUSHB
+		return (pIp + 1 < pEnd) ? 2 + pIp[1] : 1;
+	}
+	if (opcode == 0x41) { // NPUSHW
+		return (pIp + 1 < pEnd) ? 2 + 2 * pIp[1] : 1;
+	}
+	if (opcode >= 0xb0 && opcode <= 0xb7) { // PUSHB
+		return 1 + (opcode - 0xb0 + 1);
+	}
+	if (opcode >= 0xb8 && opcode <= 0xbf) { // PUSHW
+		return 1 + 2 * (opcode - 0xb8 + 1);
+	}
+
+	return 1;
+}
+
+// Skips the body of a branch, leaving pIp just past the matching EIF (or
+// ELSE, when pStopAtElse is set). Returns false if the program ends first.
+static bool
+SkipBranch(const u8*& pIp, const u8* pEnd, const bool pStopAtElse)
+{
+	s32 nesting = 1;
+
+	while (pIp < pEnd) {
+		const u8 opcode = *pIp;
+		pIp += GetInstructionLength(pIp, pEnd);
+
+		if (opcode == 0x58) { // IF
+			++nesting;
+		}
+		else if (opcode == 0x59 && --nesting == 0) { // EIF
+			return true;
+		}
+		else if (opcode == 0x1b && nesting == 1 && pStopAtElse) { // ELSE
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Skips a function body, leaving pIp just past its ENDF.
+static bool
+SkipFunction(const u8*& pIp, const u8* pEnd)
+{
+	while (pIp < pEnd) {
+		const u8 opcode = *pIp;
+		pIp += GetInstructionLength(pIp, pEnd);
+
+		if (opcode == 0x2d) { // ENDF
+			return pIp <= pEnd;
+		}
+		if (opcode == 0x2c || opcode == 0x89) { // FDEF and IDEF don't nest.
+			return false;
+		}
+	}
+
+	return false;
+}
+
+// Unit vector along (pDx, pDy) in F2Dot14. Newton's iterations on a
+// prenormalized vector, in integers so results don't depend on the FPU.
+static bool
+NormalizeVector(const s32 pDx, const s32 pDy, s32& pX, s32& pY)
+{
+	if (pDx == 0 && pDy == 0) {
+		return false;
+	}
+
+	u32 x = (u32)std::abs(pDx);
+	u32 y = (u32)std::abs(pDy);
+	if (x == 0 || y == 0) {
+		pX = (pDx > 0) ? 0x4000 : (pDx < 0) ? -0x4000 : 0;
+		pY = (pDy > 0) ? 0x4000 : (pDy < 0) ? -0x4000 : 0;
+		return true;
+	}
+
+	// Shift so the estimated length is between 2/3 and 4/3 in 16.16.
+	u32 l = (x > y) ? x + (y >> 1) : y + (x >> 1);
+	s32 shift = std::countl_zero(l);
+	shift -= 15 + (l >= (0xaaaaaaaau >> shift));
+
+	if (shift > 0) {
+		x <<= shift;
+		y <<= shift;
+		l = (x > y) ? x + (y >> 1) : y + (x >> 1);
+	}
+	else {
+		x >>= -shift;
+		y >>= -shift;
+		l >>= -shift;
+	}
+
+	s32 b = 0x10000 - (s32)l;
+	u32 u, v;
+	s32 z;
+	do {
+		u = (u32)((s32)x + (((s32)x * b) >> 16));
+		v = (u32)((s32)y + (((s32)y * b) >> 16));
+
+		z = -(s32)(u * u + v * v) / 0x200;
+		z = z * ((0x10000 + b) >> 8) / 0x10000;
+		b += z;
+	} while (z > 0);
+
+	pX = ((pDx < 0) ? -(s32)u : (s32)u) / 4;
+	pY = ((pDy < 0) ? -(s32)v : (s32)v) / 4;
+
+	return true;
+}
+
+//
+
+void
+GlyphHinter::Zone::Resize(const size_t pCount)
+{
+	orus.assign(pCount, Vector{ 0, 0 });
+	org.assign(pCount, Vector{ 0, 0 });
+	cur.assign(pCount, Vector{ 0, 0 });
+	flags.assign(pCount, 0);
+	contourEnds.clear();
+}
+
+HintingProgram::HintingProgram(const Parser& pParser)
+	: parser(pParser)
+{
+	definitions.instructions.fill(FunctionDef());
+
+	if (!parser.HasTable("glyf") || !parser.HasTable("maxp")) {
+		return;
+	}
+
+	Stream maxp = parser.GetTable("maxp");
+	if (maxp.GetField<u32>() != 0x00010000) {
+		return; // version 0.5 carries no hinting limits.
+	}
+
+	maxp.Skip(10); // skip numGlyphs to maxCompositeContours
+	maxp.SkipField<u16>(); // skip maxZones
+	maxTwilightPoints = maxp.GetField<u16>();
+	maxStorage = maxp.GetField<u16>();
+	maxFunctionDefs = maxp.GetField<u16>();
+	maxp.SkipField<u16>(); // skip maxInstructionDefs
+	maxStackElements = maxp.GetField<u16>();
+
+	// Without vmtx, the vertical phantom points come from the OS/2 line
+	// metrics, as in other rasterizers.
+	verticalAscender = parser.ascender;
+	verticalDescender = parser.descender;
+	if (parser.HasTable("os/2")) {
+		Stream os2 = parser.GetTable("os/2");
+		os2.Skip(68); // skip to sTypoAscender
+		verticalAscender = os2.GetField<s16>();
+		verticalDescender = os2.GetField<s16>();
+	}
+
+	if (parser.HasTable("cvt ")) {
+		Stream cvt = parser.GetTable("cvt ");
+		designCvt.resize(parser.GetTableLength("cvt ") / sizeof(s16));
+		for (auto& value : designCvt) {
+			value = cvt.GetField<s16>();
+		}
+	}
+
+	if (parser.HasTable("fpgm")) {
+		fontProgram = std::span<const u8>((const u8*)parser.GetTable("fpgm").get(), parser.GetTableLength("fpgm"));
+	}
+	if (parser.HasTable("prep")) {
+		controlValueProgram = std::span<const u8>((const u8*)parser.GetTable("prep").get(), parser.GetTableLength("prep"));
+	}
+
+	// Fonts without either program are treated as unhinted, so callers
+	// don't pay for a pass that only scales the outline.
+	if (fontProgram.empty() && controlValueProgram.empty()) {
+		return;
+	}
+
+	definitions.functions.resize(maxFunctionDefs);
+
+	GlyphHinter interpreter(*this);
+	available = interpreter.RunFontProgram(*this);
+}
+
+const HintingProgram::SizeState*
+HintingProgram::FindSize(const s32 pKey) const
+{
+	std::shared_lock<std::shared_mutex> lock(m_sizeLock);
+
+	// Map nodes never move, so the state outlives the lock.
+	const auto it = m_sizes.find(pKey);
+	return (it != m_sizes.end()) ? &it->second : nullptr;
+}
+
+const HintingProgram::SizeState&
+HintingProgram::AddSize(const s32 pKey, SizeState pSize) const
+{
+	std::unique_lock<std::shared_mutex> lock(m_sizeLock);
+	return m_sizes.try_emplace(pKey, std::move(pSize)).first->second;
+}
+
+//
+
+GlyphHinter::GlyphHinter(const HintingProgram& pProgram)
+	: m_program(pProgram), m_parser(pProgram.parser)
+{
+	m_stack.resize(m_program.maxStackElements + 32); // fonts often understate their stack use.
+	m_twilight.Resize(m_program.maxTwilightPoints);
+	m_glyph = &m_emptyZone;
+}
+
+bool
+GlyphHinter::RunFontProgram(HintingProgram& pProgram)
+{
+	// The font program defines functions and may seed the storage area; it
+	// has no size, so it can't depend on the cvt.
+	m_gs = GetDefaultGraphicsState();
+	UpdateVectors();
+	m_storage.assign(pProgram.maxStorage, 0);
+	m_definitions = m_definable = &pProgram.definitions;
+
+	const bool succeeded = Execute(pProgram.fontProgram.data(), pProgram.fontProgram.size());
+	pProgram.fontStorage = m_storage;
+
+	m_definitions = m_definable = nullptr;
+
+	return succeeded;
+}
+
+GlyphHinter::GraphicsState
+GlyphHinter::GetDefaultGraphicsState()
+{
+	GraphicsState gs;
+	gs.projVector = gs.freeVector = gs.dualVector = Vector{ 0x4000, 0 };
+	gs.rp0 = gs.rp1 = gs.rp2 = 0;
+	gs.zp0 = gs.zp1 = gs.zp2 = 1;
+	gs.loop = 1;
+	gs.minimumDistance = 64;
+	gs.roundState = RoundState::ToGrid;
+	gs.period = 64;
+	gs.phase = 0;
+	gs.threshold = 32;
+	gs.autoFlip = true;
+	gs.controlValueCutIn = 68; // 17/16 pixel.
+	gs.singleWidthCutIn = 0;
+	gs.singleWidthValue = 0;
+	gs.deltaBase = 9;
+	gs.deltaShift = 3;
+	gs.instructControl = 0;
+
+	return gs;
+}
+
+GlyphHinter::SizeState
+GlyphHinter::RunControlValueProgram(const float pPixelsPerEm)
+{
+	SizeState size;
+	size.ppem = (s32)std::lround(pPixelsPerEm);
+	size.scale = MulDiv((s32)std::lround(pPixelsPerEm * 64.0f), 0x10000, m_parser.upem);
+
+	m_cvt.resize(m_program.designCvt.size());
+	for (size_t k = 0; k < m_program.designCvt.size(); ++k) {
+		// Scaled from 26.6 by a truncated factor, as FreeType does, so results
+		// agree with it to the unit.
+		m_cvt[k] = ScaleValue(m_program.designCvt[k] * 64, size.scale >> 6);
+	}
+
+	// prep starts from fpgm's definitions, and anything it defines itself
+	// holds only at this size.
+	size.definitions = m_program.definitions;
+	m_definitions = m_definable = &size.definitions;
+
+	m_storage = m_program.fontStorage;
+	m_twilight.Resize(m_program.maxTwilightPoints);
+	m_glyph = &m_emptyZone;
+	m_ppem = size.ppem;
+	m_scale = m_originalScale = size.scale;
+	m_gs = GetDefaultGraphicsState();
+	UpdateVectors();
+
+	size.valid = Execute(m_program.controlValueProgram.data(), m_program.controlValueProgram.size());
+
+	m_definitions = m_definable = nullptr;
+
+	// prep's graphics state becomes the default for every glyph at this
+	// size, except for these, which the rasterizer always resets.
+	m_gs.projVector = m_gs.freeVector = m_gs.dualVector = Vector{ 0x4000, 0 };
+	m_gs.zp0 = m_gs.zp1 = m_gs.zp2 = 1;
+	m_gs.rp0 = m_gs.rp1 = m_gs.rp2 = 0;
+	m_gs.loop = 1;
+
+	size.gs = m_gs;
+	size.cvt = m_cvt;
+	size.storage = m_storage;
+
+	return size;
+}
+
+const GlyphHinter::SizeState&
+GlyphHinter::GetSize(const float pPixelsPerEm)
+{
+	const s32 key = (s32)std::lround(pPixelsPerEm * 64.0f);
+
+	if (m_lastSize && m_lastSizeKey == key) {
+		return *m_lastSize;
+	}
+
+	// Two hinters may both run prep for a new size; their results are the
+	// same, and the first one added is kept.
+	const SizeState* size = m_program.FindSize(key);
+	if (!size) {
+		size = &m_program.AddSize(key, RunControlValueProgram(pPixelsPerEm));
+	}
+
+	m_lastSize = size;
+	m_lastSizeKey = key;
+
+	return *size;
+}
+
+bool
+GlyphHinter::HintGlyph(const GlyphID pGlyphID, const float pPixelsPerEm, const float pTolerance, FlattenedOutline& pOutline)
+{
+	if (!m_program.available) {
+		return false;
+	}
+
+	const SizeState& size = GetSize(pPixelsPerEm);
+	if (!size.valid) {
+		return false;
+	}
+
+	Zone zone;
+	if (!LoadZone(pGlyphID, size, 0, zone)) {
+		return false;
+	}
+
+	// The first phantom point is the hinted origin.
+	const size_t pointCount = zone.GetPointCount() - phantomPointCount;
+	const Vector origin = zone.cur[pointCount];
+	const float toEms = 1.0f / (64.0f * pPixelsPerEm);
+
+	std::vector<Point> points(pointCount);
+	for (size_t k = 0; k < pointCount; ++k) {
+		points[k] = Point((zone.cur[k].x - origin.x) * toEms, zone.cur[k].y * toEms);
+	}
+
+	pOutline = FlattenOutline(points, zone.flags, zone.contourEnds, pTolerance);
+
+	return true;
+}
+
+void
+GlyphHinter::AddPhantomPoints(const GlyphID pGlyphID, const BoundingBox& pBB, const SizeState& pSize, Zone& pZone) const
+{
+	// Origin and advance, then the vertical origin and advance.
+	const float x1 = pBB.xMin - m_parser.leftSideBearings[pGlyphID];
+	const float x2 = x1 + m_parser.advanceWidths[pGlyphID];
+
+	float top = m_program.verticalAscender;
+	float advanceHeight = (float)m_program.verticalAscender - m_program.verticalDescender;
+	if (!m_parser.advanceHeights.empty()) {
+		top = pBB.yMax + m_parser.topSideBearings[pGlyphID];
+		advanceHeight = m_parser.advanceHeights[pGlyphID];
+	}
+
+	const Point phantoms[phantomPointCount] = {
+		Point(x1, 0), Point(x2, 0), Point(0, top), Point(0, top - advanceHeight),
+	};
+
+	for (const auto& p : phantoms) {
+		const Vector orus = { (s32)std::lround(p.x), (s32)std::lround(p.y) };
+		const Vector org = { ScaleValue(orus.x, pSize.scale), ScaleValue(orus.y, pSize.scale) };
+		pZone.orus.push_back(orus);
+		pZone.org.push_back(org);
+		pZone.cur.push_back(org);
+		pZone.flags.push_back(0);
+	}
+}
+
+bool
+GlyphHinter::LoadZone(const GlyphID pGlyphID, const SizeState& pSize, const u32 pDepth, Zone& pZone)
+{
+	if (pDepth > kMaxComponentDepth) {
+		return false;
+	}
+
+	std::vector<Component> components;
+	BoundingBox headerBB(0, 0, 0, 0);
+	std::span<const u8> program;
+
+	if (!m_parser.LoadComponents(pGlyphID, VariationInstance(), components, headerBB, program)) {
+		const GlyphDescription desc = m_parser.LoadGlyph(pGlyphID);
+
+		for (const auto& c : desc.mesh.contours) {
+			for (size_t k = 0; k < c.getTotalPtCount(); ++k) {
+				const Vector org = { ScaleValue(c.xs[k], pSize.scale), ScaleValue(c.ys[k], pSize.scale) };
+				pZone.orus.push_back(Vector{ c.xs[k], c.ys[k] });
+				pZone.org.push_back(org);
+				pZone.cur.push_back(org);
+				pZone.flags.push_back(OnCurve(c.flags[k]) ? kOnCurve : 0);
+			}
+			pZone.contourEnds.push_back((u16)(pZone.org.size() - 1));
+		}
+
+		AddPhantomPoints(pGlyphID, desc.bb, pSize, pZone);
+
+		return RunGlyphProgram(desc.instructions, pSize, false, pZone);
+	}
+
+	// Compound glyphs: each component is hinted on its own, then placed.
+	const Zone* metrics = nullptr;
+	Zone metricsZone;
+
+	for (const auto& comp : components) {
+		if (!comp.hasOffset) {
+			return false; // point-aligned components aren't supported.
+		}
+
+		Zone sub;
+		if (!LoadZone(comp.glyphID, pSize, pDepth + 1, sub)) {
+			return false;
+		}
+
+		s32 dx = ScaleValue((s32)std::lround(comp.e), pSize.scale);
+		s32 dy = ScaleValue((s32)std::lround(comp.f), pSize.scale);
+		if (comp.flags & roundXYToGridMask) {
+			dx = PixelRound(dx);
+			dy = PixelRound(dy);
+		}
+
+		// The 2x2 transform in 16.16.
+		const s32 a = (s32)std::lround(comp.a * 0x10000), b = (s32)std::lround(comp.b * 0x10000);
+		const s32 c = (s32)std::lround(comp.c * 0x10000), d = (s32)std::lround(comp.d * 0x10000);
+		const bool isTransformed = a != 0x10000 || b != 0 || c != 0 || d != 0x10000;
+		const auto place = [&](Vector v) {
+			if (isTransformed) {
+				v = Vector{ ScaleValue(v.x, a) + ScaleValue(v.y, c), ScaleValue(v.x, b) + ScaleValue(v.y, d) };
+			}
+			return Vector{ v.x + dx, v.y + dy };
+		};
+
+		const size_t base = pZone.GetPointCount();
+		const size_t subCount = sub.GetPointCount() - phantomPointCount;
+		for (size_t k = 0; k < subCount; ++k) {
+			pZone.org.push_back(place(sub.org[k]));
+			pZone.cur.push_back(place(sub.cur[k]));
+			pZone.flags.push_back(sub.flags[k] & kOnCurve);
+		}
+		for (const u16 end : sub.contourEnds) {
+			pZone.contourEnds.push_back((u16)(base + end));
+		}
+
+		if (comp.flags & useMyMetricsMask) {
+			metricsZone = std::move(sub);
+			metrics = &metricsZone;
+		}
+	}
+
+	const size_t pointCount = pZone.GetPointCount();
+	if (metrics) {
+		const size_t first = metrics->GetPointCount() - phantomPointCount;
+		for (size_t k = first; k < metrics->GetPointCount(); ++k) {
+			pZone.org.push_back(metrics->cur[k]);
+			pZone.cur.push_back(metrics->cur[k]);
+			pZone.flags.push_back(0);
+		}
+	}
+	else {
+		AddPhantomPoints(pGlyphID, headerBB, pSize, pZone);
+	}
+
+	pZone.orus.clear(); // set below if a program needs them.
+	if (program.empty()) {
+		return true;
+	}
+
+	// The compound's own program sees the hinted components as its
+	// original outline, already in pixels (see m_originalScale).
+	std::copy(pZone.cur.begin(), pZone.cur.begin() + pointCount, pZone.org.begin());
+	pZone.orus = pZone.org;
+	for (auto& flags : pZone.flags) {
+		flags &= kOnCurve;
+	}
+
+	return RunGlyphProgram(program, pSize, true, pZone);
+}
+
+bool
+GlyphHinter::RunGlyphProgram(std::span<const u8> pProgram, const SizeState& pSize, const bool pIsCompound, Zone& pZone)
+{
+	// Phantom points are grid-fitted whether or not there's a program.
+	for (size_t k = pZone.GetPointCount() - phantomPointCount; k < pZone.GetPointCount(); ++k) {
+		pZone.cur[k] = Vector{ PixelRound(pZone.cur[k].x), PixelRound(pZone.cur[k].y) };
+	}
+
+	// Bit 0 of INSTCTRL, set by prep, turns glyph programs off.
+	if (pProgram.empty() || (pSize.gs.instructControl & 1)) {
+		return true;
+	}
+
+	// Programs start from the state prep left; anything a glyph changes is
+	// discarded afterwards.
+	m_gs = pSize.gs;
+	UpdateVectors();
+	m_cvt = pSize.cvt;
+	m_storage = pSize.storage;
+	m_definitions = &pSize.definitions;
+	m_twilight.Resize(m_program.maxTwilightPoints);
+	m_glyph = &pZone;
+	m_ppem = pSize.ppem;
+	m_scale = pSize.scale;
+	m_originalScale = pIsCompound ? 0x10000 : pSize.scale;
+	m_inGlyphProgram = true;
+
+	const bool succeeded = Execute(pProgram.data(), pProgram.size());
+
+	m_glyph = &m_emptyZone;
+	m_definitions = nullptr;
+	m_inGlyphProgram = false;
+
+	return succeeded;
+}
+
+//
+
+s32
+GlyphHinter::Pop()
+{
+	// Missing arguments read as zero; enough shipping fonts underflow
+	// that treating it as an error would leave them unhinted.
+	if (m_sp == 0) {
+		return 0;
+	}
+
+	return m_stack[--m_sp];
+}
+
+bool
+GlyphHinter::HasLoopArguments()
+{
+	if (m_sp >= (size_t)m_gs.loop) {
+		return true;
+	}
+
+	m_gs.loop = 1;
+	return false;
+}
+
+void
+GlyphHinter::Push(const s32 pValue)
+{
+	if (m_sp >= m_stack.size()) {
+		m_error = true;
+		return;
+	}
+
+	m_stack[m_sp++] = pValue;
+}
+
+void
+GlyphHinter::UpdateVectors()
+{
+	const Vector& pv = m_gs.projVector;
+	const Vector& fv = m_gs.freeVector;
+
+	// Moving along the freedom vector by d changes the projection by
+	// d * (fv . pv); guard against near-perpendicular vectors.
+	m_fdotp = (s32)(((s64)fv.x * pv.x + (s64)fv.y * pv.y) >> 14);
+	if (std::abs(m_fdotp) < 0x400) {
+		m_fdotp = 0x4000;
+	}
+
+	m_projAxis = (pv.x == 0x4000 && pv.y == 0) ? 0 : (pv.x == 0 && pv.y == 0x4000) ? 1 : 2;
+	m_freeAxis = (fv.x == 0x4000 && fv.y == 0) ? 0 : (fv.x == 0 && fv.y == 0x4000) ? 1 : 2;
+}
+
+// Dot product with a unit vector in F2Dot14, rounded to nearest with ties
+// toward zero.
+static s32
+DotFix14(const s32 pDx, const s32 pDy, const s32 pX, const s32 pY)
+{
+	const s64 m = (s64)pDx * pX + (s64)pDy * pY;
+	return (s32)((m + 0x2000 - (m < 0)) >> 14);
+}
+
+s32
+GlyphHinter::Project(const s32 pDx, const s32 pDy) const
+{
+	switch (m_projAxis) {
+		case 0: return pDx;
+		case 1: return pDy;
+	}
+
+	const Vector& pv = m_gs.projVector;
+	return DotFix14(pDx, pDy, pv.x, pv.y);
+}
+
+s32
+GlyphHinter::DualProject(const s32 pDx, const s32 pDy) const
+{
+	const Vector& dv = m_gs.dualVector;
+	return DotFix14(pDx, pDy, dv.x, dv.y);
+}
+
+s32
+GlyphHinter::GetOriginalDistance(const Zone& pZone1, const u32 pPoint1, const Zone& pZone2, const u32 pPoint2) const
+{
+	if (&pZone1 == &m_twilight || &pZone2 == &m_twilight) {
+		return DualProject(pZone1.org[pPoint1].x - pZone2.org[pPoint2].x, pZone1.org[pPoint1].y - pZone2.org[pPoint2].y);
+	}
+
+	const s32 d = DualProject(pZone1.orus[pPoint1].x - pZone2.orus[pPoint2].x, pZone1.orus[pPoint1].y - pZone2.orus[pPoint2].y);
+	return ScaleValue(d, m_originalScale);
+}
+
+void
+GlyphHinter::MovePoint(Zone& pZone, const u32 pPoint, const s32 pDistance, const bool pTouch)
+{
+	Vector& p = pZone.cur[pPoint];
+	u8& flags = pZone.flags[pPoint];
+
+	// Axis-aligned vectors are by far the most common case.
+	if (m_freeAxis == 0 && m_projAxis == 0) {
+		p.x += pDistance;
+		flags |= pTouch ? kTouchedX : 0;
+		return;
+	}
+	if (m_freeAxis == 1 && m_projAxis == 1) {
+		p.y += pDistance;
+		flags |= pTouch ? kTouchedY : 0;
+		return;
+	}
+
+	const Vector& fv = m_gs.freeVector;
+	if (fv.x != 0) {
+		p.x += MulDiv(pDistance, fv.x, m_fdotp);
+		flags |= pTouch ? kTouchedX : 0;
+	}
+	if (fv.y != 0) {
+		p.y += MulDiv(pDistance, fv.y, m_fdotp);
+		flags |= pTouch ? kTouchedY : 0;
+	}
+}
+
+void
+GlyphHinter::MoveOriginal(Zone& pZone, const u32 pPoint, const s32 pDistance)
+{
+	const Vector& fv = m_gs.freeVector;
+	pZone.org[pPoint].x += MulDiv(pDistance, fv.x, m_fdotp);
+	pZone.org[pPoint].y += MulDiv(pDistance, fv.y, m_fdotp);
+}
+
+void
+GlyphHinter::ShiftPoint(Zone& pZone, const u32 pPoint, const s32 pDx, const s32 pDy, const bool pTouch)
+{
+	pZone.cur[pPoint].x += pDx;
+	pZone.cur[pPoint].y += pDy;
+
+	if (pTouch) {
+		pZone.flags[pPoint] |= (m_gs.freeVector.x != 0) ? kTouchedX : 0;
+		pZone.flags[pPoint] |= (m_gs.freeVector.y != 0) ? kTouchedY : 0;
+	}
+}
+
+s32
+GlyphHinter::Round(const s32 pDistance) const
+{
+	const s32 d = pDistance;
+
+	switch (m_gs.roundState) {
+		case RoundState::ToGrid:
+			return (d >= 0) ? std::max(0, (d + 32) & -64) : std::min(0, -((-d + 32) & -64));
+
+		case RoundState::ToHalfGrid:
+			return (d >= 0) ? (d & -64) + 32 : -(((-d) & -64) + 32);
+
+		case RoundState::ToDoubleGrid:
+			return (d >= 0) ? std::max(0, (d + 16) & -32) : std::min(0, -((-d + 16) & -32));
+
+		case RoundState::DownToGrid:
+			return (d >= 0) ? d & -64 : -((-d) & -64);
+
+		case RoundState::UpToGrid:
+			return (d >= 0) ? (d + 63) & -64 : -((-d + 63) & -64);
+
+		case RoundState::Super:
+		{
+			if (d >= 0) {
+				const s32 v = ((d - m_gs.phase + m_gs.threshold) & -m_gs.period) + m_gs.phase;
+				return (v < 0) ? m_gs.phase : v;
+			}
+
+			const s32 v = -(((m_gs.threshold - m_gs.phase - d) & -m_gs.period) - m_gs.phase);
+			return (v > 0) ? -m_gs.phase : v;
+		}
+
+		case RoundState::Super45:
+		{
+			// The period isn't a power of two here, so divide.
+			if (d >= 0) {
+				const s32 v = ((d - m_gs.phase + m_gs.threshold) / m_gs.period) * m_gs.period + m_gs.phase;
+				return (v < 0) ? m_gs.phase : v;
+			}
+
+			const s32 v = -((((m_gs.threshold - m_gs.phase - d) / m_gs.period) * m_gs.period) - m_gs.phase);
+			return (v > 0) ? -m_gs.phase : v;
+		}
+
+		case RoundState::Off:
+		default:
+			return d;
+	}
+}
+
+void
+GlyphHinter::SetSuperRound(const s32 pGridPeriod, const s32 pSelector)
+{
+	// pGridPeriod is in 16.16 fixed point, like the intermediate values.
+	s32 period = pGridPeriod;
+	switch (pSelector & 0xc0) {
+		case 0x00: period = pGridPeriod / 2; break;
+		case 0x80: period = pGridPeriod * 2; break;
+	}
+
+	s32 phase = 0;
+	switch (pSelector & 0x30) {
+		case 0x10: phase = period / 4; break;
+		case 0x20: phase = period / 2; break;
+		case 0x30: phase = period * 3 / 4; break;
+	}
+
+	const s32 threshold = ((pSelector & 0x0f) == 0) ? period - 1 : ((pSelector & 0x0f) - 4) * period / 8;
+
+	m_gs.period = std::max(period >> 8, 1);
+	m_gs.phase = phase >> 8;
+	m_gs.threshold = threshold >> 8;
+}
+
+bool
+GlyphHinter::SetVectorToLine(const u32 pPoint1, const u32 pPoint2, const bool pPerpendicular, const bool pOriginal, Vector& pVector)
+{
+	Zone& z1 = GetZone(m_gs.zp1);
+	Zone& z2 = GetZone(m_gs.zp2);
+	if (!IsValidPoint(z1, pPoint1) || !IsValidPoint(z2, pPoint2)) {
+		return false;
+	}
+
+	const Vector& p1 = pOriginal ? z1.org[pPoint1] : z1.cur[pPoint1];
+	const Vector& p2 = pOriginal ? z2.org[pPoint2] : z2.cur[pPoint2];
+
+	s32 dx = p1.x - p2.x;
+	s32 dy = p1.y - p2.y;
+	if (dx == 0 && dy == 0) {
+		dx = 0x4000; // coincident points give the x axis, unrotated.
+	}
+	else if (pPerpendicular) {
+		const s32 t = dy;
+		dy = dx;
+		dx = -t;
+	}
+
+	return NormalizeVector(dx, dy, pVector.x, pVector.y);
+}
+
+//
+
+void
+GlyphHinter::DoInterpolate()
+{
+	Zone& z0 = GetZone(m_gs.zp0);
+	Zone& z1 = GetZone(m_gs.zp1);
+	Zone& z2 = GetZone(m_gs.zp2);
+
+	// Original positions are measured unscaled, so the ratios aren't
+	// disturbed by rounding; twilight points only have scaled ones.
+	const bool isTwilight = m_gs.zp0 == 0 || m_gs.zp1 == 0 || m_gs.zp2 == 0;
+	const auto original = [&](const Zone& pZone) -> const std::vector<Vector>& { return isTwilight ? pZone.org : pZone.orus; };
+
+	const bool hasReferences = IsValidPoint(z0, m_gs.rp1) && IsValidPoint(z1, m_gs.rp2);
+
+	Vector orgBase = { 0, 0 }, curBase = { 0, 0 };
+	s32 orgRange = 0, curRange = 0;
+	if (hasReferences) {
+		orgBase = original(z0)[m_gs.rp1];
+		curBase = z0.cur[m_gs.rp1];
+		orgRange = DualProject(original(z1)[m_gs.rp2].x - orgBase.x, original(z1)[m_gs.rp2].y - orgBase.y);
+		curRange = Project(z1.cur[m_gs.rp2].x - curBase.x, z1.cur[m_gs.rp2].y - curBase.y);
+	}
+
+	if (!HasLoopArguments()) {
+		return;
+	}
+	for (; m_gs.loop > 0 && !m_error; --m_gs.loop) {
+		const u32 p = Pop();
+		if (!hasReferences || !IsValidPoint(z2, p)) {
+			continue;
+		}
+
+		const Vector& o = original(z2)[p];
+		const s32 orgDist = DualProject(o.x - orgBase.x, o.y - orgBase.y);
+		const s32 curDist = Project(z2.cur[p].x - curBase.x, z2.cur[p].y - curBase.y);
+
+		// With coincident references the point keeps its original
+		// distance, as in Microsoft's rasterizer.
+		s32 newDist = 0;
+		if (orgDist) {
+			newDist = orgRange ? MulDiv(orgDist, curRange, orgRange) : orgDist;
+		}
+
+		MovePoint(z2, p, newDist - curDist, true);
+	}
+
+	m_gs.loop = 1;
+}
+
+void
+GlyphHinter::DoShift(const u8 pOpcode)
+{
+	// The reference is rp2 in zp1 for the [0] forms, rp1 in zp0 for [1].
+	const bool useRp1 = pOpcode & 1;
+	Zone& refZone = GetZone(useRp1 ? m_gs.zp0 : m_gs.zp1);
+	const u32 ref = useRp1 ? m_gs.rp1 : m_gs.rp2;
+
+	s32 dx = 0, dy = 0;
+	const bool hasReference = IsValidPoint(refZone, ref);
+	if (hasReference) {
+		const s32 d = Project(refZone.cur[ref].x - refZone.org[ref].x, refZone.cur[ref].y - refZone.org[ref].y);
+		dx = MulDiv(d, m_gs.freeVector.x, m_fdotp);
+		dy = MulDiv(d, m_gs.freeVector.y, m_fdotp);
+	}
+
+	switch (pOpcode & ~1) {
+		case 0x32: // SHP
+		{
+			Zone& z = GetZone(m_gs.zp2);
+			if (!HasLoopArguments()) {
+				break;
+			}
+			for (; m_gs.loop > 0 && !m_error; --m_gs.loop) {
+				const u32 p = Pop();
+				if (hasReference && IsValidPoint(z, p)) {
+					ShiftPoint(z, p, dx, dy, true);
+				}
+			}
+			m_gs.loop = 1;
+			break;
+		}
+
+		case 0x34: // SHC
+		{
+			Zone& z = GetZone(m_gs.zp2);
+			const u32 contour = Pop();
+			if (!hasReference || contour >= z.contourEnds.size()) {
+				break;
+			}
+
+			const u32 first = contour ? z.contourEnds[contour - 1] + 1 : 0;
+			for (u32 p = first; p <= z.contourEnds[contour]; ++p) {
+				if (&z != &refZone || p != ref) {
+					ShiftPoint(z, p, dx, dy, true);
+				}
+			}
+			break;
+		}
+
+		case 0x36: // SHZ
+		{
+			// The zone argument is only checked; like other rasterizers,
+			// shift zp2.
+			const s32 zone = Pop();
+			if (zone < 0 || zone > 1) {
+				m_error = true;
+				break;
+			}
+
+			// The glyph zone's phantom points stay put.
+			Zone& z = GetZone(m_gs.zp2);
+			const size_t limit = m_gs.zp2 ? (z.contourEnds.empty() ? 0 : z.contourEnds.back() + 1) : z.GetPointCount();
+			for (u32 p = 0; hasReference && p < limit; ++p) {
+				if (&z != &refZone || p != ref) {
+					ShiftPoint(z, p, dx, dy, false);
+				}
+			}
+			break;
+		}
+	}
+}
+
+void
+GlyphHinter::DoInterpolateUntouched(const bool pXAxis)
+{
+	Zone& z = *m_glyph;
+	const u8 touched = pXAxis ? kTouchedX : kTouchedY;
+	s32 Vector::* axis = pXAxis ? &Vector::x : &Vector::y;
+
+	// Untouched points between two touched ones keep their relative
+	// position; those outside the pair move with the nearer one.
+	const auto interpolate = [&](size_t pFirst, const size_t pLast, size_t pRef1, size_t pRef2) {
+		if (z.orus[pRef1].*axis > z.orus[pRef2].*axis) {
+			std::swap(pRef1, pRef2);
+		}
+
+		const s32 orus1 = z.orus[pRef1].*axis, orus2 = z.orus[pRef2].*axis;
+		const s32 org1 = z.org[pRef1].*axis, org2 = z.org[pRef2].*axis;
+		const s32 cur1 = z.cur[pRef1].*axis, cur2 = z.cur[pRef2].*axis;
+		const s32 delta1 = cur1 - org1, delta2 = cur2 - org2;
+
+		// 16.16 ratio of the touched points' spans, fitted to unscaled.
+		const bool isDegenerate = cur1 == cur2 || orus1 == orus2;
+		const s32 scale = isDegenerate ? 0 : MulDiv(cur2 - cur1, 0x10000, orus2 - orus1);
+
+		for (size_t k = pFirst; k <= pLast; ++k) {
+			const s32 o = z.org[k].*axis;
+			if (o <= org1) {
+				z.cur[k].*axis = o + delta1;
+			}
+			else if (o >= org2) {
+				z.cur[k].*axis = o + delta2;
+			}
+			else {
+				z.cur[k].*axis = isDegenerate ? cur1 : cur1 + MulDiv(z.orus[k].*axis - orus1, scale, 0x10000);
+			}
+		}
+	};
+
+	size_t start = 0;
+	for (const u16 end : z.contourEnds) {
+		size_t first = start;
+		while (first <= end && !(z.flags[first] & touched)) {
+			++first;
+		}
+
+		if (first <= end) {
+			size_t prev = first;
+			for (size_t k = first + 1; k <= end; ++k) {
+				if (z.flags[k] & touched) {
+					if (k > prev + 1) {
+						interpolate(prev + 1, k - 1, prev, k);
+					}
+					prev = k;
+				}
+			}
+
+			// The run wrapping around the contour's end, split in two.
+			if (prev == first) {
+				interpolate(start, end, first, first);
+			}
+			else {
+				if (prev < end) {
+					interpolate(prev + 1, end, prev, first);
+				}
+				if (first > start) {
+					interpolate(start, first - 1, prev, first);
+				}
+			}
+		}
+
+		start = end + 1;
+	}
+}
+
+void
+GlyphHinter::DoDelta(const u8 pOpcode)
+{
+	s32 ppemBase = m_gs.deltaBase;
+	if (pOpcode == 0x71 || pOpcode == 0x74) {
+		ppemBase += 16;
+	}
+	else if (pOpcode == 0x72 || pOpcode == 0x75) {
+		ppemBase += 32;
+	}
+
+	const bool isPointDelta = pOpcode == 0x5d || pOpcode == 0x71 || pOpcode == 0x72;
+	Zone& z = GetZone(m_gs.zp0);
+
+	const s32 count = Pop();
+	for (s32 k = 0; k < count && m_sp >= 2; ++k) { // stop, rather than read zeros, if the pairs run out.
+		const s32 target = Pop(); // a point, or a cvt entry.
+		const s32 arg = Pop();
+
+		if (ppemBase + ((arg & 0xf0) >> 4) != m_ppem) {
+			continue;
+		}
+
+		// Steps run -8..-1, 1..8 in units of 1/2^deltaShift pixels.
+		s32 step = (arg & 0x0f) - 8;
+		if (step >= 0) {
+			++step;
+		}
+		const s32 amount = step * (1 << (6 - std::clamp(m_gs.deltaShift, 0, 6)));
+
+		if (isPointDelta) {
+			if (IsValidPoint(z, target)) {
+				MovePoint(z, target, amount, true);
+			}
+		}
+		else if (target >= 0 && target < (s32)m_cvt.size()) {
+			m_cvt[target] += amount;
+		}
+	}
+}
+
+void
+GlyphHinter::DoMoveDirect(const u8 pOpcode)
+{
+	const u32 p = Pop();
+	Zone& z0 = GetZone(m_gs.zp0);
+	Zone& z1 = GetZone(m_gs.zp1);
+	const u32 rp0 = m_gs.rp0;
+
+	if (IsValidPoint(z0, rp0) && IsValidPoint(z1, p)) {
+		s32 orgDist = GetOriginalDistance(z1, p, z0, rp0);
+
+		if (std::abs(orgDist - m_gs.singleWidthValue) < m_gs.singleWidthCutIn) {
+			orgDist = (orgDist >= 0) ? m_gs.singleWidthValue : -m_gs.singleWidthValue;
+		}
+
+		s32 distance = (pOpcode & 4) ? Round(orgDist) : orgDist;
+
+		if (pOpcode & 8) { // keep the minimum distance.
+			if (orgDist >= 0) {
+				distance = std::max(distance, m_gs.minimumDistance);
+			}
+			else {
+				distance = std::min(distance, -m_gs.minimumDistance);
+			}
+		}
+
+		const s32 curDist = Project(z1.cur[p].x - z0.cur[rp0].x, z1.cur[p].y - z0.cur[rp0].y);
+		MovePoint(z1, p, distance - curDist, true);
+	}
+
+	m_gs.rp1 = m_gs.rp0;
+	m_gs.rp2 = p;
+	if (pOpcode & 16) {
+		m_gs.rp0 = p;
+	}
+}
+
+void
+GlyphHinter::DoMoveIndirect(const u8 pOpcode)
+{
+	const s32 cvtIndex = Pop();
+	const u32 p = Pop();
+	Zone& z0 = GetZone(m_gs.zp0);
+	Zone& z1 = GetZone(m_gs.zp1);
+	const u32 rp0 = m_gs.rp0;
+
+	if (IsValidPoint(z0, rp0) && IsValidPoint(z1, p)) {
+		s32 cvtDist = GetCvt(cvtIndex);
+
+		if (std::abs(cvtDist - m_gs.singleWidthValue) < m_gs.singleWidthCutIn) {
+			cvtDist = (cvtDist >= 0) ? m_gs.singleWidthValue : -m_gs.singleWidthValue;
+		}
+
+		// A twilight point is created at the cvt distance from rp0.
+		if (m_gs.zp1 == 0) {
+			z1.org[p].x = z0.org[rp0].x + MulDiv(cvtDist, m_gs.freeVector.x, 0x4000);
+			z1.org[p].y = z0.org[rp0].y + MulDiv(cvtDist, m_gs.freeVector.y, 0x4000);
+			z1.cur[p] = z1.org[p];
+		}
+
+		const s32 orgDist = DualProject(z1.org[p].x - z0.org[rp0].x, z1.org[p].y - z0.org[rp0].y);
+		const s32 curDist = Project(z1.cur[p].x - z0.cur[rp0].x, z1.cur[p].y - z0.cur[rp0].y);
+
+		if (m_gs.autoFlip && ((orgDist ^ cvtDist) < 0)) {
+			cvtDist = -cvtDist;
+		}
+
+		s32 distance = cvtDist;
+		if (pOpcode & 4) {
+			if (m_gs.zp0 == m_gs.zp1 && std::abs(cvtDist - orgDist) > m_gs.controlValueCutIn) {
+				cvtDist = orgDist;
+			}
+			distance = Round(cvtDist);
+		}
+
+		if (pOpcode & 8) { // keep the minimum distance.
+			if (orgDist >= 0) {
+				distance = std::max(distance, m_gs.minimumDistance);
+			}
+			else {
+				distance = std::min(distance, -m_gs.minimumDistance);
+			}
+		}
+
+		MovePoint(z1, p, distance - curDist, true);
+	}
+
+	m_gs.rp1 = m_gs.rp0;
+	if (pOpcode & 16) {
+		m_gs.rp0 = p;
+	}
+	m_gs.rp2 = p;
+}
+
+void
+GlyphHinter::DoIntersect()
+{
+	const u32 b1 = Pop();
+	const u32 b0 = Pop();
+	const u32 a1 = Pop();
+	const u32 a0 = Pop();
+	const u32 p = Pop();
+
+	Zone& za = GetZone(m_gs.zp1);
+	Zone& zb = GetZone(m_gs.zp0);
+	Zone& z = GetZone(m_gs.zp2);
+	if (!IsValidPoint(za, a0) || !IsValidPoint(za, a1) || !IsValidPoint(zb, b0) || !IsValidPoint(zb, b1) || !IsValidPoint(z, p)) {
+		return;
+	}
+
+	const s32 dbx = zb.cur[b1].x - zb.cur[b0].x;
+	const s32 dby = zb.cur[b1].y - zb.cur[b0].y;
+	const s32 dax = za.cur[a1].x - za.cur[a0].x;
+	const s32 day = za.cur[a1].y - za.cur[a0].y;
+	const s32 dx = zb.cur[b0].x - za.cur[a0].x;
+	const s32 dy = zb.cur[b0].y - za.cur[a0].y;
+
+	const s32 discriminant = MulDiv(dax, -dby, 0x40) + MulDiv(day, dbx, 0x40);
+	const s32 dotProduct = MulDiv(dax, dbx, 0x40) + MulDiv(day, dby, 0x40);
+
+	// Lines closer than about 3 degrees to parallel meet at the middle of
+	// their end points instead.
+	if (19 * std::abs(discriminant) > std::abs(dotProduct)) {
+		const s32 v = MulDiv(dx, -dby, 0x40) + MulDiv(dy, dbx, 0x40);
+		z.cur[p].x = za.cur[a0].x + MulDiv(v, dax, discriminant);
+		z.cur[p].y = za.cur[a0].y + MulDiv(v, day, discriminant);
+	}
+	else {
+		z.cur[p].x = (za.cur[a0].x + za.cur[a1].x + zb.cur[b0].x + zb.cur[b1].x) / 4;
+		z.cur[p].y = (za.cur[a0].y + za.cur[a1].y + zb.cur[b0].y + zb.cur[b1].y) / 4;
+	}
+
+	z.flags[p] |= kTouchedX | kTouchedY;
+}
+
+//
+
+bool
+GlyphHinter::Execute(const u8* pProgram, const size_t pLength)
+{
+	const u8* start = pProgram;
+	const u8* ip = pProgram;
+	const u8* end = pProgram + pLength;
+
+	m_sp = 0;
+	m_callDepth = 0;
+	m_error = false;
+
+	const auto call = [&](const FunctionDef& pFunction, const s32 pCount) {
+		if (!pFunction.start || m_callDepth >= kMaxCallDepth) {
+			m_error = true;
+			return;
+		}
+		if (pCount <= 0) {
+			return;
+		}
+
+		m_calls[m_callDepth++] = CallFrame{ ip, end, &pFunction, pCount };
+		start = ip = pFunction.start;
+		end = pFunction.end;
+	};
+
+	const auto jump = [&](const u8* pFrom, const s32 pOffset) {
+		const u8* target = pFrom + pOffset;
+		if (target < start || target > end) {
+			m_error = true;
+			return;
+		}
+		ip = target;
+	};
+
+	const auto getFunction = [&](const s32 pIndex) -> const FunctionDef* {
+		if (pIndex < 0 || pIndex >= (s32)m_definitions->functions.size()) {
+			m_error = true;
+			return nullptr;
+		}
+		return &m_definitions->functions[pIndex];
+	};
+
+	u32 budget = kMaxInstructionsPerProgram;
+
+	while (!m_error) {
+		if (ip >= end) {
+			// Only the top level program may simply run off its end.
+			if (m_callDepth == 0) {
+				break;
+			}
+			return false;
+		}
+		if (--budget == 0) {
+			return false;
+		}
+
+		const u8* opcodeIp = ip;
+		const u8 opcode = *ip++;
+
+		switch (opcode) {
+			case 0x00: case 0x01: // SVTCA
+			{
+				const Vector axis = (opcode & 1) ? Vector{ 0x4000, 0 } : Vector{ 0, 0x4000 };
+				m_gs.projVector = m_gs.freeVector = m_gs.dualVector = axis;
+				UpdateVectors();
+				break;
+			}
+
+			case 0x02: case 0x03: // SPVTCA
+				m_gs.projVector = m_gs.dualVector = (opcode & 1) ? Vector{ 0x4000, 0 } : Vector{ 0, 0x4000 };
+				UpdateVectors();
+				break;
+
+			case 0x04: case 0x05: // SFVTCA
+				m_gs.freeVector = (opcode & 1) ? Vector{ 0x4000, 0 } : Vector{ 0, 0x4000 };
+				UpdateVectors();
+				break;
+
+			case 0x06: case 0x07: // SPVTL
+			{
+				const u32 p2 = Pop();
+				const u32 p1 = Pop();
+				if (SetVectorToLine(p1, p2, opcode & 1, false, m_gs.projVector)) {
+					m_gs.dualVector = m_gs.projVector;
+					UpdateVectors();
+				}
+				break;
+			}
+
+			case 0x08: case 0x09: // SFVTL
+			{
+				const u32 p2 = Pop();
+				const u32 p1 = Pop();
+				if (SetVectorToLine(p1, p2, opcode & 1, false, m_gs.freeVector)) {
+					UpdateVectors();
+				}
+				break;
+			}
+
+			case 0x0a: // SPVFS
+			{
+				const s32 y = Pop();
+				const s32 x = Pop();
+				if (NormalizeVector(x, y, m_gs.projVector.x, m_gs.projVector.y)) {
+					m_gs.dualVector = m_gs.projVector;
+					UpdateVectors();
+				}
+				break;
+			}
+
+			case 0x0b: // SFVFS
+			{
+				const s32 y = Pop();
+				const s32 x = Pop();
+				if (NormalizeVector(x, y, m_gs.freeVector.x, m_gs.freeVector.y)) {
+					UpdateVectors();
+				}
+				break;
+			}
+
+			case 0x0c: // GPV
+				Push(m_gs.projVector.x);
+				Push(m_gs.projVector.y);
+				break;
+
+			case 0x0d: // GFV
+				Push(m_gs.freeVector.x);
+				Push(m_gs.freeVector.y);
+				break;
+
+			case 0x0e: // SFVTPV
+				m_gs.freeVector = m_gs.projVector;
+				UpdateVectors();
+				break;
+
+			case 0x0f: // ISECT
+				DoIntersect();
+				break;
+
+			case 0x10: m_gs.rp0 = Pop(); break; // SRP0
+			case 0x11: m_gs.rp1 = Pop(); break; // SRP1
+			case 0x12: m_gs.rp2 = Pop(); break; // SRP2
+
+			case 0x13: case 0x14: case 0x15: case 0x16: // SZP0, SZP1, SZP2, SZPS
+			{
+				const s32 zone = Pop();
+				if (zone < 0 || zone > 1) {
+					m_error = true;
+					break;
+				}
+
+				if (opcode == 0x13 || opcode == 0x16) m_gs.zp0 = (u8)zone;
+				if (opcode == 0x14 || opcode == 0x16) m_gs.zp1 = (u8)zone;
+				if (opcode == 0x15 || opcode == 0x16) m_gs.zp2 = (u8)zone;
+				break;
+			}
+
+			case 0x17: // SLOOP
+			{
+				const s32 count = Pop();
+				if (count < 0) {
+					m_error = true;
+				}
+				m_gs.loop = std::min(count, 0xffff);
+				break;
+			}
+
+			case 0x18: m_gs.roundState = RoundState::ToGrid; break; // RTG
+			case 0x19: m_gs.roundState = RoundState::ToHalfGrid; break; // RTHG
+			case 0x1a: m_gs.minimumDistance = Pop(); break; // SMD
+
+			case 0x1b: // ELSE, reached at the end of a taken IF branch.
+				if (!SkipBranch(ip, end, false)) {
+					m_error = true;
+				}
+				break;
+
+			case 0x1c: // JMPR
+				jump(opcodeIp, Pop());
+				break;
+
+			case 0x1d: m_gs.controlValueCutIn = Pop(); break; // SCVTCI
+			case 0x1e: m_gs.singleWidthCutIn = Pop(); break; // SSWCI
+			case 0x1f: m_gs.singleWidthValue = ScaleValue(Pop(), m_scale); break; // SSW
+
+			case 0x20: // DUP
+			{
+				const s32 v = Pop();
+				Push(v);
+				Push(v);
+				break;
+			}
+
+			case 0x21: Pop(); break; // POP
+			case 0x22: m_sp = 0; break; // CLEAR
+
+			case 0x23: // SWAP
+			{
+				const s32 b = Pop();
+				const s32 a = Pop();
+				Push(b);
+				Push(a);
+				break;
+			}
+
+			case 0x24: Push((s32)m_sp); break; // DEPTH
+
+			case 0x25: // CINDEX
+			{
+				const s32 k = Pop();
+				if (k <= 0 || k > (s32)m_sp) {
+					m_error = true;
+					break;
+				}
+				Push(m_stack[m_sp - k]);
+				break;
+			}
+
+			case 0x26: // MINDEX
+			{
+				const s32 k = Pop();
+				if (k <= 0 || k > (s32)m_sp) {
+					m_error = true;
+					break;
+				}
+
+				const s32 v = m_stack[m_sp - k];
+				std::copy(m_stack.begin() + (m_sp - k + 1), m_stack.begin() + m_sp, m_stack.begin() + (m_sp - k));
+				m_stack[m_sp - 1] = v;
+				break;
+			}
+
+			case 0x27: // ALIGNPTS
+			{
+				const u32 p2 = Pop();
+				const u32 p1 = Pop();
+				Zone& z0 = GetZone(m_gs.zp0);
+				Zone& z1 = GetZone(m_gs.zp1);
+				if (IsValidPoint(z1, p1) && IsValidPoint(z0, p2)) {
+					const s32 d = Project(z0.cur[p2].x - z1.cur[p1].x, z0.cur[p2].y - z1.cur[p1].y) / 2;
+					MovePoint(z1, p1, d, true);
+					MovePoint(z0, p2, -d, true);
+				}
+				break;
+			}
+
+			case 0x29: // UTP
+			{
+				const u32 p = Pop();
+				Zone& z = GetZone(m_gs.zp0);
+				if (IsValidPoint(z, p)) {
+					if (m_gs.freeVector.x != 0) z.flags[p] &= ~kTouchedX;
+					if (m_gs.freeVector.y != 0) z.flags[p] &= ~kTouchedY;
+				}
+				break;
+			}
+
+			case 0x2a: // LOOPCALL
+			{
+				const s32 index = Pop();
+				const s32 count = Pop();
+				if (const FunctionDef* function = getFunction(index)) {
+					call(*function, count);
+				}
+				break;
+			}
+
+			case 0x2b: // CALL
+				if (const FunctionDef* function = getFunction(Pop())) {
+					call(*function, 1);
+				}
+				break;
+
+			case 0x2c: // FDEF
+			{
+				// Only fpgm and prep may define functions, as in FreeType.
+				const s32 index = Pop();
+				if (!m_definable || index < 0 || index >= (s32)m_definable->functions.size()) {
+					m_error = true;
+					break;
+				}
+
+				FunctionDef& function = m_definable->functions[index];
+				function.start = ip;
+				if (!SkipFunction(ip, end)) {
+					m_error = true;
+					break;
+				}
+				function.end = ip;
+				break;
+			}
+
+			case 0x2d: // ENDF
+			{
+				if (m_callDepth == 0) {
+					m_error = true;
+					break;
+				}
+
+				CallFrame& frame = m_calls[m_callDepth - 1];
+				if (--frame.count > 0) {
+					ip = frame.function->start;
+					break;
+				}
+
+				ip = frame.returnIp;
+				end = frame.returnEnd;
+				--m_callDepth;
+				start = m_callDepth ? m_calls[m_callDepth - 1].function->start : pProgram;
+				break;
+			}
+
+			case 0x2e: case 0x2f: // MDAP
+			{
+				const u32 p = Pop();
+				Zone& z = GetZone(m_gs.zp0);
+				if (IsValidPoint(z, p)) {
+					s32 distance = 0;
+					if (opcode & 1) {
+						const s32 d = Project(z.cur[p].x, z.cur[p].y);
+						distance = Round(d) - d;
+					}
+					MovePoint(z, p, distance, true);
+				}
+				m_gs.rp0 = m_gs.rp1 = p;
+				break;
+			}
+
+			case 0x30: case 0x31: // IUP
+				DoInterpolateUntouched(opcode & 1);
+				break;
+
+			case 0x32: case 0x33: // SHP
+			case 0x34: case 0x35: // SHC
+			case 0x36: case 0x37: // SHZ
+				DoShift(opcode);
+				break;
+
+			case 0x38: // SHPIX
+			{
+				const s32 amount = Pop();
+				const s32 dx = MulDiv(amount, m_gs.freeVector.x, 0x4000);
+				const s32 dy = MulDiv(amount, m_gs.freeVector.y, 0x4000);
+
+				Zone& z = GetZone(m_gs.zp2);
+				if (!HasLoopArguments()) {
+					break;
+				}
+				for (; m_gs.loop > 0 && !m_error; --m_gs.loop) {
+					const u32 p = Pop();
+					if (IsValidPoint(z, p)) {
+						ShiftPoint(z, p, dx, dy, true);
+					}
+				}
+				m_gs.loop = 1;
+				break;
+			}
+
+			case 0x39: // IP
+				DoInterpolate();
+				break;
+
+			case 0x3a: case 0x3b: // MSIRP
+			{
+				const s32 distance = Pop();
+				const u32 p = Pop();
+				Zone& z0 = GetZone(m_gs.zp0);
+				Zone& z1 = GetZone(m_gs.zp1);
+				const u32 rp0 = m_gs.rp0;
+
+				if (IsValidPoint(z0, rp0) && IsValidPoint(z1, p)) {
+					if (m_gs.zp1 == 0) {
+						z1.org[p] = z0.org[rp0];
+						MoveOriginal(z1, p, distance);
+						z1.cur[p] = z1.org[p];
+					}
+
+					const s32 curDist = Project(z1.cur[p].x - z0.cur[rp0].x, z1.cur[p].y - z0.cur[rp0].y);
+					MovePoint(z1, p, distance - curDist, true);
+				}
+
+				m_gs.rp1 = m_gs.rp0;
+				m_gs.rp2 = p;
+				if (opcode & 1) {
+					m_gs.rp0 = p;
+				}
+				break;
+			}
+
+			case 0x3c: // ALIGNRP
+			{
+				Zone& z0 = GetZone(m_gs.zp0);
+				Zone& z1 = GetZone(m_gs.zp1);
+				const u32 rp0 = m_gs.rp0;
+
+				if (!HasLoopArguments()) {
+					break;
+				}
+				for (; m_gs.loop > 0 && !m_error; --m_gs.loop) {
+					const u32 p = Pop();
+					if (IsValidPoint(z0, rp0) && IsValidPoint(z1, p)) {
+						const s32 d = Project(z1.cur[p].x - z0.cur[rp0].x, z1.cur[p].y - z0.cur[rp0].y);
+						MovePoint(z1, p, -d, true);
+					}
+				}
+				m_gs.loop = 1;
+				break;
+			}
+
+			case 0x3d: m_gs.roundState = RoundState::ToDoubleGrid; break; // RTDG
+
+			case 0x3e: case 0x3f: // MIAP
+			{
+				const s32 cvtIndex = Pop();
+				const u32 p = Pop();
+				Zone& z = GetZone(m_gs.zp0);
+
+				if (IsValidPoint(z, p)) {
+					s32 distance = GetCvt(cvtIndex);
+
+					if (m_gs.zp0 == 0) {
+						z.org[p].x = MulDiv(distance, m_gs.freeVector.x, 0x4000);
+						z.org[p].y = MulDiv(distance, m_gs.freeVector.y, 0x4000);
+						z.cur[p] = z.org[p];
+					}
+
+					const s32 curDist = Project(z.cur[p].x, z.cur[p].y);
+					if (opcode & 1) {
+						if (std::abs(distance - curDist) > m_gs.controlValueCutIn) {
+							distance = curDist;
+						}
+						distance = Round(distance);
+					}
+
+					MovePoint(z, p, distance - curDist, true);
+				}
+
+				m_gs.rp0 = m_gs.rp1 = p;
+				break;
+			}
+
+			case 0x40: // NPUSHB
+			case 0x41: // NPUSHW
+			{
+				if (ip >= end) {
+					m_error = true;
+					break;
+				}
+
+				const size_t count = *ip++;
+				const size_t width = (opcode == 0x40) ? 1 : 2;
+				if (ip + count * width > end) {
+					m_error = true;
+					break;
+				}
+
+				for (size_t k = 0; k < count; ++k, ip += width) {
+					Push((width == 1) ? ip[0] : (s16)((ip[0] << 8) | ip[1]));
+				}
+				break;
+			}
+
+			case 0x42: // WS
+			{
+				const s32 v = Pop();
+				const s32 index = Pop();
+				if (index >= 0 && index < (s32)m_storage.size()) {
+					m_storage[index] = v;
+				}
+				break;
+			}
+
+			case 0x43: // RS
+			{
+				const s32 index = Pop();
+				Push((index >= 0 && index < (s32)m_storage.size()) ? m_storage[index] : 0);
+				break;
+			}
+
+			case 0x44: // WCVTP
+			case 0x70: // WCVTF
+			{
+				const s32 v = Pop();
+				const s32 index = Pop();
+				if (index >= 0 && index < (s32)m_cvt.size()) {
+					m_cvt[index] = (opcode == 0x44) ? v : ScaleValue(v, m_scale);
+				}
+				break;
+			}
+
+			case 0x45: // RCVT
+				Push(GetCvt(Pop()));
+				break;
+
+			case 0x46: case 0x47: // GC
+			{
+				const u32 p = Pop();
+				Zone& z = GetZone(m_gs.zp2);
+				s32 v = 0;
+				if (IsValidPoint(z, p)) {
+					v = (opcode & 1) ? DualProject(z.org[p].x, z.org[p].y) : Project(z.cur[p].x, z.cur[p].y);
+				}
+				Push(v);
+				break;
+			}
+
+			case 0x48: // SCFS
+			{
+				const s32 v = Pop();
+				const u32 p = Pop();
+				Zone& z = GetZone(m_gs.zp2);
+				if (IsValidPoint(z, p)) {
+					MovePoint(z, p, v - Project(z.cur[p].x, z.cur[p].y), true);
+					if (m_gs.zp2 == 0) {
+						z.org[p] = z.cur[p];
+					}
+				}
+				break;
+			}
+
+			case 0x49: case 0x4a: // MD
+			{
+				const u32 k = Pop();
+				const u32 l = Pop();
+				Zone& z0 = GetZone(m_gs.zp0);
+				Zone& z1 = GetZone(m_gs.zp1);
+				s32 d = 0;
+				if (IsValidPoint(z0, l) && IsValidPoint(z1, k)) {
+					// MD[0] measures the grid-fitted outline, MD[1] the original.
+					d = (opcode & 1) ? Project(z0.cur[l].x - z1.cur[k].x, z0.cur[l].y - z1.cur[k].y)
+						: GetOriginalDistance(z0, l, z1, k);
+				}
+				Push(d);
+				break;
+			}
+
+			case 0x4b: // MPPEM
+			case 0x4c: // MPS
+				Push(m_ppem);
+				break;
+
+			case 0x4d: m_gs.autoFlip = true; break; // FLIPON
+			case 0x4e: m_gs.autoFlip = false; break; // FLIPOFF
+			case 0x4f: Pop(); break; // DEBUG
+
+			case 0x50: case 0x51: case 0x52: case 0x53: case 0x54: case 0x55: // LT, LTEQ, GT, GTEQ, EQ, NEQ
+			case 0x5a: case 0x5b: // AND, OR
+			case 0x60: case 0x61: case 0x62: case 0x63: // ADD, SUB, DIV, MUL
+			case 0x8b: case 0x8c: // MAX, MIN
+			{
+				const s32 b = Pop();
+				const s32 a = Pop();
+				s32 v = 0;
+
+				switch (opcode) {
+					case 0x50: v = a < b; break;
+					case 0x51: v = a <= b; break;
+					case 0x52: v = a > b; break;
+					case 0x53: v = a >= b; break;
+					case 0x54: v = a == b; break;
+					case 0x55: v = a != b; break;
+					case 0x5a: v = a && b; break;
+					case 0x5b: v = a || b; break;
+					case 0x60: v = a + b; break;
+					case 0x61: v = a - b; break;
+					case 0x62:
+						if (b == 0) {
+							m_error = true;
+							break;
+						}
+						v = (s32)((s64)a * 64 / b);
+						break;
+					case 0x63: v = MulDiv(a, b, 64); break;
+					case 0x8b: v = std::max(a, b); break;
+					case 0x8c: v = std::min(a, b); break;
+				}
+
+				Push(v);
+				break;
+			}
+
+			case 0x56: Push((Round(Pop()) & 127) == 64); break; // ODD
+			case 0x57: Push((Round(Pop()) & 127) == 0); break; // EVEN
+
+			case 0x58: // IF
+				if (!Pop() && !SkipBranch(ip, end, true)) {
+					m_error = true;
+				}
+				break;
+
+			case 0x59: // EIF
+				break;
+
+			case 0x5c: Push(!Pop()); break; // NOT
+
+			case 0x5d: case 0x71: case 0x72: // DELTAP1-3
+			case 0x73: case 0x74: case 0x75: // DELTAC1-3
+				DoDelta(opcode);
+				break;
+
+			case 0x5e: m_gs.deltaBase = Pop(); break; // SDB
+			case 0x5f: m_gs.deltaShift = Pop(); break; // SDS
+
+			case 0x64: Push(std::abs(Pop())); break; // ABS
+			case 0x65: Push(-Pop()); break; // NEG
+			case 0x66: Push(Pop() & -64); break; // FLOOR
+			case 0x67: Push((Pop() + 63) & -64); break; // CEILING
+
+			case 0x68: case 0x69: case 0x6a: case 0x6b: // ROUND
+				Push(Round(Pop()));
+				break;
+
+			case 0x6c: case 0x6d: case 0x6e: case 0x6f: // NROUND (no engine compensation)
+				break;
+
+			case 0x76: // SROUND
+				SetSuperRound(0x4000, Pop());
+				m_gs.roundState = RoundState::Super;
+				break;
+
+			case 0x77: // S45ROUND
+				SetSuperRound(0x2d41, Pop());
+				m_gs.roundState = RoundState::Super45;
+				break;
+
+			case 0x78: case 0x79: // JROT, JROF
+			{
+				const s32 condition = Pop();
+				const s32 offset = Pop();
+				if ((condition != 0) == (opcode == 0x78)) {
+					jump(opcodeIp, offset);
+				}
+				break;
+			}
+
+			case 0x7a: m_gs.roundState = RoundState::Off; break; // ROFF
+			case 0x7c: m_gs.roundState = RoundState::UpToGrid; break; // RUTG
+			case 0x7d: m_gs.roundState = RoundState::DownToGrid; break; // RDTG
+			case 0x7e: Pop(); break; // SANGW
+			case 0x7f: Pop(); break; // AA
+
+			case 0x80: // FLIPPT
+			{
+				Zone& z = *m_glyph;
+				if (!HasLoopArguments()) {
+					break;
+				}
+				for (; m_gs.loop > 0 && !m_error; --m_gs.loop) {
+					const u32 p = Pop();
+					if (IsValidPoint(z, p)) {
+						z.flags[p] ^= kOnCurve;
+					}
+				}
+				m_gs.loop = 1;
+				break;
+			}
+
+			case 0x81: case 0x82: // FLIPRGON, FLIPRGOFF
+			{
+				const u32 last = Pop();
+				const u32 first = Pop();
+				Zone& z = *m_glyph;
+				if (first <= last && IsValidPoint(z, last)) {
+					for (u32 p = first; p <= last; ++p) {
+						z.flags[p] = (opcode == 0x81) ? (z.flags[p] | kOnCurve) : (z.flags[p] & ~kOnCurve);
+					}
+				}
+				break;
+			}
+
+			case 0x85: Pop(); break; // SCANCTRL
+
+			case 0x86: case 0x87: // SDPVTL
+			{
+				const u32 p2 = Pop();
+				const u32 p1 = Pop();
+				if (SetVectorToLine(p1, p2, opcode & 1, true, m_gs.dualVector)) {
+					SetVectorToLine(p1, p2, opcode & 1, false, m_gs.projVector);
+					UpdateVectors();
+				}
+				break;
+			}
+
+			case 0x88: // GETINFO
+			{
+				// Report a version 35 engine rendering in grayscale.
+				const s32 selector = Pop();
+				s32 info = 0;
+				if (selector & 1) {
+					info |= 35;
+				}
+				if (selector & 32) {
+					info |= 1 << 12;
+				}
+				Push(info);
+				break;
+			}
+
+			case 0x89: // IDEF
+			{
+				const s32 index = Pop();
+				if (!m_definable || index < 0 || index > 0xff) {
+					m_error = true;
+					break;
+				}
+
+				FunctionDef& def = m_definable->instructions[index];
+				def.start = ip;
+				if (!SkipFunction(ip, end)) {
+					m_error = true;
+					break;
+				}
+				def.end = ip;
+				break;
+			}
+
+			case 0x8a: // ROLL
+			{
+				const s32 c = Pop();
+				const s32 b = Pop();
+				const s32 a = Pop();
+				Push(b);
+				Push(c);
+				Push(a);
+				break;
+			}
+
+			case 0x8d: Pop(); break; // SCANTYPE
+
+			case 0x8e: // INSTCTRL
+			{
+				const s32 selector = Pop();
+				const s32 value = Pop();
+				if (selector >= 1 && selector <= 3 && !m_inGlyphProgram) {
+					const u8 bit = (u8)(1 << (selector - 1));
+					m_gs.instructControl = (m_gs.instructControl & ~bit) | (value & bit);
+				}
+				break;
+			}
+
+			case 0xb0: case 0xb1: case 0xb2: case 0xb3: case 0xb4: case 0xb5: case 0xb6: case 0xb7: // PUSHB
+			{
+				const size_t count = opcode - 0xb0 + 1;
+				if (ip + count > end) {
+					m_error = true;
+					break;
+				}
+				for (size_t k = 0; k < count; ++k) {
+					Push(*ip++);
+				}
+				break;
+			}
+
+			case 0xb8: case 0xb9: case 0xba: case 0xbb: case 0xbc: case 0xbd: case 0xbe: case 0xbf: // PUSHW
+			{
+				const size_t count = opcode - 0xb8 + 1;
+				if (ip + count * 2 > end) {
+					m_error = true;
+					break;
+				}
+				for (size_t k = 0; k < count; ++k, ip += 2) {
+					Push((s16)((ip[0] << 8) | ip[1]));
+				}
+				break;
+			}
+
+			default:
+				if (opcode >= 0xc0 && opcode <= 0xdf) { // MDRP
+					DoMoveDirect(opcode);
+				}
+				else if (opcode >= 0xe0) { // MIRP
+					DoMoveIndirect(opcode);
+				}
+				else {
+					// Anything else must have been defined by IDEF.
+					call(m_definitions->instructions[opcode], 1);
+				}
+				break;
+		}
+	}
+
+	return !m_error;
+}
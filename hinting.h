@@ -0,0 +1,242 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+
+#include "base.h"
+#include "outline.h"
+#include "parser.h"
+
+//
+
+// Instructions a single program may execute before it is abandoned, so a
+// looping program can't hang the renderer.
+constexpr u32 kMaxInstructionsPerProgram = 1000000;
+
+// How a glyph is turned into pixels; part of the glyph cache key.
+enum class RenderMode : u8 {
+    Unhinted, Hinted
+};
+
+// What the font program (fpgm) and the control value program (prep) leave
+// behind, which is the same for every hinter of a font: fpgm runs once, at
+// construction, and prep once per pixel size, by whichever hinter first
+// needs the size. A Font builds one and its render contexts' hinters share
+// it. Everything is read-only once constructed bar the size cache, which
+// is locked, so hinters on several threads can use it at once.
+struct HintingProgram {
+    struct Vector {
+        s32 x, y;
+    };
+
+    enum class RoundState : u8 {
+        ToHalfGrid, ToGrid, ToDoubleGrid, DownToGrid, UpToGrid, Off, Super, Super45
+    };
+
+    struct GraphicsState {
+        Vector projVector, freeVector, dualVector;
+        u32 rp0, rp1, rp2;
+        u8 zp0, zp1, zp2; // 0 is the twilight zone, 1 the glyph.
+        s32 loop;
+        s32 minimumDistance;
+        RoundState roundState;
+        s32 period, phase, threshold; // super rounding.
+        bool autoFlip;
+        s32 controlValueCutIn;
+        s32 singleWidthCutIn;
+        s32 singleWidthValue;
+        s32 deltaBase, deltaShift;
+        u8 instructControl;
+    };
+
+    struct FunctionDef {
+        const u8* start = nullptr;
+        const u8* end = nullptr; // just past the closing ENDF.
+    };
+
+    // Functions (FDEF) and instructions (IDEF) defined so far.
+    struct Definitions {
+        std::vector<FunctionDef> functions;
+        std::array<FunctionDef, 256> instructions;
+    };
+
+    // Cached result of running prep at one size.
+    struct SizeState {
+        s32 ppem;
+        s32 scale; // design units to F26Dot6, in 16.16 fixed point.
+        bool valid; // false when prep failed: glyphs at this size stay unhinted.
+        std::vector<s32> cvt;
+        std::vector<s32> storage;
+        GraphicsState gs;
+        Definitions definitions; // prep may define functions too.
+    };
+
+    HintingProgram(const Parser& pParser);
+
+    // The size cache, keyed by ppem in 26.6. AddSize keeps the state
+    // already there if another hinter added the size first.
+    const SizeState* FindSize(const s32 pKey) const;
+    const SizeState& AddSize(const s32 pKey, SizeState pSize) const;
+
+    //
+
+    const Parser& parser;
+    bool available = false; // false when the font carries no usable hinting.
+
+    // Limits from maxp.
+    u16 maxTwilightPoints = 0;
+    u16 maxStorage = 0;
+    u16 maxFunctionDefs = 0;
+    u16 maxStackElements = 0;
+    s16 verticalAscender = 0, verticalDescender = 0; // for glyphs without vmtx.
+
+    std::vector<s16> designCvt; // FUnits, as stored in 'cvt '.
+    std::span<const u8> fontProgram, controlValueProgram;
+    Definitions definitions; // as left by fpgm.
+    std::vector<s32> fontStorage; // storage as left by fpgm.
+
+private:
+    mutable std::shared_mutex m_sizeLock;
+    mutable std::unordered_map<s32, SizeState> m_sizes;
+};
+
+// TrueType bytecode interpreter: the mutable half of hinting, one per
+// render context, over the font's shared HintingProgram. Each glyph's own
+// program runs whenever it is hinted. Positions are F26Dot6 (pixels in 26.6
+// fixed point) and vectors F2Dot14, as in the spec.
+//
+// Any error in a program (stack overflow, bad jump, missing function)
+// abandons it; HintGlyph then returns false and the caller renders the
+// unhinted outline instead.
+class GlyphHinter {
+    /* === Methods === */
+public:
+    GlyphHinter(const HintingProgram& pProgram);
+
+    // False when the font carries no usable hinting.
+    bool IsAvailable() const { return m_program.available; }
+
+    // Grid-fits the glyph at pPixelsPerEm and flattens the hinted outline,
+    // in ems with the hinted origin at (0, 0), to pOutline.
+    bool HintGlyph(const GlyphID pGlyphID, const float pPixelsPerEm, const float pTolerance, FlattenedOutline& pOutline);
+
+private:
+    friend struct HintingProgram; // which runs fpgm through RunFontProgram.
+
+    using Vector = HintingProgram::Vector;
+    using RoundState = HintingProgram::RoundState;
+    using GraphicsState = HintingProgram::GraphicsState;
+    using FunctionDef = HintingProgram::FunctionDef;
+    using Definitions = HintingProgram::Definitions;
+    using SizeState = HintingProgram::SizeState;
+
+    struct Zone {
+        std::vector<Vector> orus; // unscaled originals (see m_originalScale); unused in the twilight zone.
+        std::vector<Vector> org, cur;
+        std::vector<u8> flags; // kOnCurve, kTouchedX, kTouchedY.
+        std::vector<u16> contourEnds;
+
+        size_t GetPointCount() const { return cur.size(); }
+        void Resize(const size_t pCount);
+    };
+
+    struct CallFrame {
+        const u8* returnIp;
+        const u8* returnEnd;
+        const FunctionDef* function;
+        s32 count; // remaining LOOPCALL iterations.
+    };
+
+    // Runs fpgm, leaving its definitions and storage in pProgram.
+    bool RunFontProgram(HintingProgram& pProgram);
+
+    // Runs prep for a size not in the shared cache yet.
+    SizeState RunControlValueProgram(const float pPixelsPerEm);
+    const SizeState& GetSize(const float pPixelsPerEm);
+
+    // Builds the glyph's zone at the size's scale and runs its program;
+    // compound glyphs are assembled from individually hinted components.
+    bool LoadZone(const GlyphID pGlyphID, const SizeState& pSize, const u32 pDepth, Zone& pZone);
+    void AddPhantomPoints(const GlyphID pGlyphID, const BoundingBox& pBB, const SizeState& pSize, Zone& pZone) const;
+    bool RunGlyphProgram(std::span<const u8> pProgram, const SizeState& pSize, const bool pIsCompound, Zone& pZone);
+
+    bool Execute(const u8* pProgram, const size_t pLength);
+
+    // Graphics state helpers.
+    static GraphicsState GetDefaultGraphicsState();
+    void UpdateVectors();
+    s32 Project(const s32 pDx, const s32 pDy) const;
+    s32 DualProject(const s32 pDx, const s32 pDy) const;
+    // Projected original distance from pPoint2 to pPoint1, measured from
+    // unscaled coordinates unless either lies in the twilight zone.
+    s32 GetOriginalDistance(const Zone& pZone1, const u32 pPoint1, const Zone& pZone2, const u32 pPoint2) const;
+    void MovePoint(Zone& pZone, const u32 pPoint, const s32 pDistance, const bool pTouch);
+    void MoveOriginal(Zone& pZone, const u32 pPoint, const s32 pDistance);
+    void ShiftPoint(Zone& pZone, const u32 pPoint, const s32 pDx, const s32 pDy, const bool pTouch);
+    s32 Round(const s32 pDistance) const;
+    void SetSuperRound(const s32 pGridPeriod, const s32 pSelector);
+    bool SetVectorToLine(const u32 pPoint1, const u32 pPoint2, const bool pPerpendicular, const bool pOriginal, Vector& pVector);
+
+    Zone& GetZone(const u8 pZone) { return pZone ? *m_glyph : m_twilight; }
+
+    // Stack helpers; overflow flags an error, underflow reads zeros.
+    s32 Pop();
+    void Push(const s32 pValue);
+    // Instructions repeated by SLOOP are skipped outright if the stack
+    // can't supply every iteration.
+    bool HasLoopArguments();
+
+    bool IsValidPoint(const Zone& pZone, const u32 pPoint) const { return pPoint < pZone.GetPointCount(); }
+
+    // Out of range cvt entries read as zero, as in other rasterizers.
+    s32 GetCvt(const s32 pIndex) const { return (pIndex >= 0 && pIndex < (s32)m_cvt.size()) ? m_cvt[pIndex] : 0; }
+
+    // Instruction bodies too large to sit inline in the dispatch switch.
+    void DoInterpolate(); // IP
+    void DoShift(const u8 pOpcode); // SHP, SHC, SHZ
+    void DoInterpolateUntouched(const bool pXAxis); // IUP
+    void DoDelta(const u8 pOpcode); // DELTAP, DELTAC
+    void DoMoveDirect(const u8 pOpcode); // MDRP
+    void DoMoveIndirect(const u8 pOpcode); // MIRP
+    void DoIntersect(); // ISECT
+
+    /* === Variables === */
+private:
+    static constexpr u8 kOnCurve = 1 << 0;
+    static constexpr u8 kTouchedX = 1 << 1;
+    static constexpr u8 kTouchedY = 1 << 2;
+    static constexpr u32 kMaxCallDepth = 64;
+    static constexpr u32 kMaxComponentDepth = 8;
+
+    const HintingProgram& m_program;
+    const Parser& m_parser;
+
+    // The size used last, found without locking the shared cache.
+    const SizeState* m_lastSize = nullptr;
+    s32 m_lastSizeKey = 0;
+
+    // Execution context of the program being run.
+    GraphicsState m_gs;
+    Zone m_twilight;
+    Zone* m_glyph = nullptr;
+    Zone m_emptyZone; // the glyph zone outside glyph programs.
+    std::vector<s32> m_cvt;
+    std::vector<s32> m_storage;
+    const Definitions* m_definitions = nullptr;
+    Definitions* m_definable = nullptr; // null in glyph programs, which may not define anything.
+    std::vector<s32> m_stack;
+    size_t m_sp = 0;
+    std::array<CallFrame, kMaxCallDepth> m_calls;
+    u32 m_callDepth = 0;
+    s32 m_ppem = 0;
+    s32 m_scale = 0;
+    s32 m_originalScale = 0; // orus to F26Dot6; 1.0 in compounds, whose orus are already hinted.
+    bool m_inGlyphProgram = false;
+    bool m_error = false;
+
+    // Derived from the graphics state vectors by UpdateVectors.
+    s32 m_fdotp = 0x4000;
+    u8 m_projAxis = 0, m_freeAxis = 0; // 0 for x, 1 for y, 2 for neither.
+};
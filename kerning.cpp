@@ -0,0 +1,426 @@
+#include <algorithm>
+#include <assert.h>
+#include <bit>
+
+#include "kerning.h"
+
+//
+
+#define kernHorizontalMask  (1 << 0)
+#define kernMinimumMask     (1 << 1)
+#define kernCrossStreamMask (1 << 2)
+
+#define xAdvanceMask (1 << 2)
+
+static u16
+ReadU16(const u8* pData)
+{
+	return Stream::GetField<u16>(pData);
+}
+
+void
+KerningTable::LoadKern(Stream pKern)
+{
+	const u16 version = pKern.GetField<u16>();
+	if (version != 0) {
+		return; // @todo: Apple's 'kern' layout (32-bit version) isn't supported.
+	}
+
+	std::vector<KernPair> pairs;
+
+	const u16 subtableCount = pKern.GetField<u16>();
+	for (size_t k = 0; k < subtableCount; ++k) {
+		Stream subtable = pKern;
+
+		subtable.SkipField<u16>(); // skip version
+		const u16 length = subtable.GetField<u16>();
+		const u16 coverage = subtable.GetField<u16>();
+		const u8 format = coverage >> 8;
+
+		pKern.Skip(length);
+
+		// Only plain horizontal kerning is applied by the layout.
+		const bool isKerning = (coverage & kernHorizontalMask) && !(coverage & (kernMinimumMask | kernCrossStreamMask));
+		if (format != 0 || !isKerning) {
+			continue;
+		}
+
+		const u16 pairCount = subtable.GetField<u16>();
+		subtable.Skip(6); // skip binary search parameters.
+
+		for (size_t p = 0; p < pairCount; ++p) {
+			const u16 left = subtable.GetField<u16>();
+			const u16 right = subtable.GetField<u16>();
+			const s16 value = subtable.GetField<s16>();
+			pairs.emplace_back(MakeKey(left, right), value);
+		}
+	}
+
+	// Values from several subtables accumulate.
+	std::stable_sort(pairs.begin(), pairs.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+	std::vector<KernPair> merged;
+	for (const auto& p : pairs) {
+		if (!merged.empty() && merged.back().first == p.first) {
+			merged.back().second += p.second;
+		}
+		else {
+			merged.push_back(p);
+		}
+	}
+
+	BuildHash(merged);
+}
+
+// Calls pFunc(glyph, coverageIndex) for every glyph in a coverage table.
+template <typename F>
+static void
+ForEachCovered(const u8* pCoverage, F pFunc)
+{
+	Stream coverage(pCoverage);
+	const u16 format = coverage.GetField<u16>();
+
+	if (format == 1) {
+		const u16 glyphCount = coverage.GetField<u16>();
+		for (u16 k = 0; k < glyphCount; ++k) {
+			pFunc(coverage.GetField<u16>(), k);
+		}
+	}
+	else if (format == 2) {
+		const u16 rangeCount = coverage.GetField<u16>();
+		for (u16 k = 0; k < rangeCount; ++k) {
+			const u16 start = coverage.GetField<u16>();
+			const u16 end = coverage.GetField<u16>();
+			const u16 startIndex = coverage.GetField<u16>();
+			for (u32 g = start; g <= end; ++g) {
+				pFunc((u16)g, (u16)(startIndex + g - start));
+			}
+		}
+	}
+}
+
+// Fills pClasses (one entry per glyph) from a class definition table.
+// Glyphs the table doesn't mention keep whatever was already there.
+static void
+UnpackClassDef(const u8* pClassDef, std::vector<u16>& pClasses)
+{
+	Stream classDef(pClassDef);
+	const u16 format = classDef.GetField<u16>();
+
+	if (format == 1) {
+		const u16 startGlyph = classDef.GetField<u16>();
+		const u16 glyphCount = classDef.GetField<u16>();
+		for (u32 g = startGlyph; g < (u32)startGlyph + glyphCount; ++g) {
+			const u16 cls = classDef.GetField<u16>();
+			if (g < pClasses.size()) {
+				pClasses[g] = cls;
+			}
+		}
+	}
+	else if (format == 2) {
+		const u16 rangeCount = classDef.GetField<u16>();
+		for (u16 k = 0; k < rangeCount; ++k) {
+			const u16 start = classDef.GetField<u16>();
+			const u16 end = classDef.GetField<u16>();
+			const u16 cls = classDef.GetField<u16>();
+			for (u32 g = start; g <= end && g < pClasses.size(); ++g) {
+				pClasses[g] = cls;
+			}
+		}
+	}
+}
+
+void
+KerningTable::LoadPairAdjustment(const u8* pSubtable, const u16 pGlyphCount, const u16 pLookup, const size_t pFirstClassSubtable, std::vector<KernPair>& pPairs)
+{
+	Stream pairPos(pSubtable);
+	const u16 format = pairPos.GetField<u16>();
+	const u16 coverageOffset = pairPos.GetField<u16>();
+	const u16 valueFormat1 = pairPos.GetField<u16>();
+	const u16 valueFormat2 = pairPos.GetField<u16>();
+
+	// Only the first glyph's x-advance adjustment is kerning. A subtable
+	// without one is still loaded, with zero values, as its matches end the
+	// lookup's search all the same.
+	const bool hasXAdvance = (valueFormat1 & xAdvanceMask) != 0;
+	const size_t xAdvanceOffset = 2 * std::popcount((u32)(valueFormat1 & (xAdvanceMask - 1)));
+	const size_t valueRecordSize = 2 * (std::popcount((u32)(valueFormat1 & 0xff)) + std::popcount((u32)(valueFormat2 & 0xff)));
+
+	if (format == 1) {
+		const u8* pairSetOffsets = (const u8*)pairPos.get() + 2; // skip pairSetCount
+
+		ForEachCovered(pSubtable + coverageOffset, [&](const u16 left, const u16 coverageIndex) {
+			// Every pair of a left glyph an earlier class subtable covers
+			// has already matched there.
+			for (size_t k = pFirstClassSubtable; k < m_classSubtables.size(); ++k) {
+				const ClassSubtable& sub = m_classSubtables[k];
+				if (left < sub.leftClasses.size() && sub.leftClasses[left] != kNotCovered) {
+					return;
+				}
+			}
+
+			Stream pairSet(pSubtable + ReadU16(pairSetOffsets + 2 * coverageIndex));
+			const u16 pairCount = pairSet.GetField<u16>();
+
+			for (size_t k = 0; k < pairCount; ++k) {
+				const u16 right = pairSet.GetField<u16>();
+				const s16 value = hasXAdvance ? Stream::GetField<s16>((const u8*)pairSet.get() + xAdvanceOffset) : 0;
+				pairSet.Skip(valueRecordSize);
+
+				// A zero pair still matches, ending the lookup's search.
+				pPairs.emplace_back(MakeKey(left, right), value);
+			}
+		});
+	}
+	else if (format == 2) {
+		const u16 classDef1Offset = pairPos.GetField<u16>();
+		const u16 classDef2Offset = pairPos.GetField<u16>();
+		const u16 leftClassCount = pairPos.GetField<u16>();
+		const u16 rightClassCount = pairPos.GetField<u16>();
+
+		// Covered glyphs default to class 0; everything else is marked as
+		// not covered so the subtable is skipped for it.
+		std::vector<u16> leftClasses(pGlyphCount, kNotCovered);
+		ForEachCovered(pSubtable + coverageOffset, [&](const u16 glyph, const u16) {
+			if (glyph < pGlyphCount) {
+				leftClasses[glyph] = 0;
+			}
+		});
+
+		std::vector<u16> leftDefs(pGlyphCount, 0);
+		UnpackClassDef(pSubtable + classDef1Offset, leftDefs);
+		for (size_t g = 0; g < pGlyphCount; ++g) {
+			if (leftClasses[g] != kNotCovered) {
+				leftClasses[g] = leftDefs[g];
+			}
+		}
+
+		std::vector<u16> rightClasses(pGlyphCount, 0);
+		UnpackClassDef(pSubtable + classDef2Offset, rightClasses);
+
+		std::vector<s16> values((size_t)leftClassCount * rightClassCount);
+		const u8* record = (const u8*)pairPos.get();
+		for (size_t k = 0; k < values.size(); ++k) {
+			values[k] = hasXAdvance ? Stream::GetField<s16>(record + xAdvanceOffset) : 0;
+			record += valueRecordSize;
+		}
+
+		// Class ids outside the matrix would index past it.
+		for (auto& cls : leftClasses) {
+			if (cls != kNotCovered && cls >= leftClassCount) {
+				cls = kNotCovered;
+			}
+		}
+		for (auto& cls : rightClasses) {
+			if (cls >= rightClassCount) {
+				cls = 0;
+			}
+		}
+
+		// Kept even when every value is zero, as it still ends the
+		// lookup's search for the glyphs it covers. The storage vectors
+		// only ever move, so the views stay valid.
+		ClassSubtable sub;
+		sub.rightClassCount = rightClassCount;
+		sub.lookup = pLookup;
+		sub.leftClasses = m_classStorage.emplace_back(std::move(leftClasses));
+		sub.rightClasses = m_classStorage.emplace_back(std::move(rightClasses));
+		sub.values = m_classValueStorage.emplace_back(std::move(values));
+		m_classSubtables.push_back(sub);
+	}
+}
+
+void
+KerningTable::LoadGPOS(Stream pGPOS, const u16 pGlyphCount)
+{
+	const u8* gposTop = (const u8*)pGPOS.get();
+
+	pGPOS.Skip(4); // skip version
+	pGPOS.SkipField<u16>(); // skip script list offset
+	const u16 featureListOffset = pGPOS.GetField<u16>();
+	const u16 lookupListOffset = pGPOS.GetField<u16>();
+
+	// Gather the lookups of every 'kern' feature. Script and language
+	// selection is ignored: kerning lookups are almost always shared.
+	std::vector<u16> lookupIndices;
+
+	Stream featureList(gposTop + featureListOffset);
+	const u16 featureCount = featureList.GetField<u16>();
+	for (size_t k = 0; k < featureCount; ++k) {
+		const u32 tag = featureList.GetField<u32>();
+		const u16 featureOffset = featureList.GetField<u16>();
+
+		if (tag != 0x6B65726E) { // 'kern'
+			continue;
+		}
+
+		Stream feature(gposTop + featureListOffset + featureOffset);
+		feature.SkipField<u16>(); // skip feature params
+		const u16 lookupCount = feature.GetField<u16>();
+		for (size_t l = 0; l < lookupCount; ++l) {
+			lookupIndices.push_back(feature.GetField<u16>());
+		}
+	}
+
+	std::sort(lookupIndices.begin(), lookupIndices.end());
+	lookupIndices.erase(std::unique(lookupIndices.begin(), lookupIndices.end()), lookupIndices.end());
+
+	// Lookups apply in lookup list order, which the ordinals follow.
+	struct LookupPair {
+		u32 key;
+		u16 lookup;
+		s16 value;
+	};
+	std::vector<LookupPair> lookupPairs;
+
+	const u8* lookupList = gposTop + lookupListOffset;
+	for (size_t ordinal = 0; ordinal < lookupIndices.size(); ++ordinal) {
+		const u8* lookupTop = lookupList + ReadU16(lookupList + 2 + 2 * lookupIndices[ordinal]);
+
+		Stream lookup(lookupTop);
+		const u16 lookupType = lookup.GetField<u16>();
+		lookup.SkipField<u16>(); // skip lookup flags
+		const u16 subtableCount = lookup.GetField<u16>();
+
+		const size_t firstClassSubtable = m_classSubtables.size();
+		std::vector<KernPair> pairs;
+
+		for (size_t k = 0; k < subtableCount; ++k) {
+			const u8* subtable = lookupTop + lookup.GetField<u16>();
+			u16 subtableType = lookupType;
+
+			if (lookupType == 9) { // extension: the real subtable is behind a 32-bit offset.
+				Stream extension(subtable);
+				extension.SkipField<u16>(); // skip format
+				subtableType = extension.GetField<u16>();
+				subtable += extension.GetField<u32>();
+			}
+
+			if (subtableType == 2) {
+				LoadPairAdjustment(subtable, pGlyphCount, (u16)ordinal, firstClassSubtable, pairs);
+			}
+		}
+
+		// Within a lookup the first subtable to match wins.
+		std::stable_sort(pairs.begin(), pairs.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+		pairs.erase(std::unique(pairs.begin(), pairs.end(),
+			[](const auto& a, const auto& b) { return a.first == b.first; }), pairs.end());
+
+		for (const auto& [key, value] : pairs) {
+			lookupPairs.push_back({ key, (u16)ordinal, value });
+		}
+	}
+
+	// Each hashed pair holds its total over every lookup: its own value in
+	// the lookups that list it, and class kerning in the others.
+	std::stable_sort(lookupPairs.begin(), lookupPairs.end(), [](const auto& a, const auto& b) { return a.key < b.key; });
+
+	std::vector<KernPair> pairs;
+	for (size_t first = 0; first < lookupPairs.size();) {
+		size_t last = first;
+		s32 value = 0;
+		while (last < lookupPairs.size() && lookupPairs[last].key == lookupPairs[first].key) {
+			value += lookupPairs[last].value;
+			++last;
+		}
+
+		const u32 key = lookupPairs[first].key;
+		value += SumClassKerning((GlyphID)(key >> 16), (GlyphID)(key & 0xffff), [&](const u16 pLookup) {
+			return std::any_of(lookupPairs.begin() + first, lookupPairs.begin() + last,
+				[pLookup](const LookupPair& pair) { return pair.lookup == pLookup; });
+		});
+
+		pairs.emplace_back(key, (s16)std::clamp<s32>(value, INT16_MIN, INT16_MAX));
+		first = last;
+	}
+
+	BuildHash(pairs);
+}
+
+template <typename F>
+s32
+KerningTable::SumClassKerning(const GlyphID pLeft, const GlyphID pRight, F pIsExplicit) const
+{
+	s32 value = 0;
+	u32 matchedLookup = ~0u;
+	for (const auto& sub : m_classSubtables) {
+		if (pLeft >= sub.leftClasses.size() || pRight >= sub.rightClasses.size()) {
+			break; // not a glyph of this font.
+		}
+
+		// Only a lookup's first covering subtable applies.
+		const u16 leftClass = sub.leftClasses[pLeft];
+		if (leftClass == kNotCovered || sub.lookup == matchedLookup) {
+			continue;
+		}
+
+		matchedLookup = sub.lookup;
+		if (!pIsExplicit(sub.lookup)) {
+			value += sub.values[leftClass * sub.rightClassCount + sub.rightClasses[pRight]];
+		}
+	}
+
+	return value;
+}
+
+void
+KerningTable::BuildHash(const std::vector<KernPair>& pPairs)
+{
+	if (pPairs.empty()) {
+		return;
+	}
+
+	// Keep the load factor at or below 1/2 so probe chains stay short.
+	const u32 capacity = std::bit_ceil((u32)pPairs.size() * 2);
+	m_mask = capacity - 1;
+	m_shift = 32 - std::countr_zero(capacity);
+
+	m_keyStorage.assign(capacity, kEmptyKey);
+	m_valueStorage.assign(capacity, 0);
+
+	for (const auto& [key, value] : pPairs) {
+		u32 slot = (key * 0x9E3779B1u) >> m_shift; // fibonacci hashing.
+		while (m_keyStorage[slot] != kEmptyKey) {
+			slot = (slot + 1) & m_mask;
+		}
+		m_keyStorage[slot] = key;
+		m_valueStorage[slot] = value;
+	}
+
+	m_keys = m_keyStorage;
+	m_values = m_valueStorage;
+}
+
+void
+KerningTable::LoadFlat(std::span<const u32> pKeys, std::span<const s16> pValues, std::vector<ClassSubtable> pClassSubtables)
+{
+	assert(pKeys.size() == pValues.size() && (pKeys.empty() || std::has_single_bit(pKeys.size())));
+
+	m_keys = pKeys;
+	m_values = pValues;
+	if (!m_keys.empty()) {
+		m_mask = (u32)m_keys.size() - 1;
+		m_shift = 32 - std::countr_zero((u32)m_keys.size());
+	}
+
+	m_classSubtables = std::move(pClassSubtables);
+}
+
+s16
+KerningTable::GetKerning(const GlyphID pLeft, const GlyphID pRight) const
+{
+	if (!m_keys.empty()) {
+		const u32 key = MakeKey(pLeft, pRight);
+
+		u32 slot = (key * 0x9E3779B1u) >> m_shift;
+		while (m_keys[slot] != kEmptyKey) {
+			if (m_keys[slot] == key) {
+				return m_values[slot];
+			}
+			slot = (slot + 1) & m_mask;
+		}
+	}
+
+	// Pairs in the hash already include their class kerning.
+	const s32 value = SumClassKerning(pLeft, pRight, [](const u16) { return false; });
+	return (s16)std::clamp<s32>(value, INT16_MIN, INT16_MAX);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <span>
+
+#include "base.h"
+#include "stream.h"
+#include "encodings.h"
+
+//
+
+// Pair kerning adjustments, in design units, gathered from the 'kern'
+// table (format 0) or the GPOS 'kern' feature (PairPos formats 1 and 2).
+// Explicit glyph pairs live in an open-addressing hash keyed by the 32-bit
+// (left, right) pair; class-based pairs are resolved through flat per-glyph
+// class arrays. Lookups never allocate.
+//
+// GPOS is applied as a shaper would: every kern lookup contributes, and the
+// values sum, while within a lookup only its first subtable to match the
+// pair applies. A hashed pair's value is already that sum over every
+// lookup, class-based contributions included.
+class KerningTable {
+    /* === Methods === */
+public:
+    struct ClassSubtable {
+        std::span<const u16> leftClasses; // kNotCovered for glyphs outside the coverage table.
+        std::span<const u16> rightClasses;
+        std::span<const s16> values; // leftClassCount x rightClassCount matrix.
+        u16 rightClassCount;
+        u16 lookup; // ordinal of the kern lookup holding it; subtables are in lookup order.
+    };
+
+    KerningTable() = default;
+
+    KerningTable(const KerningTable&) = delete;
+    KerningTable& operator=(const KerningTable&) = delete;
+
+    void LoadKern(Stream pKern);
+    void LoadGPOS(Stream pGPOS, const u16 pGlyphCount);
+
+    // The table in its flat form, for saving it precompiled (see
+    // CompiledFont), and LoadFlat to use such a table in place. The pair
+    // hash's capacity must be a power of two; the arrays must outlive the
+    // table.
+    std::span<const u32> GetPairKeys() const { return m_keys; }
+    std::span<const s16> GetPairValues() const { return m_values; }
+    std::span<const ClassSubtable> GetClassSubtables() const { return m_classSubtables; }
+    void LoadFlat(std::span<const u32> pKeys, std::span<const s16> pValues, std::vector<ClassSubtable> pClassSubtables);
+
+    s16 GetKerning(const GlyphID pLeft, const GlyphID pRight) const;
+
+    bool IsEmpty() const { return m_keys.empty() && m_classSubtables.empty(); }
+
+private:
+
+    using KernPair = std::pair<u32, s16>;
+
+    // Loads one PairPos subtable of lookup pLookup. Class subtables are
+    // added to m_classSubtables; explicit pairs go to pPairs, unless a class
+    // subtable earlier in the same lookup (from pFirstClassSubtable on)
+    // already covers their left glyph.
+    void LoadPairAdjustment(const u8* pSubtable, const u16 pGlyphCount, const u16 pLookup, const size_t pFirstClassSubtable, std::vector<KernPair>& pPairs);
+
+    // The class-based kerning of a pair, summed over the lookups for which
+    // pIsExplicit is false.
+    template <typename F>
+    s32 SumClassKerning(const GlyphID pLeft, const GlyphID pRight, F pIsExplicit) const;
+    void BuildHash(const std::vector<KernPair>& pPairs);
+
+    static u32 MakeKey(const GlyphID pLeft, const GlyphID pRight) { return (pLeft << 16) | (pRight & 0xffff); }
+
+    /* === Variables === */
+private:
+    static constexpr u32 kEmptyKey = 0xffffffff;
+    static constexpr u16 kNotCovered = 0xffff;
+
+    std::span<const u32> m_keys;
+    std::span<const s16> m_values;
+    u32 m_mask = 0;
+    u32 m_shift = 0;
+
+    std::vector<ClassSubtable> m_classSubtables;
+
+    // Backing for the views above when the table was loaded from the font
+    // rather than flat.
+    std::vector<u32> m_keyStorage;
+    std::vector<s16> m_valueStorage;
+    std::vector<std::vector<u16>> m_classStorage;
+    std::vector<std::vector<s16>> m_classValueStorage;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include "base.h"
+#include "encodings.h"
+
+//
+
+struct PositionedGlyph {
+    PositionedGlyph(const GlyphID pGlyphID, const float pX, const float pY, const u32 pCluster)
+        : glyphID(pGlyphID), x(pX), y(pY), cluster(pCluster)
+    {
+    }
+
+    //
+
+    GlyphID glyphID;
+    float x, y; // pen position in pixels; y is the baseline, growing down a line at a time.
+    u32 cluster; // byte offset of the source character in the text.
+};
+
+// Output buffer for library::LayoutRun. Clearing keeps the storage, so a
+// buffer reused across calls stops allocating once it has grown to fit.
+struct GlyphRun {
+    GlyphRun() : width(0), height(0), lineHeight(0), lineCount(0) {}
+
+    void Clear()
+    {
+        glyphs.clear();
+        width = height = lineHeight = 0;
+        lineCount = 0;
+    }
+
+    //
+
+    std::vector<PositionedGlyph> glyphs;
+    float width, height; // ink-independent extents: widest line, and lineCount * lineHeight.
+    float lineHeight;
+    size_t lineCount;
+};
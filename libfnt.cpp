@@ -1,36 +1,592 @@
 #include <assert.h>
-#include <fstream>
+#include <cstdlib>
+#include <algorithm>
+#include <cmath>
 
 #include "libfnt.h"
 
-library::library(const std::string& pFontPath)
+// The table directory lists a checksum for every table, so hashing it (FNV-1a)
+// tells fonts apart without reading the tables themselves.
+static u64
+HashFontDirectory(const u8* pData, const size_t pSize)
+{
+	const u16 tableCount = Stream::GetField<u16>(pData + 4);
+	const size_t length = std::min((size_t)12 + tableCount * 16, pSize);
+
+	u64 hash = 0xcbf29ce484222325ull ^ pSize;
+	for (size_t k = 0; k < length; ++k) {
+		hash = (hash ^ pData[k]) * 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+Font::Font(const std::string& pFontPath)
+{
+	// The file is mapped rather than read, so only the pages actually
+	// decoded from are read in. This matters for large (e.g. CJK) fonts,
+	// where most of glyf is never touched.
+	m_file = std::make_shared<const MappedFile>(pFontPath);
+	assert(m_file->IsOpen());
+
+	Open(std::span<const u8>(m_file->GetData(), m_file->GetSize()), 0);
+}
+
+Font::Font(std::span<const u8> pFontData)
+{
+	Open(pFontData, 0);
+}
+
+Font::Font(const EmbeddedFont& pEmbedded)
+{
+	m_compiled = new CompiledFont(pEmbedded);
+	assert(m_compiled->IsValid());
+
+	Open(m_compiled->GetFontData(), 0);
+}
+
+Font::Font(std::shared_ptr<const MappedFile> pFile, const u32 pDirectoryOffset, std::vector<std::shared_ptr<const Font>> pSiblings)
+	: m_file(std::move(pFile)), m_siblings(std::move(pSiblings))
+{
+	assert(m_file->IsOpen());
+
+	Open(std::span<const u8>(m_file->GetData(), m_file->GetSize()), pDirectoryOffset);
+}
+
+void Font::Open(std::span<const u8> pFontData, const u32 pDirectoryOffset)
+{
+	// A precompiled font is hashed by the font it carries, so glyph cache
+	// files are shared with the original.
+	std::span<const u8> fontData = pFontData;
+	if (!m_compiled && CompiledFont::IsCompiledFont(pFontData.data(), pFontData.size())) {
+		m_compiled = new CompiledFont(pFontData.data(), pFontData.size());
+		assert(m_compiled->IsValid());
+	}
+
+	if (m_compiled) {
+		fontData = m_compiled->GetFontData();
+		m_parser = new Parser(*m_compiled);
+	}
+	else {
+		std::vector<const Parser*> siblings;
+		for (const auto& sibling : m_siblings) {
+			siblings.push_back(&sibling->GetParser());
+		}
+
+		m_parser = new Parser(pFontData.data(), pDirectoryOffset, siblings);
+	}
+
+	// Each face of a collection is hashed by its own directory (0 meaning
+	// the first face, as for Parser).
+	const u32 directory = pDirectoryOffset ? pDirectoryOffset : Parser::GetFaceDirectories(fontData.data()).front();
+
+	m_hinting = new HintingProgram(*m_parser);
+	m_glyphCache = new GlyphCache();
+	m_contentHash = HashFontDirectory(fontData.data() + directory, fontData.size() - directory);
+}
+
+Font::~Font()
+{
+	// Bitmaps loaded from cache files point into them, so the cache goes
+	// first.
+	delete m_glyphCache;
+	for (auto* file : m_cacheFiles) {
+		delete file;
+	}
+	delete m_hinting;
+	delete m_parser;
+	delete m_compiled;
+}
+
+void Font::PrecomputeGlyphBounds()
+{
+	m_parser->BuildBoundsTable();
+}
+
+bool Font::LoadGlyphCache(const std::string& pPath)
+{
+	CacheFile* file = new CacheFile(pPath, m_contentHash);
+	if (!file->IsValid()) {
+		delete file;
+		return false;
+	}
+
+	file->Populate(*m_glyphCache);
+	m_cacheFiles.push_back(file);
+
+	return true;
+}
+
+bool Font::SaveGlyphCache(const std::string& pPath) const
+{
+	return CacheFile::Write(pPath, m_contentHash, *m_glyphCache);
+}
+
+//
+
+FontCollection::FontCollection(const std::string& pPath)
+	: m_file(std::make_shared<const MappedFile>(pPath))
+{
+	assert(m_file->IsOpen());
+
+	// A precompiled font only ever holds one face.
+	if (CompiledFont::IsCompiledFont(m_file->GetData(), m_file->GetSize())) {
+		m_directories = { 0 };
+	}
+	else {
+		m_directories = Parser::GetFaceDirectories(m_file->GetData());
+	}
+
+	m_faces.resize(m_directories.size());
+}
+
+std::shared_ptr<const Font> FontCollection::GetFace(const size_t pIndex)
 {
-	// Load font file into memory.
-	std::ifstream file_handle(pFontPath, std::ios::binary);
-	assert(file_handle.is_open());
+	assert(pIndex < m_directories.size());
+
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	if (!m_faces[pIndex]) {
+		std::vector<std::shared_ptr<const Font>> siblings;
+		for (const auto& face : m_faces) {
+			if (face) {
+				siblings.push_back(face);
+			}
+		}
+
+		m_faces[pIndex] = std::make_shared<const Font>(m_file, m_directories[pIndex], std::move(siblings));
+	}
+
+	return m_faces[pIndex];
+}
+
+RenderContext::RenderContext(std::shared_ptr<const Font> pFont)
+	: font(std::move(pFont))
+{
+	parser = &font->GetParser();
+	outlineCache = new OutlineCache(*parser);
+	glyphCache = &font->GetGlyphCache();
+	hinter = new GlyphHinter(font->GetHintingProgram());
+}
+
+RenderContext::~RenderContext()
+{
+	delete hinter;
+	delete outlineCache;
+}
+
+GlyphID RenderContext::GetGlyphID(const size_t pCharCode) const
+{
+	return parser->encoder->GetGlyphID(pCharCode);
+}
+
+GlyphDescription RenderContext::LoadGlyph(const size_t pCharCode)
+{
+	return parser->LoadGlyph(GetGlyphID(pCharCode), instance);
+}
+
+std::vector<GlyphDescription> RenderContext::LoadGlyphs(std::span<const GlyphID> pGlyphIDs) const
+{
+	return parser->LoadGlyphs(pGlyphIDs, instance);
+}
+
+BoundingBox RenderContext::GetGlyphBounds(const GlyphID pGlyphID, const float pPointSize) const
+{
+	const float scale = GetPixelsPerEm(pPointSize) / parser->upem;
+	const BoundingBox bb = parser->GetGlyphBounds(pGlyphID);
+	return BoundingBox(bb.xMin * scale, bb.yMin * scale, bb.xMax * scale, bb.yMax * scale);
+}
+
+void RenderContext::GetAdvances(std::span<const GlyphID> pGlyphIDs, std::span<float> pAdvances, const float pPointSize) const
+{
+	parser->GetAdvances(pGlyphIDs, pAdvances, GetPixelsPerEm(pPointSize));
+}
+
+float RenderContext::GetKerning(const GlyphID pLeft, const GlyphID pRight, const float pPointSize) const
+{
+	return parser->kerning.GetKerning(pLeft, pRight) * GetPixelsPerEm(pPointSize) / parser->upem;
+}
+
+TextExtents RenderContext::MeasureText(std::string_view pText, const float pPointSize) const
+{
+	const BasicUnicodeEncoder* encoder = parser->encoder;
+	const KerningTable& kerning = parser->kerning;
+	const uint16_t* advances = parser->advanceWidths.data();
+
+	// Sum in design units and scale once at the end.
+	s64 width = 0;
+	GlyphID prevGlyphID = 0;
+
+	const char* cursor = pText.data();
+	const char* end = cursor + pText.size();
+	while (cursor < end) {
+		const GlyphID glyphID = encoder->GetGlyphID(DecodeUTF8(cursor, end));
+		width += advances[glyphID];
+
+		if (prevGlyphID) {
+			width += kerning.GetKerning(prevGlyphID, glyphID);
+		}
+		prevGlyphID = glyphID;
+	}
+
+	const float scale = GetPixelsPerEm(pPointSize) / parser->upem;
+	return TextExtents{ width * scale, parser->ascender * scale, parser->descender * scale };
+}
+
+void RenderContext::LayoutRun(std::string_view pText, const float pPointSize, const float pMaxWidth, GlyphRun& pRun) const
+{
+	constexpr size_t kNoBreak = SIZE_MAX;
+
+	const BasicUnicodeEncoder* encoder = parser->encoder;
+	const KerningTable& kerning = parser->kerning;
+	const uint16_t* advances = parser->advanceWidths.data();
+
+	const float scale = GetPixelsPerEm(pPointSize) / parser->upem;
+
+	pRun.Clear();
+	pRun.lineHeight = (parser->ascender - parser->descender + parser->lineGap) * scale;
+	pRun.lineCount = 1;
+
+	float penX = 0.0f, penY = 0.0f;
+	float lineExtent = 0.0f; // right edge of the line's last non-space glyph.
+	size_t lineStart = 0;
+
+	// Index of the first glyph after the most recent space on this line,
+	// and the line's extent at that point.
+	size_t breakIdx = kNoBreak;
+	float breakExtent = 0.0f;
+
+	GlyphID prevGlyphID = 0;
+
+	const char* begin = pText.data();
+	const char* cursor = begin;
+	const char* end = begin + pText.size();
+	while (cursor < end) {
+		const u32 cluster = (u32)(cursor - begin);
+		const CharCode charCode = DecodeUTF8(cursor, end);
+
+		if (charCode == '\n') {
+			pRun.width = std::max(pRun.width, lineExtent);
+			penX = lineExtent = 0.0f;
+			penY += pRun.lineHeight;
+			lineStart = pRun.glyphs.size();
+			breakIdx = kNoBreak;
+			prevGlyphID = 0;
+			++pRun.lineCount;
+			continue;
+		}
+
+		const GlyphID glyphID = encoder->GetGlyphID(charCode);
+		const bool isSpace = (charCode == ' ');
 
-	file_handle.seekg(0, file_handle.end);
-	const auto file_size = file_handle.tellg();
-	file_handle.seekg(0, file_handle.beg);
+		if (prevGlyphID) {
+			penX += kerning.GetKerning(prevGlyphID, glyphID) * scale;
+		}
 
-	void* font = std::malloc(file_size);
-	file_handle.read((char*)font, file_size);
-	file_handle.close();
+		const float advance = advances[glyphID] * scale;
 
-	assert(font);
+		// Wrap at the last space if this glyph would overflow. A line
+		// with no space to break at is left to overflow instead.
+		const bool overflows = pMaxWidth > 0.0f && penX + advance > pMaxWidth;
+		if (!isSpace && overflows && breakIdx != kNoBreak && breakIdx > lineStart) {
+			pRun.width = std::max(pRun.width, breakExtent);
 
-	//
+			const bool hasCarried = breakIdx < pRun.glyphs.size();
+			const float shift = hasCarried ? pRun.glyphs[breakIdx].x : penX;
 
-	parser = new Parser(font);
+			for (size_t k = breakIdx; k < pRun.glyphs.size(); ++k) {
+				pRun.glyphs[k].x -= shift;
+				pRun.glyphs[k].y += pRun.lineHeight;
+			}
+
+			penX -= shift;
+			penY += pRun.lineHeight;
+			lineExtent = hasCarried ? lineExtent - shift : 0.0f;
+			lineStart = breakIdx;
+			breakIdx = kNoBreak;
+			++pRun.lineCount;
+		}
+
+		pRun.glyphs.emplace_back(glyphID, penX, penY, cluster);
+		penX += advance;
+
+		if (isSpace) {
+			breakIdx = pRun.glyphs.size();
+			breakExtent = lineExtent;
+		}
+		else {
+			lineExtent = penX;
+		}
+
+		prevGlyphID = glyphID;
+	}
+
+	pRun.width = std::max(pRun.width, lineExtent);
+	pRun.height = pRun.lineCount * pRun.lineHeight;
+}
+
+const RasterTarget* RenderContext::RenderGlyph(const GlyphDescription& pGlyphDesc, const float pPointSize)
+{
+	return RenderOutline(pGlyphDesc, parser->upem, GetPixelsPerEm(pPointSize));
+}
+
+void RenderContext::RenderGlyph(const GlyphDescription& pGlyphDesc, const float pPointSize, const RowSink& pSink)
+{
+	RenderOutline(pGlyphDesc, parser->upem, GetPixelsPerEm(pPointSize), pSink);
+}
+
+const SpanBitmap* RenderContext::RenderGlyphSpans(const GlyphDescription& pGlyphDesc, const float pPointSize)
+{
+	return RenderOutlineSpans(pGlyphDesc, parser->upem, GetPixelsPerEm(pPointSize));
+}
+
+const SpanBitmap* RenderContext::RenderGlyphSpans(const GlyphID pGlyphID, const float pPointSize)
+{
+	const GlyphKey key = MakeGlyphKey(pGlyphID, pPointSize, instance.id);
+
+	return glyphCache->FindOrRender(key, [&]() -> const SpanBitmap* {
+		if (const SpanBitmap* embedded = RenderEmbeddedGlyphSpans(pGlyphID, pPointSize)) {
+			return embedded;
+		}
+
+		const float ppem = GetPixelsPerEm(pPointSize);
+		return RenderOutlineSpans(outlineCache->Get(pGlyphID, ppem, instance), ppem);
+	}, countUses);
+}
+
+const SpanBitmap* RenderContext::RenderHintedGlyphSpans(const GlyphID pGlyphID, const float pPointSize)
+{
+	// Hinting only applies to the default instance; cvar isn't read.
+	if (!hinter->IsAvailable() || !instance.IsDefault()) {
+		return RenderGlyphSpans(pGlyphID, pPointSize);
+	}
+
+	const GlyphKey key = MakeGlyphKey(pGlyphID, pPointSize, 0, RenderMode::Hinted);
+
+	const SpanBitmap* bitmap = glyphCache->FindOrRender(key, [&]() -> const SpanBitmap* {
+		if (const SpanBitmap* embedded = RenderEmbeddedGlyphSpans(pGlyphID, pPointSize)) {
+			return embedded;
+		}
+
+		const float ppem = GetPixelsPerEm(pPointSize);
+		FlattenedOutline outline(BoundingBox(0, 0, 0, 0), 0.0f);
+		if (hinter->HintGlyph(pGlyphID, ppem, kFlattenTolerancePx / ppem, outline)) {
+			return RenderOutlineSpans(outline, ppem);
+		}
+
+		return nullptr;
+	}, countUses);
+
+	// A failed program is remembered under the hinted key, so it only runs
+	// once; the glyph is served unhinted from then on.
+	return bitmap ? bitmap : RenderGlyphSpans(pGlyphID, pPointSize);
+}
+
+const SpanBitmap* RenderContext::RenderGlyph(const GlyphID pGlyphID, const float pPointSize, const RenderPreference pPreference)
+{
+	if (ChooseRenderMode(pPointSize, pPreference) == RenderMode::Hinted) {
+		return RenderHintedGlyphSpans(pGlyphID, pPointSize);
+	}
+
+	return RenderGlyphSpans(pGlyphID, pPointSize);
+}
+
+RenderMode RenderContext::ChooseRenderMode(const float pPointSize, const RenderPreference pPreference) const
+{
+	// Hinting is only possible for the default instance (see
+	// RenderHintedGlyphSpans).
+	if (pPreference == RenderPreference::Speed || !hinter->IsAvailable() || !instance.IsDefault()) {
+		return RenderMode::Unhinted;
+	}
+
+	if (pPreference == RenderPreference::Quality) {
+		return RenderMode::Hinted;
+	}
+
+	// The rasterizer is bilevel, so the smoothing flags have nothing to
+	// switch off. Symmetric grid-fitting asks for the ClearType style of
+	// hinting, which the interpreter doesn't do, so it's left unhinted.
+	const u16 behavior = parser->GetGaspBehavior(GetPixelsPerEm(pPointSize));
+	return (behavior & gaspGridFitMask) ? RenderMode::Hinted : RenderMode::Unhinted;
+}
+
+const RasterTarget* RenderContext::RenderEmbeddedGlyph(const GlyphID pGlyphID, const float pPointSize, BitmapMetrics& pMetrics) const
+{
+	// Strikes only exist for whole pixel sizes, and only depict the
+	// default instance of a variable font.
+	if (!instance.IsDefault()) {
+		return nullptr;
+	}
+
+	const float ppem = GetPixelsPerEm(pPointSize);
+	const long strikePpem = std::lround(ppem);
+	if (std::fabs(ppem - strikePpem) > 0.01f || !parser->bitmaps.HasStrike((u16)strikePpem)) {
+		return nullptr;
+	}
+
+	return parser->bitmaps.Render((u16)strikePpem, pGlyphID, pMetrics);
+}
+
+const SpanBitmap* RenderContext::RenderEmbeddedGlyphSpans(const GlyphID pGlyphID, const float pPointSize) const
+{
+	BitmapMetrics metrics;
+	const RasterTarget* embedded = RenderEmbeddedGlyph(pGlyphID, pPointSize, metrics);
+	if (!embedded) {
+		return nullptr;
+	}
+
+	const SpanBitmap* encoded = EncodeSpans(*embedded, metrics.bearingX, metrics.bearingY - metrics.height);
+	std::free(embedded->memory_);
+	delete embedded;
+
+	return encoded;
+}
+
+const std::vector<VariationAxis>& RenderContext::GetVariationAxes() const
+{
+	return parser->variations.GetAxes();
+}
+
+void RenderContext::SetVariationCoordinates(std::span<const float> pCoords)
+{
+	instance = parser->variations.CreateInstance(pCoords);
+}
+
+const RasterTarget* RenderContext::RenderRun(const GlyphRun& pRun, const float pPointSize)
+{
+	if (pRun.glyphs.empty()) {
+		return nullptr;
+	}
+
+	const float ppem = GetPixelsPerEm(pPointSize);
+	const float ascent = DesignToRaster(parser->ascender, parser->upem, ppem);
+
+	// Each glyph's bitmap, cached or not, has its corner snapped to a whole
+	// pixel, so a run renders the same whatever is in the cache. Cached
+	// glyphs are measured from their bitmaps; only the rest are flattened.
+	struct Placement {
+		const SpanBitmap* bitmap; // or, when not cached,
+		const FlattenedOutline* outline;
+		long x, y; // where the bitmap's corner lands, from the first baseline's ascent line.
+	};
+
+	std::vector<Placement> placements;
+	placements.reserve(pRun.glyphs.size());
+
+	// Size the bitmap to the run's ink, which can overhang its advances.
+	float xMin = 0.0f, xMax = pRun.width;
+	float yMin = -pRun.height, yMax = 0.0f;
+	for (const auto& g : pRun.glyphs) {
+		Placement placement = { glyphCache->Find(MakeGlyphKey(g.glyphID, pPointSize, instance.id), countUses), nullptr };
+
+		float left, bottom; // the bitmap's corner from the glyph origin.
+		size_t width, height;
+		if (placement.bitmap) {
+			left = placement.bitmap->left;
+			bottom = placement.bitmap->bottom;
+			width = placement.bitmap->width;
+			height = placement.bitmap->height;
+		}
+		else {
+			placement.outline = &outlineCache->Get(g.glyphID, ppem, instance);
+			left = placement.outline->bb.xMin * ppem;
+			bottom = placement.outline->bb.yMin * ppem;
+			GetRasterExtents(placement.outline->bb, ppem, width, height);
+		}
+
+		// Rounded half up rather than away from zero, so a glyph lands on
+		// the same pixel whichever side of the ascent line it sits.
+		placement.x = (long)std::floor(g.x + left + 0.5f);
+		placement.y = (long)std::floor(-ascent - g.y + bottom + 0.5f);
+
+		xMin = std::min(xMin, (float)placement.x);
+		xMax = std::max(xMax, (float)(placement.x + (long)width));
+		yMin = std::min(yMin, (float)placement.y);
+		yMax = std::max(yMax, (float)(placement.y + (long)height));
+
+		placements.push_back(placement);
+	}
+
+	const float originX = std::floor(xMin);
+	const float originY = std::floor(yMin);
+	const size_t width = (size_t)std::ceil(xMax - originX);
+	const size_t height = (size_t)std::ceil(yMax - originY);
+	if (!width || !height) {
+		return nullptr;
+	}
+
+	// Rows run bottom up, so each corner is measured from the bottom left
+	// of the bitmap. Uncached outlines are merged into one table, each
+	// placed as its own bitmap would be blitted.
+	EdgeTable et(width, height, ppem);
+	for (const Placement& placement : placements) {
+		if (placement.outline) {
+			et.AppendAt(*placement.outline, placement.x - (long)originX, placement.y - (long)originY);
+		}
+	}
+
+	RasterTarget* target = (RasterTarget*)RenderOutline(et, 0.0f);
+
+	for (const Placement& placement : placements) {
+		if (placement.bitmap) {
+			placement.bitmap->Blit(*target, placement.x - (long)originX, placement.y - (long)originY);
+		}
+	}
+
+	return target;
+}
+
+const EdgeTable* RenderContext::FlattenGlyph(const GlyphDescription& pGlyphDesc, const float pPointSize)
+{
+	return new EdgeTable(pGlyphDesc, parser->upem, GetPixelsPerEm(pPointSize));
+}
+
+const RasterTarget* RenderContext::RenderGlyph(const EdgeTable& pEdgeTable, const float pSubpixelX)
+{
+	return RenderOutline(pEdgeTable, pSubpixelX);
+}
+
+const EdgeTable* RenderContext::FlattenGlyph(const GlyphID pGlyphID, const float pPointSize)
+{
+	const float ppem = GetPixelsPerEm(pPointSize);
+	return new EdgeTable(outlineCache->Get(pGlyphID, ppem, instance), ppem);
+}
+
+const OutlineCache::Stats& RenderContext::GetOutlineCacheStats() const
+{
+	return outlineCache->GetStats();
+}
+
+const RasterTarget* RenderContext::RenderGlyphSDF(const GlyphID pGlyphID, const float pPointSize, const float pSpread)
+{
+	const float ppem = GetPixelsPerEm(pPointSize);
+	return RenderSDF(outlineCache->Get(pGlyphID, ppem, instance), ppem, pSpread);
+}
+
+//
+
+library::library(const std::string& pFontPath)
+	: library(std::make_shared<Font>(pFontPath))
+{
+}
+
+library::library(std::span<const u8> pFontData)
+	: library(std::make_shared<Font>(pFontData))
+{
+}
+
+library::library(const EmbeddedFont& pEmbedded)
+	: library(std::make_shared<Font>(pEmbedded))
+{
 }
 
-GlyphDescription library::LoadGlyph(const size_t pCharCode)
+library::library(std::shared_ptr<Font> pFont)
+	: RenderContext(pFont), m_ownFont(pFont)
 {
-	const GlyphID glyphID = parser->encoder->GetGlyphID(pCharCode);
-	return parser->LoadGlyph(glyphID);
 }
 
-const RasterTarget* library::RenderGlyph(const GlyphDescription& pGlyphDesc, const float pPointSize)
+void library::PrecomputeGlyphBounds()
 {
-	return RenderOutline(pGlyphDesc, parser->upem);
+	// Safe, as the font isn't shared with any other context.
+	m_ownFont->PrecomputeGlyphBounds();
 }
@@ -1,21 +1,242 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
 
 #include "outline.h" 
 #include "parser.h" 
 #include "raster.h" 
+#include "spans.h"
+#include "cache.h"
+#include "sdf.h"
+#include "layout.h"
+#include "hinting.h"
+#include "mapping.h"
+#include "cachefile.h"
+#include "compiled.h"
 
 //
 
-struct library {
-    library(const std::string& pFontFilePath);
+struct TextExtents {
+    float width;
+    float ascent, descent; // descent is negative, as it lies below the baseline.
+};
+
+// How library::RenderGlyph trades speed against quality when it picks a
+// render mode for a size.
+enum class RenderPreference : u8 {
+    Speed, // never hint.
+    Balanced, // hint where the font's gasp table asks for grid-fitting.
+    Quality // hint at every size.
+};
+
+// A font file and everything parsed from it. Nothing in it changes once
+// constructed (bar PrecomputeGlyphBounds), so a single Font can back any
+// number of RenderContexts on different threads without locking. The glyph
+// cache and the hinting size cache are the exceptions: they are shared by
+// all of them, and safe to use concurrently (see GlyphCache and
+// HintingProgram).
+class Font {
+    /* === Methods === */
+public:
+    // Opens a TrueType font, or one precompiled from it (see CompiledFont).
+    Font(const std::string& pFontFilePath);
+
+    // As above, from a font already in memory, which must outlive the
+    // Font. Nothing is read from disk.
+    Font(std::span<const u8> pFontData);
+
+    // A font embedded in the program by fntgen, used where it lies: no
+    // I/O, no index building, and outlines are flattened straight from
+    // the pre-decoded points.
+    Font(const EmbeddedFont& pEmbedded);
+
+    // A face of a collection (see FontCollection), over the collection's
+    // one mapping. pSiblings are faces already open from the same file,
+    // whose indexes this face uses wherever their tables are shared (see
+    // Parser::Parser); it keeps them alive for that.
+    Font(std::shared_ptr<const MappedFile> pFile, const u32 pDirectoryOffset, std::vector<std::shared_ptr<const Font>> pSiblings);
+    ~Font();
+
+    Font(const Font&) = delete;
+    Font& operator=(const Font&) = delete;
+
+    // Not thread-safe: call before the font is shared.
+    void PrecomputeGlyphBounds();
+
+    const Parser& GetParser() const { return *m_parser; }
+    GlyphCache& GetGlyphCache() const { return *m_glyphCache; }
+    const HintingProgram& GetHintingProgram() const { return *m_hinting; }
+
+    // Identifies the font's contents, from the face's table directory
+    // (which holds every table's checksum) and the file size.
+    u64 GetContentHash() const { return m_contentHash; }
+
+    // Warm restarts: SaveGlyphCache writes the glyph cache to pPath (see
+    // CacheFile), and LoadGlyphCache fills the cache from a file saved
+    // earlier for this same font, keeping it mapped for the font's
+    // lifetime. A stale or mismatched file is ignored and false returned.
+    // LoadGlyphCache is not thread-safe: call it before the font is shared.
+    bool LoadGlyphCache(const std::string& pPath);
+    bool SaveGlyphCache(const std::string& pPath) const;
 
+private:
+    void Open(std::span<const u8> pFontData, const u32 pDirectoryOffset);
+
+    /* === Variables === */
+private:
+    std::shared_ptr<const MappedFile> m_file; // null when opened from memory.
+    std::vector<std::shared_ptr<const Font>> m_siblings;
+    CompiledFont* m_compiled = nullptr; // when the file is precompiled.
+    Parser* m_parser;
+    HintingProgram* m_hinting; // fpgm is run once here, not per context.
+    GlyphCache* m_glyphCache;
+    std::vector<CacheFile*> m_cacheFiles; // loaded by LoadGlyphCache.
+    u64 m_contentHash;
+};
+
+// A TrueType Collection (.ttc), the usual packaging of CJK system fonts:
+// several faces in one file, sharing many of their tables. The file is
+// mapped once and every face is a Font over that mapping, so shared tables
+// are in memory once, and faces sharing a cmap, metrics or kerning table
+// index it once between them. A single font file opens as a collection of
+// one face.
+class FontCollection {
+    /* === Methods === */
+public:
+    FontCollection(const std::string& pPath);
+
+    size_t GetFaceCount() const { return m_directories.size(); }
+
+    // The face is opened on first request, and the same Font returned
+    // after that. Safe to call from several threads.
+    std::shared_ptr<const Font> GetFace(const size_t pIndex);
+
+    /* === Variables === */
+private:
+    std::shared_ptr<const MappedFile> m_file;
+    std::vector<u32> m_directories; // each face's table directory offset.
+
+    std::mutex m_lock; // guards m_faces.
+    std::vector<std::shared_ptr<const Font>> m_faces; // null until opened.
+};
+
+// Everything needed to render from a shared Font on one thread: the outline
+// cache, the hinting interpreter and the selected variation instance. A
+// context is not itself thread-safe, so each thread creates its own; the
+// font is only ever read through it.
+struct RenderContext {
+    RenderContext(std::shared_ptr<const Font> pFont);
+    ~RenderContext();
+
+    RenderContext(const RenderContext&) = delete;
+    RenderContext& operator=(const RenderContext&) = delete;
+
+    GlyphID GetGlyphID(const size_t pCharCode) const;
     GlyphDescription LoadGlyph(const size_t pCharCode);
 
+    // Decodes many glyphs at once, returned in the order given (see
+    // Parser::LoadGlyphs).
+    std::vector<GlyphDescription> LoadGlyphs(std::span<const GlyphID> pGlyphIDs) const;
+
+    // Ink bounds in pixels, without decoding the outline.
+    BoundingBox GetGlyphBounds(const GlyphID pGlyphID, const float pPointSize) const;
+
+    void GetAdvances(std::span<const GlyphID> pGlyphIDs, std::span<float> pAdvances, const float pPointSize) const;
+
+    // Kerning adjustment between two glyphs, in pixels.
+    float GetKerning(const GlyphID pLeft, const GlyphID pRight, const float pPointSize) const;
+
+    // Measures a single line of UTF-8 text from the cmap and metrics alone;
+    // no outlines are decoded and nothing is allocated.
+    TextExtents MeasureText(std::string_view pText, const float pPointSize) const;
+
+    // Positions the glyphs of UTF-8 text with advances and kerning applied,
+    // breaking lines at spaces to fit pMaxWidth (zero for no limit) and at
+    // newlines. Results replace the previous contents of pRun.
+    void LayoutRun(std::string_view pText, const float pPointSize, const float pMaxWidth, GlyphRun& pRun) const;
+
+    // Variable fonts: pCoords are user-space axis values (e.g. a weight of
+    // 700), in the order of GetVariationAxes. Later loads and renders by
+    // this context use that instance; cached outlines and bitmaps are kept
+    // per instance.
+    const std::vector<VariationAxis>& GetVariationAxes() const;
+    void SetVariationCoordinates(std::span<const float> pCoords);
+
+    // Renders a laid out run into a single bitmap. Glyphs already in the
+    // glyph cache are blitted; the rest have their edges merged into one
+    // table and are scan-converted together. Either way each glyph sits on
+    // a whole pixel, as its cached bitmap would. nullptr for a run with no
+    // glyphs or no area.
+    const RasterTarget* RenderRun(const GlyphRun& pRun, const float pPointSize);
+
     const RasterTarget* RenderGlyph(const GlyphDescription& pGlyphDesc, const float pPointSize);
+    void RenderGlyph(const GlyphDescription& pGlyphDesc, const float pPointSize, const RowSink& pSink);
+    const SpanBitmap* RenderGlyphSpans(const GlyphDescription& pGlyphDesc, const float pPointSize);
+
+    // Cached: the returned bitmap is owned by the library. An embedded
+    // bitmap is used when the font has a strike for this exact size.
+    // nullptr when the glyph can't be rendered, e.g. when it would be
+    // wider than kMaxSpanBitmapWidth.
+    const SpanBitmap* RenderGlyphSpans(const GlyphID pGlyphID, const float pPointSize);
+
+    // As above, but grid-fitted by the font's TrueType instructions. Falls
+    // back to the unhinted outline when the font has no hinting or its
+    // programs fail.
+    const SpanBitmap* RenderHintedGlyphSpans(const GlyphID pGlyphID, const float pPointSize);
+
+    // Renders with the mode ChooseRenderMode picks for the size. Cached,
+    // as above; an embedded bitmap still wins in every mode.
+    const SpanBitmap* RenderGlyph(const GlyphID pGlyphID, const float pPointSize, const RenderPreference pPreference = RenderPreference::Balanced);
+    RenderMode ChooseRenderMode(const float pPointSize, const RenderPreference pPreference) const;
+
+    // The glyph's embedded bitmap for this size, or nullptr if the font
+    // has none.
+    const RasterTarget* RenderEmbeddedGlyph(const GlyphID pGlyphID, const float pPointSize, BitmapMetrics& pMetrics) const;
+
+    // As above, run-length encoded and placed by the bitmap's metrics, as
+    // the glyph cache stores it.
+    const SpanBitmap* RenderEmbeddedGlyphSpans(const GlyphID pGlyphID, const float pPointSize) const;
+
+    // Subpixel positioning: flatten a glyph once, then render it at any
+    // fractional pen offset (see SplitPenPosition) from the same table.
+    const EdgeTable* FlattenGlyph(const GlyphDescription& pGlyphDesc, const float pPointSize);
+    const RasterTarget* RenderGlyph(const EdgeTable& pEdgeTable, const float pSubpixelX);
+
+    // As above, but the flattened outline is cached in ems and reused
+    // across point sizes.
+    const EdgeTable* FlattenGlyph(const GlyphID pGlyphID, const float pPointSize);
+    const OutlineCache::Stats& GetOutlineCacheStats() const;
+
+    // Signed distance field of the glyph, with pSpread in pixels at the
+    // given point size (see RenderSDF).
+    const RasterTarget* RenderGlyphSDF(const GlyphID pGlyphID, const float pPointSize, const float pSpread);
+
+    //
+
+    std::shared_ptr<const Font> font;
+    const Parser* parser;
+    OutlineCache* outlineCache;
+    GlyphCache* glyphCache; // the font's, shared with its other contexts.
+    GlyphHinter* hinter;
+    VariationInstance instance;
+    bool countUses = true; // whether this context's cache lookups add to its usage counts.
+};
+
+// A render context with a font of its own, for single threaded use.
+struct library : RenderContext {
+    library(const std::string& pFontFilePath);
+    library(std::span<const u8> pFontData);
+    library(const EmbeddedFont& pEmbedded);
+
+    void PrecomputeGlyphBounds();
+
+private:
+    library(std::shared_ptr<Font> pFont);
 
     //
 
-    Parser* parser;
+    std::shared_ptr<Font> m_ownFont;
 };
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include <fstream>
+#include <cstdlib>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mapping.h"
+
+//
+
+MappedFile::MappedFile(const std::string& pPath)
+{
+#if defined(__unix__) || defined(__APPLE__)
+	const int fd = open(pPath.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) == 0 && info.st_size > 0) {
+		void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			m_data = data;
+			m_size = info.st_size;
+			m_mapped = true;
+		}
+	}
+	close(fd);
+
+	if (m_mapped) {
+		return;
+	}
+#endif
+
+	std::ifstream file_handle(pPath, std::ios::binary);
+	if (!file_handle.is_open()) {
+		return;
+	}
+
+	file_handle.seekg(0, file_handle.end);
+	const auto file_size = file_handle.tellg();
+	file_handle.seekg(0, file_handle.beg);
+
+	if (file_size <= 0) {
+		return;
+	}
+
+	m_size = file_size;
+	m_data = std::malloc(m_size);
+	file_handle.read((char*)m_data, m_size);
+}
+
+MappedFile::~MappedFile()
+{
+#if defined(__unix__) || defined(__APPLE__)
+	if (m_mapped) {
+		munmap(m_data, m_size);
+		return;
+	}
+#endif
+	std::free(m_data);
+}
+
+void
+PrefetchRange(const void* pStart, const size_t pLength)
+{
+#if defined(__unix__) || defined(__APPLE__)
+	const uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+	const uintptr_t start = (uintptr_t)pStart & ~(pageSize - 1);
+	madvise((void*)start, (uintptr_t)pStart + pLength - start, MADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+#include "base.h"
+
+//
+
+// A whole file, read-only. On POSIX systems it is mapped (mmap), so pages
+// are only read in as they are touched. Elsewhere, Windows included, there
+// is no mapping: the whole file is read into memory when opened, so the
+// "zero-copy" users of it (cache files, compiled fonts, collections) then
+// share that one copy instead.
+class MappedFile {
+    /* === Methods === */
+public:
+    // IsOpen is false if the file couldn't be opened.
+    MappedFile(const std::string& pPath);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool IsOpen() const { return m_data != nullptr; }
+
+    const u8* GetData() const { return (const u8*)m_data; }
+    size_t GetSize() const { return m_size; }
+
+    /* === Variables === */
+private:
+    void* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_mapped = false; // false when the file was read into memory instead.
+};
+
+// Asks the OS to start reading a range of a mapped file ahead of use. On
+// memory that is already resident it does nothing.
+void PrefetchRange(const void* pStart, const size_t pLength);
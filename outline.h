@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <span>
 #include "base.h"
 
 //
@@ -38,12 +39,39 @@ struct BoundingBox {
 
     //
 
-    BoundingBox(const float pXmin, const float pYmin, const float pXmax, const float pYmax)
+    constexpr BoundingBox(const float pXmin, const float pYmin, const float pXmax, const float pYmax)
         : xMin(pXmin), yMin(pYmin), xMax(pXmax), yMax(pYmax)
     {
     }
 };
 
+struct LineSegment {
+    LineSegment(const Point& pP0, const Point& pP1)
+        : p0(pP0), p1(pP1)
+    {
+    }
+
+    //
+
+    Point p0, p1;
+};
+
+// A glyph outline with its curves flattened into line segments. Points are
+// in ems (design units divided by upem), so one flattening can be scaled to
+// any pixel size whose flattening error stays within tolerance.
+struct FlattenedOutline {
+    FlattenedOutline(const BoundingBox& pBB, const float pTolerance)
+        : bb(pBB), tolerance(pTolerance)
+    {
+    }
+
+    //
+
+    BoundingBox bb;
+    float tolerance; // max distance of a segment from the true curve, in ems.
+    std::vector<LineSegment> segments;
+};
+
 struct Outline {
     Outline(const EdgeTable* pEdgeTable, const BoundingBox& pBB)
         : et(pEdgeTable), bb(pBB)
@@ -76,6 +104,48 @@ struct GlyphMesh {
     std::vector<Contour> contours;
 };
 
+struct OutlinePoint {
+    s16 x, y;
+};
+
+// A glyph's outline in design units, decoded ahead of time (see
+// DecodedOutlines) and viewed where it is stored.
+struct OutlineView {
+    std::span<const OutlinePoint> points;
+    std::span<const uint8_t> flags;
+    std::span<const u16> contourEnds; // each contour's last point.
+};
+
+// Every glyph's default outline, decoded ahead of time, as a precompiled
+// font carries them (see CompiledFont). Glyph k's points run from
+// starts[k].firstPoint to starts[k + 1].firstPoint, and its contours
+// likewise, with each contour end counted from the glyph's first point.
+// Compound glyphs are stored already resolved into their components.
+struct DecodedOutlines {
+    struct Start {
+        u32 firstPoint;
+        u32 firstContour;
+    };
+
+    bool IsEmpty() const { return starts.empty(); }
+
+    OutlineView Get(const u32 pGlyphID) const
+    {
+        const Start& start = starts[pGlyphID];
+        const Start& end = starts[pGlyphID + 1];
+        return OutlineView{ points.subspan(start.firstPoint, end.firstPoint - start.firstPoint),
+            flags.subspan(start.firstPoint, end.firstPoint - start.firstPoint),
+            contourEnds.subspan(start.firstContour, end.firstContour - start.firstContour) };
+    }
+
+    //
+
+    std::span<const Start> starts; // glyphCount + 1 entries.
+    std::span<const OutlinePoint> points;
+    std::span<const uint8_t> flags;
+    std::span<const u16> contourEnds;
+};
+
 struct GlyphDescription {
     GlyphDescription(const GlyphMesh& pMesh, const BoundingBox& pBB)
         : mesh(pMesh), bb(pBB)
@@ -86,4 +156,5 @@ struct GlyphDescription {
 
     GlyphMesh mesh;
     BoundingBox bb;
+    std::span<const u8> instructions; // the glyph program of a simple glyph.
 };
\ No newline at end of file
@@ -1,24 +1,141 @@
 #include <functional>
 #include <algorithm>
 #include <assert.h>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
 
 #include "stream.h"
 #include "parser.h"
 #include "raster.h"
+#include "mapping.h"
+#include "compiled.h"
 
 //
 
-Parser::Parser(const void *pFontData)
-	: fontData((const uint8_t *)pFontData), encoder(nullptr), upem(0)
+Parser::Parser(const void *pFontData, const uint32_t pDirectoryOffset, std::span<const Parser* const> pSiblings)
+	: encoder(nullptr), fontData((const uint8_t *)pFontData), upem(0), numGlyphs(0), locaLongFormat(false),
+	ascender(0), descender(0), lineGap(0)
 {
+	RegisterTables(pDirectoryOffset);
+	LoadGlobalMetrics();
+
+	// Faces of a collection commonly share their cmap, metrics and kerning
+	// tables, so their indexes are borrowed from a sibling where possible.
+	if (const Parser* shared = FindSharedTables(pSiblings, { "cmap" })) {
+		encoder = shared->encoder;
+	}
+	else {
+		ChooseEncoder();
+	}
+
+	if (const Parser* shared = FindSharedTables(pSiblings, { "hhea", "hmtx", "vhea", "vmtx" })) {
+		advanceWidths = shared->advanceWidths;
+		leftSideBearings = shared->leftSideBearings;
+		advanceHeights = shared->advanceHeights;
+		topSideBearings = shared->topSideBearings;
+	}
+	else {
+		LoadGlyphMetrics();
+	}
+
+	if (const Parser* shared = FindSharedTables(pSiblings, { "gpos", "kern" })) {
+		const auto subtables = shared->kerning.GetClassSubtables();
+		kerning.LoadFlat(shared->kerning.GetPairKeys(), shared->kerning.GetPairValues(), { subtables.begin(), subtables.end() });
+	}
+	else {
+		LoadKerning();
+	}
+
+	LoadEmbeddedBitmaps();
+	LoadVariations();
+	LoadGasp();
+}
+
+Parser::Parser(const CompiledFont& pCompiled)
+	: encoder(nullptr), fontData(pCompiled.GetFontData().data()), upem(0), numGlyphs(0), locaLongFormat(false),
+	ascender(0), descender(0), lineGap(0)
+{
+	// Only the fixed size headers are read from the tables; everything
+	// proportional to the glyph count comes from the compiled indexes.
 	RegisterTables();
-	ChooseEncoder();
 	LoadGlobalMetrics();
+	assert(numGlyphs == pCompiled.GetGlyphCount());
+
+	// Embedded fonts give their character map as ranges instead.
+	if (pCompiled.GetCharRanges().empty()) {
+		encoder = new BasicUnicodeEncoder(pCompiled.GetCharMap());
+	}
+	else {
+		encoder = new BasicUnicodeEncoder(pCompiled.GetCharRanges());
+	}
+	glyphOffsets = pCompiled.GetGlyphOffsets();
+	outlines = pCompiled.GetOutlines();
+	advanceWidths = pCompiled.GetAdvanceWidths();
+	leftSideBearings = pCompiled.GetLeftSideBearings();
+	advanceHeights = pCompiled.GetAdvanceHeights();
+	topSideBearings = pCompiled.GetTopSideBearings();
+	glyphBounds = pCompiled.GetGlyphBounds();
+	pCompiled.LoadKerning(kerning);
+
+	LoadEmbeddedBitmaps();
+	LoadVariations();
+	LoadGasp();
+}
+
+std::vector<uint32_t>
+Parser::GetFaceDirectories(const void *pFontData)
+{
+	Stream header(pFontData);
+	if (header.GetField<uint32_t>() != 0x74746366) { // 'ttcf'
+		return { 0 };
+	}
+
+	header.Skip(4); // skip version
+	const uint32_t faceCount = header.GetField<uint32_t>();
+	assert(faceCount > 0);
+
+	std::vector<uint32_t> directories(faceCount);
+	for (auto &offset : directories) {
+		offset = header.GetField<uint32_t>();
+	}
+
+	return directories;
 }
 
-void Parser::RegisterTables()
+const Parser*
+Parser::FindSharedTables(std::span<const Parser* const> pSiblings, std::initializer_list<const char*> pTags) const
 {
-	Stream ttfFile(fontData);
+	for (const Parser* sibling : pSiblings) {
+		// The per-glyph indexes are sized by the glyph count.
+		bool isShared = (sibling->fontData == fontData && sibling->numGlyphs == numGlyphs);
+
+		for (const char* tag : pTags) {
+			const auto mine = tables.find(tag);
+			const auto theirs = sibling->tables.find(tag);
+			const bool hasMine = (mine != tables.end());
+			const bool hasTheirs = (theirs != sibling->tables.end());
+
+			isShared &= (hasMine == hasTheirs) && (!hasMine || mine->second == theirs->second);
+		}
+
+		if (isShared) {
+			return sibling;
+		}
+	}
+
+	return nullptr;
+}
+
+void Parser::RegisterTables(uint32_t pDirectoryOffset)
+{
+	// Table offsets in a collection are from the start of the file, so
+	// only the directory itself moves.
+	if (!pDirectoryOffset) {
+		pDirectoryOffset = GetFaceDirectories(fontData).front();
+	}
+
+	Stream ttfFile(fontData + pDirectoryOffset);
 	ttfFile.Skip(4); // skip to table-count
 	uint16_t tableCount = ttfFile.GetField<uint16_t>();
 	ttfFile.Skip(6); // skip to 1st table-descriptor
@@ -34,7 +151,8 @@ void Parser::RegisterTables()
 		const uint32_t tableOffset = ttfFile.GetField<uint32_t>();
 		tables.insert(std::make_pair(tag, tableOffset));
 
-		ttfFile.Skip(4); // skip table length
+		const uint32_t tableLength = ttfFile.GetField<uint32_t>();
+		tableLengths.insert(std::make_pair(tag, tableLength));
 	}
 }
 
@@ -70,11 +188,172 @@ Parser::GetTable(const std::string &pTag) const
 	return Stream(fontData + tables.at(pTag));
 }
 
+uint32_t Parser::GetTableLength(const std::string &pTag) const
+{
+	return tableLengths.at(pTag);
+}
+
+bool Parser::HasTable(const std::string &pTag) const
+{
+	return tables.count(pTag);
+}
+
 void Parser::LoadGlobalMetrics()
 {
 	Stream head = GetTable("head");
 	head.Skip(18);
 	upem = head.GetField<uint16_t>();
+	head.Skip(30); // skip to locaFormat field
+	locaLongFormat = (bool)head.GetField<int16_t>();
+
+	Stream maxp = GetTable("maxp");
+	maxp.Skip(4); // skip version
+	numGlyphs = maxp.GetField<uint16_t>();
+
+	Stream hhea = GetTable("hhea");
+	hhea.Skip(4); // skip version
+	ascender = hhea.GetField<int16_t>();
+	descender = hhea.GetField<int16_t>();
+	lineGap = hhea.GetField<int16_t>();
+}
+
+static void
+UnpackLongMetrics(
+	Stream header,
+	Stream metrics,
+	const uint16_t glyphCount,
+	std::vector<uint16_t> &advances,
+	std::vector<int16_t> &bearings)
+{
+	// hhea and vhea share a layout, with the long metric count last.
+	header.Skip(34);
+	const uint16_t longMetricCount = std::min(header.GetField<uint16_t>(), glyphCount);
+
+	advances.assign(glyphCount, 0);
+	bearings.assign(glyphCount, 0);
+
+	// Without a single long metric there is no advance to share, so every
+	// glyph keeps a zero advance and bearing rather than reading garbage.
+	if (longMetricCount == 0) {
+		return;
+	}
+
+	for (size_t k = 0; k < longMetricCount; ++k) {
+		advances[k] = metrics.GetField<uint16_t>();
+		bearings[k] = metrics.GetField<int16_t>();
+	}
+
+	// Trailing glyphs only store a bearing and share the last advance,
+	// which is expanded here so lookups never need to branch on it.
+	for (size_t k = longMetricCount; k < glyphCount; ++k) {
+		advances[k] = advances[longMetricCount - 1];
+		bearings[k] = metrics.GetField<int16_t>();
+	}
+}
+
+void Parser::LoadGlyphMetrics()
+{
+	UnpackLongMetrics(GetTable("hhea"), GetTable("hmtx"), numGlyphs, m_advanceWidths, m_leftSideBearings);
+	advanceWidths = m_advanceWidths;
+	leftSideBearings = m_leftSideBearings;
+
+	if (HasTable("vhea") && HasTable("vmtx")) {
+		UnpackLongMetrics(GetTable("vhea"), GetTable("vmtx"), numGlyphs, m_advanceHeights, m_topSideBearings);
+		advanceHeights = m_advanceHeights;
+		topSideBearings = m_topSideBearings;
+	}
+}
+
+void Parser::LoadKerning()
+{
+	// GPOS supersedes 'kern' when a font has both, as its pairs are the
+	// ones the designer actually maintains.
+	if (HasTable("gpos")) {
+		kerning.LoadGPOS(GetTable("gpos"), numGlyphs);
+	}
+
+	if (kerning.IsEmpty() && HasTable("kern")) {
+		kerning.LoadKern(GetTable("kern"));
+	}
+}
+
+void Parser::LoadEmbeddedBitmaps()
+{
+	// CBLC shares EBLC's layout; only its image formats differ.
+	if (HasTable("eblc") && HasTable("ebdt")) {
+		bitmaps.Load(GetTable("eblc"), GetTable("ebdt"));
+	}
+	else if (HasTable("cblc") && HasTable("cbdt")) {
+		bitmaps.Load(GetTable("cblc"), GetTable("cbdt"));
+	}
+}
+
+void Parser::LoadVariations()
+{
+	if (!HasTable("fvar") || !HasTable("gvar")) {
+		return;
+	}
+
+	variations.Load(GetTable("fvar"), GetTable("gvar"));
+	if (HasTable("avar")) {
+		variations.LoadAxisMapping(GetTable("avar"));
+	}
+}
+
+void Parser::LoadGasp()
+{
+	if (!HasTable("gasp")) {
+		return;
+	}
+
+	Stream gasp = GetTable("gasp");
+	gasp.SkipField<uint16_t>(); // skip version
+	const uint16_t rangeCount = gasp.GetField<uint16_t>();
+
+	gaspRanges.resize(rangeCount);
+	for (auto& range : gaspRanges) {
+		range.maxPPEM = gasp.GetField<uint16_t>();
+		range.behavior = gasp.GetField<uint16_t>();
+	}
+}
+
+uint16_t Parser::GetGaspBehavior(const float pPixelsPerEm) const
+{
+	if (gaspRanges.empty()) {
+		return gaspGridFitMask | gaspDoGrayMask;
+	}
+
+	// The last range is meant to end at 0xffff; any size past it is
+	// treated as belonging to it regardless.
+	const uint16_t ppem = (uint16_t)std::min(std::lround(pPixelsPerEm), 0xffffl);
+	for (const auto& range : gaspRanges) {
+		if (ppem <= range.maxPPEM) {
+			return range.behavior;
+		}
+	}
+
+	return gaspRanges.back().behavior;
+}
+
+void Parser::GetAdvances(std::span<const GlyphID> pGlyphIDs, std::span<float> pAdvances, const float pPixelsPerEm) const
+{
+	assert(pAdvances.size() >= pGlyphIDs.size());
+
+	const size_t count = pGlyphIDs.size();
+	const uint16_t *widths = advanceWidths.data();
+	float *out = pAdvances.data();
+
+	// Gather first, then scale in a separate branch-free pass so the
+	// multiply loop vectorizes.
+	for (size_t k = 0; k < count; ++k) {
+		assert(pGlyphIDs[k] < numGlyphs);
+		out[k] = widths[pGlyphIDs[k]];
+	}
+
+	const float scale = pPixelsPerEm / upem;
+	for (size_t k = 0; k < count; ++k) {
+		out[k] *= scale;
+	}
 }
 
 void UnpackFlags(
@@ -84,18 +363,25 @@ void UnpackFlags(
 {
 	constexpr auto kRepeatMask = (1 << RepeatBit);
 
+	// A repeated flag can run on into the next contour, so unpack the
+	// flags for every point first and then split them between contours.
+	const size_t totalPtCount = endPoints.empty() ? 0 : endPoints.back() + 1;
+
+	std::vector<uint8_t> allFlags;
+	allFlags.reserve(totalPtCount);
+	while (allFlags.size() < totalPtCount) {
+		const uint8_t flag = *dataStream;
+		const auto repeatCount = (flag & kRepeatMask) ? *dataStream : 0;
+		allFlags.insert(allFlags.end(), 1 + repeatCount, flag);
+	}
+
 	size_t prevTotalPts = 0;
 	for (const auto &idx : endPoints) {
 		contours.emplace_back();
 		auto &flags = contours.back().flags;
 
 		const auto contourPtCount = (idx + 1) - prevTotalPts;
-
-		while (flags.size() < contourPtCount) {
-			const uint8_t flag = *dataStream;
-			const auto repeatCount = (flag & kRepeatMask) ? *dataStream : 0;
-			flags.insert(flags.end(), 1 + repeatCount, flag);
-		}
+		flags.assign(allFlags.begin() + prevTotalPts, allFlags.begin() + prevTotalPts + contourPtCount);
 
 		prevTotalPts += contourPtCount;
 	}
@@ -149,27 +435,15 @@ InterpretF2DOT14(const u16 bits)
 	// fractional value, and the top 2-bits store the
 	// integer value, using twos complement representation.
 	// See: https://learn.microsoft.com/en-us/typography/opentype/spec/otff
-
-	s8 integerVal = (bits & 0xC000) >> 14; // shift integer-bits to bottom.
-	if (bits & 0x8000) { // if msb is set, then value is -ve.
-		// minus one, and negate the integer-bits, yielding the +ve
-		// version of the value.
-		constexpr u8 integerBitsMask = 1 << 15;
-		const u8 absVal = ~(integerVal - 1) & integerBitsMask;
-		integerVal = -absVal; // store back as signed value.
-	}
-
-	// Compute the fractional value from the fraction-bits, using the
-	// formula (fraction-bits integer value) / 2^14.
-	const float fractionalVal = (bits & 0x3FFF) / (float)16384;
-
 	//
+	// Reinterpreting all 16-bits as a twos complement integer and
+	// dividing by 2^14 yields the same value, sign included.
 
-	return integerVal + fractionalVal;
+	return (s16)bits / (float)16384;
 }
 
 const GlyphMesh
-Parser::LoadSimpleGlyph(Stream glyf, const int16_t pContourCount)
+Parser::LoadSimpleGlyph(Stream glyf, const int16_t pContourCount, const GlyphID pGlyphID, const VariationInstance& pInstance, std::span<const uint8_t> &pInstructions) const
 {
 	std::vector<uint16_t> contourEndPts(pContourCount);
 	for (size_t k = 0; k < pContourCount; ++k) {
@@ -177,6 +451,7 @@ Parser::LoadSimpleGlyph(Stream glyf, const int16_t pContourCount)
 	}
 
 	const uint16_t instructionCount = glyf.GetField<uint16_t>();
+	pInstructions = std::span<const uint8_t>((const uint8_t *)glyf.get(), instructionCount);
 	glyf.Skip(instructionCount);
 
 	std::vector<Contour> contours;
@@ -184,108 +459,331 @@ Parser::LoadSimpleGlyph(Stream glyf, const int16_t pContourCount)
 	UnpackAxis(glyf, contours, XSelect, XShort, XDual);
 	UnpackAxis(glyf, contours, YSelect, YShort, YDual);
 
+	if (!pInstance.IsDefault()) {
+		variations.Apply(pGlyphID, pInstance, contours);
+	}
+
 	return GlyphMesh(contours); // @todo: avoid copy of contour data into GlyphMesh struct?
 }
 
-const GlyphMesh
-Parser::LoadCompoundGlyph(Stream pData)
+static Component
+ReadComponent(Stream &pData)
 {
-	// @todo: "In a variable font, the offset vector can be modified by deltas in the 'gvar' table; 
-	// see Point numbers and processing for composite glyphs in the 'gvar' chapter for details."
+	Component comp;
+	comp.flags = pData.GetField<u16>();
+	comp.glyphID = pData.GetField<u16>();
+
+	// Load arguments 1 and 2.
+	const bool isWide = comp.flags & argWidthMask;
+	const bool isSigned = comp.flags & argTypeMask;
+
+	// Load the transform components.
+	float a = 1.0f; // a-d (transform matrix).
+	float b = 0.0f;
+	float c = 0.0f;
+	float d = 1.0f;
+	float e = 0.0f; // e-f (translation)
+	float f = 0.0f;
+
+	// offsets ...
+	comp.hasOffset = isSigned;
+	if (isWide && isSigned) {
+		e = pData.GetField<s16>();	// x-delta
+		f = pData.GetField<s16>();	// y-delta
+	}
+	else if (!isWide && isSigned) {
+		e = pData.GetField<s8>();	// x-delta
+		f = pData.GetField<s8>();	// y-delta
+	}
+	else { // point-aligments.
+		pData.Skip(isWide ? 4 : 2);
+	}
 
-	GlyphMesh compoundMesh;
+	if (comp.flags & singleScaleMask) {
+		const float scale = InterpretF2DOT14(pData.GetField<u16>());
+		a = scale;
+		d = scale;
+	}
+	else if (comp.flags & doubleScaleMask) {
+		a = InterpretF2DOT14(pData.GetField<u16>());
+		d = InterpretF2DOT14(pData.GetField<u16>());
+	}
+	else if (comp.flags & transformMask) {
+		a = InterpretF2DOT14(pData.GetField<u16>());
+		b = InterpretF2DOT14(pData.GetField<u16>());
+		c = InterpretF2DOT14(pData.GetField<u16>());
+		d = InterpretF2DOT14(pData.GetField<u16>());
+	}
+
+	// scale the subglyph's offsets by the transform.
+	float m = std::max(std::abs(a), std::abs(b));
+	float n = std::max(std::abs(c), std::abs(d));
+	constexpr float threshold = 33 / (float)65536;
+	if ((std::abs(std::abs(a) - std::abs(c)) <= threshold)) {
+		m *= 2;
+	}
+	if ((std::abs(std::abs(b) - std::abs(d)) <= threshold)) {
+		n *= 2;
+	}
+
+	comp.a = a;
+	comp.b = b;
+	comp.c = c;
+	comp.d = d;
+	comp.e = m * e;
+	comp.f = n * f;
+
+	return comp;
+}
+
+std::vector<Component>
+Parser::ReadComponents(Stream &pData, const GlyphID pGlyphID, const VariationInstance& pInstance) const
+{
+	std::vector<Component> components;
 
 	bool hasNextComponent = true;
 	while (hasNextComponent) {
-		const u16 flags = pData.GetField<u16>();
-		const u16 componentGlyphID = pData.GetField<u16>();
-		GlyphDescription subGlyph = LoadGlyph(componentGlyphID); // @todo: use maxp table to avoid stack recursion. 
-
-		// Load arguments 1 and 2.
-		const bool isWide = flags & argWidthMask;
-		const bool isSigned = flags & argTypeMask;
-
-		// Load the transform components.
-		float a = 1.0f; // a-d (transform matrix).
-		float b = 0.0f;
-		float c = 0.0f;
-		float d = 1.0f;
-		float e = 0.0f; // e-f (translation)
-		float f = 0.0f;
-
-		// offsets ...
-		if (isWide && isSigned) {
-			e = pData.GetField<s16>();	// x-delta
-			f = pData.GetField<s16>();	// y-delta
-		}
-		else if (!isWide && isSigned) {
-			e = pData.GetField<s8>();	// x-delta
-			f = pData.GetField<s8>();	// y-delta
-		}
-		else { // point-aligments.
-			// @err: We don't support alignments!
-			assert(0);
-		}
+		components.push_back(ReadComponent(pData));
+		hasNextComponent = components.back().flags & nextCompMask;
+	}
 
-		if (flags & singleScaleMask) {
-			const float scale = InterpretF2DOT14(pData.GetField<u16>());
-			a = scale;
-			d = scale;
-		}
-		else if (flags & doubleScaleMask) {
-			a = InterpretF2DOT14(pData.GetField<u16>());
-			d = InterpretF2DOT14(pData.GetField<u16>());
-		}
-		else if (flags & transformMask) {
-			a = InterpretF2DOT14(pData.GetField<u16>());
-			b = InterpretF2DOT14(pData.GetField<u16>());
-			c = InterpretF2DOT14(pData.GetField<u16>());
-			d = InterpretF2DOT14(pData.GetField<u16>());
+	// In a variable font, gvar moves each component's offset like a point.
+	if (!pInstance.IsDefault()) {
+		std::vector<Point> offsets;
+		for (const auto &comp : components) {
+			offsets.emplace_back(comp.e, comp.f);
 		}
 
-		// scale the subglyph's offsets by the transform.
-		float m = std::max(std::abs(a), std::abs(b));
-		float n = std::max(std::abs(c), std::abs(d));
-		constexpr float threshold = 33 / (float)65536;
-		if ((std::abs(std::abs(a) - std::abs(c)) <= threshold)) {
-			m *= 2;
-		}
-		if ((std::abs(std::abs(b) - std::abs(d)) <= threshold)) {
-			n *= 2;
+		variations.ApplyToComponents(pGlyphID, pInstance, offsets);
+
+		for (size_t k = 0; k < components.size(); ++k) {
+			components[k].e = offsets[k].x;
+			components[k].f = offsets[k].y;
 		}
+	}
+
+	return components;
+}
+
+bool
+Parser::LoadComponents(const GlyphID pGlyphID, const VariationInstance& pInstance, std::vector<Component> &pComponents, BoundingBox &pHeaderBB, std::span<const uint8_t> &pInstructions) const
+{
+	uint32_t glyphOffset, glyphLength;
+	GetGlyphLocation(pGlyphID, glyphOffset, glyphLength);
+	if (!glyphLength) {
+		return false;
+	}
+
+	Stream glyf = GetTable("glyf");
+	glyf.Skip(glyphOffset);
+	if (glyf.GetField<int16_t>() >= 0) {
+		return false;
+	}
+
+	pHeaderBB.xMin = glyf.GetField<int16_t>();
+	pHeaderBB.yMin = glyf.GetField<int16_t>();
+	pHeaderBB.xMax = glyf.GetField<int16_t>();
+	pHeaderBB.yMax = glyf.GetField<int16_t>();
+
+	pComponents = ReadComponents(glyf, pGlyphID, pInstance);
+
+	pInstructions = {};
+	if (pComponents.back().flags & instructionsMask) {
+		const uint16_t instructionCount = glyf.GetField<uint16_t>();
+		pInstructions = std::span<const uint8_t>((const uint8_t *)glyf.get(), instructionCount);
+	}
+
+	return true;
+}
+
+const GlyphMesh
+Parser::LoadCompoundGlyph(Stream pData, const GlyphID pGlyphID, const VariationInstance& pInstance) const
+{
+	const std::vector<Component> components = ReadComponents(pData, pGlyphID, pInstance);
+
+	GlyphMesh compoundMesh;
+
+	for (const auto &comp : components) {
+		assert(comp.hasOffset); // @err: We don't support alignments!
+
+		GlyphDescription subGlyph = LoadGlyph(comp.glyphID, pInstance); // @todo: use maxp table to avoid stack recursion. 
 
 		// Transform the child's control points. 
 		for (auto &con : subGlyph.mesh.contours) {
 			for (size_t k = 0; k < con.getTotalPtCount(); ++k) {
-				s16 x = con.xs[k], y = con.ys[k];
-				con.xs[k] = (s16)std::roundf(a*x + c*y + m*e);
-				con.ys[k] = (s16)std::roundf(b*x + d*y + n*f);
+				const fPoint p = comp.Apply(con.xs[k], con.ys[k]);
+				con.xs[k] = (s16)std::roundf(p.x);
+				con.ys[k] = (s16)std::roundf(p.y);
 			}
 		}
 
 		// 
 		compoundMesh.AddMesh(subGlyph.mesh);
-
-		//
-		hasNextComponent = flags & nextCompMask;
 	}
 
 	return compoundMesh;
 }
 
-GlyphDescription
-Parser::LoadGlyph(const GlyphID pGlyphID)
+void
+Parser::GetGlyphLocation(const GlyphID pGlyphID, uint32_t &pOffset, uint32_t &pLength) const
 {
-	Stream head = GetTable("head");
-	head.Skip(50); // skip to locaFormat field
-	const bool locaLongFormat = (bool)head.GetField<int16_t>();
+	assert(pGlyphID < numGlyphs);
+
+	if (!glyphOffsets.empty()) {
+		pOffset = glyphOffsets[pGlyphID];
+		pLength = glyphOffsets[pGlyphID + 1] - pOffset;
+		return;
+	}
 
 	Stream loca = GetTable("loca");
 	const size_t bytesPerElement = locaLongFormat ? 4 : 2;
 	loca.Skip(bytesPerElement * pGlyphID); // jump to array element for glyph.
 	uint32_t glyphOffset = locaLongFormat ? loca.GetField<uint32_t>() : loca.GetField<uint16_t>();
+	uint32_t nextGlyphOffset = locaLongFormat ? loca.GetField<uint32_t>() : loca.GetField<uint16_t>();
 	if (!locaLongFormat) {
 		glyphOffset *= 2;
+		nextGlyphOffset *= 2;
+	}
+
+	pOffset = glyphOffset;
+	pLength = nextGlyphOffset - glyphOffset;
+}
+
+BoundingBox
+Parser::GetGlyphBounds(const GlyphID pGlyphID) const
+{
+	if (!glyphBounds.empty()) {
+		return glyphBounds[pGlyphID];
+	}
+
+	uint32_t glyphOffset, glyphLength;
+	GetGlyphLocation(pGlyphID, glyphOffset, glyphLength);
+
+	// Glyphs without an outline (e.g. the space) have no glyf data at all.
+	if (!glyphLength) {
+		return BoundingBox(0, 0, 0, 0);
+	}
+
+	Stream glyf = GetTable("glyf");
+	glyf.Skip(glyphOffset);
+
+	const int16_t contourCount = glyf.GetField<int16_t>();
+
+	const int16_t xMin = glyf.GetField<int16_t>();
+	const int16_t yMin = glyf.GetField<int16_t>();
+	const int16_t xMax = glyf.GetField<int16_t>();
+	const int16_t yMax = glyf.GetField<int16_t>();
+	const BoundingBox headerBB(xMin, yMin, xMax, yMax);
+
+	if (contourCount >= 0) {
+		return headerBB;
+	}
+
+	// A compound glyph's header can't be trusted once its components are
+	// scaled or rotated, so union the transformed corners of each
+	// component's own bounds instead, rounded outwards so the box always
+	// holds the outline.
+	BoundingBox bb(FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+	bool hasNextComponent = true;
+	while (hasNextComponent) {
+		const Component comp = ReadComponent(glyf);
+		if (!comp.hasOffset) {
+			return headerBB; // point-aligned components need the full outline.
+		}
+
+		const BoundingBox sub = GetGlyphBounds(comp.glyphID);
+		const fPoint corners[] = {
+			comp.Apply(sub.xMin, sub.yMin), comp.Apply(sub.xMax, sub.yMin),
+			comp.Apply(sub.xMin, sub.yMax), comp.Apply(sub.xMax, sub.yMax),
+		};
+
+		for (const auto &p : corners) {
+			bb.xMin = std::min(bb.xMin, std::floor(p.x));
+			bb.yMin = std::min(bb.yMin, std::floor(p.y));
+			bb.xMax = std::max(bb.xMax, std::ceil(p.x));
+			bb.yMax = std::max(bb.yMax, std::ceil(p.y));
+		}
+
+		hasNextComponent = comp.flags & nextCompMask;
+	}
+
+	return bb;
+}
+
+void
+Parser::BuildBoundsTable()
+{
+	if (!glyphBounds.empty()) {
+		return; // already built, or precompiled.
+	}
+
+	std::vector<BoundingBox> table;
+	table.reserve(numGlyphs);
+
+	for (GlyphID k = 0; k < numGlyphs; ++k) {
+		table.push_back(GetGlyphBounds(k));
+	}
+
+	m_glyphBounds = std::move(table);
+	glyphBounds = m_glyphBounds;
+}
+
+std::vector<GlyphDescription>
+Parser::LoadGlyphs(std::span<const GlyphID> pGlyphIDs, const VariationInstance &pInstance) const
+{
+	// Bytes of glyph data requested ahead of the glyph being decoded.
+	constexpr uint32_t kPrefetchWindow = 256 * 1024;
+
+	const size_t count = pGlyphIDs.size();
+
+	std::vector<uint32_t> offsets(count), lengths(count);
+	for (size_t k = 0; k < count; ++k) {
+		GetGlyphLocation(pGlyphIDs[k], offsets[k], lengths[k]);
+	}
+
+	std::vector<uint32_t> order(count);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&offsets](const uint32_t a, const uint32_t b) { return offsets[a] < offsets[b]; });
+
+	const uint8_t *glyf = (const uint8_t *)GetTable("glyf").get();
+
+	std::vector<GlyphDescription> descs(count, GlyphDescription(GlyphMesh(), BoundingBox(0, 0, 0, 0)));
+
+	size_t windowEnd = 0; // position in order up to which data has been prefetched.
+	for (size_t k = 0; k < count; ++k) {
+		const uint32_t index = order[k];
+
+		// Once decoding catches up with the prefetched data, request the
+		// next window's worth of glyphs in one go.
+		if (k == windowEnd) {
+			const uint32_t start = offsets[index];
+			uint32_t end = start;
+			while (windowEnd < count && offsets[order[windowEnd]] < start + kPrefetchWindow) {
+				end = std::max(end, offsets[order[windowEnd]] + lengths[order[windowEnd]]);
+				++windowEnd;
+			}
+
+			if (end > start) {
+				PrefetchRange(glyf + start, end - start);
+			}
+		}
+
+		descs[index] = LoadGlyph(pGlyphIDs[index], pInstance);
+	}
+
+	return descs;
+}
+
+GlyphDescription
+Parser::LoadGlyph(const GlyphID pGlyphID, const VariationInstance& pInstance) const
+{
+	uint32_t glyphOffset, glyphLength;
+	GetGlyphLocation(pGlyphID, glyphOffset, glyphLength);
+
+	// Glyphs without an outline (e.g. the space) have no glyf data at all.
+	if (!glyphLength) {
+		return GlyphDescription(GlyphMesh(), BoundingBox(0, 0, 0, 0));
 	}
 
 	Stream glyf = GetTable("glyf");
@@ -299,12 +797,36 @@ Parser::LoadGlyph(const GlyphID pGlyphID)
 	const int16_t yMin = glyf.GetField<int16_t>();
 	const int16_t xMax = glyf.GetField<int16_t>();
 	const int16_t yMax = glyf.GetField<int16_t>();
-	BoundingBox bb(xMin, yMin, xMax, yMax);
 
-	const GlyphMesh mesh = (contourCount < 0) ? LoadCompoundGlyph(glyf)
-		: LoadSimpleGlyph(glyf, contourCount);
+	// Compound glyphs take the bounds GetGlyphBounds resolves, so a glyph
+	// is rendered within the same box it is measured by.
+	BoundingBox bb = (contourCount < 0) ? GetGlyphBounds(pGlyphID) : BoundingBox(xMin, yMin, xMax, yMax);
+
+	std::span<const uint8_t> instructions;
+	const GlyphMesh mesh = (contourCount < 0) ? LoadCompoundGlyph(glyf, pGlyphID, pInstance)
+		: LoadSimpleGlyph(glyf, contourCount, pGlyphID, pInstance, instructions);
+
+	// The header bounds only hold for the default instance.
+	if (!pInstance.IsDefault()) {
+		bb = BoundingBox(FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (const auto &c : mesh.contours) {
+			for (size_t k = 0; k < c.getTotalPtCount(); ++k) {
+				bb.xMin = std::min(bb.xMin, (float)c.xs[k]);
+				bb.yMin = std::min(bb.yMin, (float)c.ys[k]);
+				bb.xMax = std::max(bb.xMax, (float)c.xs[k]);
+				bb.yMax = std::max(bb.yMax, (float)c.ys[k]);
+			}
+		}
+
+		if (mesh.contours.empty()) {
+			bb = BoundingBox(0, 0, 0, 0);
+		}
+	}
 
 	//
 
-	return GlyphDescription(mesh, bb);
+	GlyphDescription desc(mesh, bb);
+	desc.instructions = instructions;
+
+	return desc;
 }
\ No newline at end of file
@@ -3,10 +3,15 @@
 // Depends:
 #include <unordered_map>
 #include <string>
+#include <vector>
+#include <span>
 
 #include "stream.h"
 #include "outline.h"
 #include "encodings.h"
+#include "kerning.h"
+#include "bitmaps.h"
+#include "variations.h"
 
 #define XSelect [](Contour& c) -> auto & { return c.xs; }
 #define YSelect [](Contour& c) -> auto & { return c.ys; }
@@ -18,34 +23,162 @@
 
 #define argWidthMask 	 (1 << 0)
 #define argTypeMask 	 (1 << 1)
+#define roundXYToGridMask (1 << 2)
 #define singleScaleMask  (1 << 3)
 #define doubleScaleMask  (1 << 6)
 #define transformMask 	 (1 << 7)
 #define nextCompMask     (1 << 5)
+#define instructionsMask (1 << 8)
+#define useMyMetricsMask (1 << 9)
 #define SCALED_COMPONENT_OFFSET (1<<11)
 #define UNSCALED_COMPONENT_OFFSET (1<<12)
+
+// gasp range behaviour flags.
+#define gaspGridFitMask           (1 << 0)
+#define gaspDoGrayMask            (1 << 1)
+#define gaspSymmetricGridFitMask  (1 << 2)
+#define gaspSymmetricSmoothMask   (1 << 3)
 //
 
+class CompiledFont;
+
+// A gasp range: the behaviour flags for sizes up to maxPPEM, inclusive.
+struct GaspRange {
+    uint16_t maxPPEM;
+    uint16_t behavior;
+};
+
+// One component record of a compound glyph.
+struct Component {
+    u16 flags;
+    GlyphID glyphID;
+    bool hasOffset; // false when the component is positioned by point alignment.
+
+    float a, b, c, d; // a-d (transform matrix).
+    float e, f; // e-f (translation, already scaled by the transform).
+
+    fPoint Apply(const float x, const float y) const
+    {
+        return fPoint(a*x + c*y + e, b*x + d*y + f);
+    }
+};
+
 struct Parser {
-    Parser(const void *pFontData);
+    // pDirectoryOffset locates the face's table directory: always 0 for a
+    // single font, and one of GetFaceDirectories for a collection (0 picks
+    // a collection's first face). Indexes of tables shared with an
+    // already-open face of the same collection in pSiblings (the character
+    // map, metrics and kerning) are used from it rather than built again;
+    // the siblings must outlive this parser.
+    Parser(const void *pFontData, const uint32_t pDirectoryOffset = 0, std::span<const Parser* const> pSiblings = {});
 
-    void RegisterTables();
+    // Uses a precompiled font's indexes in place (see CompiledFont): the
+    // glyph locations, character map, metrics, kerning and bounds are read
+    // straight from its mapping instead of being built from the tables.
+    Parser(const CompiledFont& pCompiled);
+
+    // The table directory offset of each face in a TrueType Collection
+    // (.ttc), or just 0 for a single font.
+    static std::vector<uint32_t> GetFaceDirectories(const void *pFontData);
+
+    void RegisterTables(uint32_t pDirectoryOffset = 0);
 
     void ChooseEncoder();
 
     Stream GetTable(const std::string &pTag) const;
+    uint32_t GetTableLength(const std::string &pTag) const;
+    bool HasTable(const std::string &pTag) const;
 
     void LoadGlobalMetrics();
+    void LoadGlyphMetrics();
+    void LoadKerning();
+    void LoadEmbeddedBitmaps();
+    void LoadVariations();
+    void LoadGasp();
+
+    // The gasp behaviour flags for a size. Fonts without a gasp table get
+    // grid-fitting and smoothing at every size.
+    uint16_t GetGaspBehavior(const float pPixelsPerEm) const;
+
+    // Writes each glyph's advance width, scaled to pixels, into pAdvances.
+    void GetAdvances(std::span<const GlyphID> pGlyphIDs, std::span<float> pAdvances, const float pPixelsPerEm) const;
+
+    // Decodes the glyph at the given variation instance (see
+    // GlyphVariations::CreateInstance).
+    GlyphDescription LoadGlyph(const GlyphID pGlyphID, const VariationInstance& pInstance = VariationInstance()) const;
+
+    // As LoadGlyph, for many glyphs, returned in the order given. They are
+    // decoded in glyf order instead, with the data just ahead of the
+    // current glyph requested from the OS early, so a large set of glyphs
+    // is read in one forward sweep rather than by seeking about the file.
+    std::vector<GlyphDescription> LoadGlyphs(std::span<const GlyphID> pGlyphIDs, const VariationInstance& pInstance = VariationInstance()) const;
 
-    GlyphDescription LoadGlyph(const GlyphID pGlyphID);
+    // Offset of the glyph's data within glyf, and its length in bytes.
+    void GetGlyphLocation(const GlyphID pGlyphID, uint32_t &pOffset, uint32_t &pLength) const;
 
-    const GlyphMesh LoadCompoundGlyph(Stream pData); // @todo: private
-    const GlyphMesh LoadSimpleGlyph(Stream glyf, const int16_t pContourCount); // @todo: private
+    // Bounds in design units, from the glyf header alone (compound glyphs
+    // are resolved from their components' headers), without decoding any
+    // outline. These are the bounds LoadGlyph gives the default instance,
+    // so measuring and rendering agree. BuildBoundsTable precomputes them
+    // for every glyph.
+    BoundingBox GetGlyphBounds(const GlyphID pGlyphID) const;
+    void BuildBoundsTable();
+
+    // A compound glyph's components (with the instance's gvar offset deltas
+    // applied), the bounds stored in its header, and its own instructions.
+    // Returns false for simple glyphs.
+    bool LoadComponents(const GlyphID pGlyphID, const VariationInstance& pInstance, std::vector<Component> &pComponents, BoundingBox &pHeaderBB, std::span<const uint8_t> &pInstructions) const;
+
+    std::vector<Component> ReadComponents(Stream &pData, const GlyphID pGlyphID, const VariationInstance& pInstance) const; // @todo: private
+    const GlyphMesh LoadCompoundGlyph(Stream pData, const GlyphID pGlyphID, const VariationInstance& pInstance) const; // @todo: private
+    const GlyphMesh LoadSimpleGlyph(Stream glyf, const int16_t pContourCount, const GlyphID pGlyphID, const VariationInstance& pInstance, std::span<const uint8_t> &pInstructions) const; // @todo: private
 
     //
 
     std::unordered_map<std::string, uint32_t> tables;
+    std::unordered_map<std::string, uint32_t> tableLengths;
     const BasicUnicodeEncoder *encoder;
     const uint8_t *fontData;
     uint16_t upem;
+    uint16_t numGlyphs;
+    bool locaLongFormat;
+
+    // Line metrics from hhea, in design units.
+    int16_t ascender, descender, lineGap;
+
+    // Per-glyph metrics from hmtx (and vmtx, when present), indexed by glyph
+    // id. Glyphs past numberOfHMetrics already carry the last advance.
+    std::span<const uint16_t> advanceWidths;
+    std::span<const int16_t> leftSideBearings;
+    std::span<const uint16_t> advanceHeights;
+    std::span<const int16_t> topSideBearings;
+
+    // Each glyph's offset within glyf, plus one past the last glyph; only
+    // set for precompiled fonts, as otherwise loca is read directly.
+    std::span<const uint32_t> glyphOffsets;
+
+    // Every glyph's default outline, decoded ahead of time; only set for
+    // precompiled fonts, as otherwise glyf is decoded on demand.
+    DecodedOutlines outlines;
+
+    KerningTable kerning;
+    EmbeddedBitmaps bitmaps;
+    GlyphVariations variations;
+
+    std::vector<GaspRange> gaspRanges; // in ascending maxPPEM order.
+
+    std::span<const BoundingBox> glyphBounds; // empty until BuildBoundsTable is called.
+
+private:
+    // A sibling whose tables pTags are all the same as this face's (or
+    // equally absent), or nullptr.
+    const Parser* FindSharedTables(std::span<const Parser* const> pSiblings, std::initializer_list<const char*> pTags) const;
+
+    // Backing for the views above when they were built here rather than
+    // mapped from a precompiled font.
+    std::vector<uint16_t> m_advanceWidths;
+    std::vector<int16_t> m_leftSideBearings;
+    std::vector<uint16_t> m_advanceHeights;
+    std::vector<int16_t> m_topSideBearings;
+    std::vector<BoundingBox> m_glyphBounds;
 };
\ No newline at end of file
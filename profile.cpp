@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <fstream>
+#include <cstdio>
+
+#include "profile.h"
+
+//
+
+std::vector<UsageEntry>
+GetUsageProfile(const Font& pFont)
+{
+	std::vector<std::pair<GlyphKey, u32>> usage;
+	pFont.GetGlyphCache().GetUsage(usage);
+
+	std::vector<UsageEntry> profile;
+	for (const auto& [key, count] : usage) {
+		UsageEntry entry;
+		u16 instance;
+		SplitGlyphKey(key, entry.glyphID, entry.pointSize, instance, entry.mode);
+		entry.count = count;
+
+		if (instance == 0 && count > 0) {
+			profile.push_back(entry);
+		}
+	}
+
+	// Ties are broken by key, so the same usage always saves the same file.
+	std::sort(profile.begin(), profile.end(), [](const UsageEntry& a, const UsageEntry& b) {
+		if (a.count != b.count) {
+			return a.count > b.count;
+		}
+		if (a.glyphID != b.glyphID) {
+			return a.glyphID < b.glyphID;
+		}
+		if (a.pointSize != b.pointSize) {
+			return a.pointSize < b.pointSize;
+		}
+		return a.mode < b.mode;
+	});
+
+	return profile;
+}
+
+bool
+SaveUsageProfile(const Font& pFont, const std::string& pPath)
+{
+	std::ofstream file(pPath, std::ios::trunc);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	for (const UsageEntry& entry : GetUsageProfile(pFont)) {
+		file << entry.glyphID << ' ' << entry.pointSize << ' ' << (u32)entry.mode << ' ' << entry.count << '\n';
+	}
+
+	return file.good();
+}
+
+std::vector<UsageEntry>
+LoadUsageProfile(const std::string& pPath)
+{
+	std::vector<UsageEntry> profile;
+
+	std::ifstream file(pPath);
+	std::string line;
+	while (std::getline(file, line)) {
+		u32 glyphID, mode;
+		float pointSize;
+		u32 count;
+		if (std::sscanf(line.c_str(), "%u %f %u %u", &glyphID, &pointSize, &mode, &count) != 4) {
+			continue;
+		}
+
+		if (glyphID > 0xffff || mode > (u32)RenderMode::Hinted || !(pointSize > 0.0f)) {
+			continue;
+		}
+
+		profile.push_back({ (GlyphID)glyphID, pointSize, (RenderMode)mode, count });
+	}
+
+	return profile;
+}
+
+std::future<size_t>
+PrewarmGlyphCache(std::shared_ptr<const Font> pFont, std::vector<UsageEntry> pProfile,
+	const std::chrono::milliseconds pTimeBudget, const size_t pMemoryBudget)
+{
+	const auto deadline = std::chrono::steady_clock::now() + pTimeBudget;
+
+	return std::async(std::launch::async, [font = std::move(pFont), profile = std::move(pProfile), deadline, pMemoryBudget]() {
+		// Prewarming isn't use, so it mustn't feed the next profile.
+		RenderContext context(font);
+		context.countUses = false;
+		const u16 glyphCount = font->GetParser().numGlyphs;
+
+		size_t rendered = 0;
+		for (const UsageEntry& entry : profile) {
+			if (std::chrono::steady_clock::now() >= deadline || context.glyphCache->GetMemoryUsage() >= pMemoryBudget) {
+				break;
+			}
+
+			// A profile from another version of the font may name glyphs
+			// this one doesn't have.
+			if (entry.glyphID >= glyphCount) {
+				continue;
+			}
+
+			// Glyphs already cached, by other contexts or an earlier entry
+			// for the same size, cost nothing and don't count.
+			if (context.glyphCache->Contains(MakeGlyphKey(entry.glyphID, entry.pointSize, 0, entry.mode))) {
+				continue;
+			}
+
+			if (entry.mode == RenderMode::Hinted) {
+				context.RenderHintedGlyphSpans(entry.glyphID, entry.pointSize);
+			}
+			else {
+				context.RenderGlyphSpans(entry.glyphID, entry.pointSize);
+			}
+			++rendered;
+		}
+
+		return rendered;
+	});
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <future>
+#include <memory>
+
+#include "base.h"
+#include "libfnt.h"
+
+//
+
+// How often one cached glyph was asked for while usage was being recorded
+// (see GlyphCache::SetRecordUsage).
+struct UsageEntry {
+    GlyphID glyphID;
+    float pointSize;
+    RenderMode mode;
+    u32 count;
+};
+
+// The font's glyph cache usage so far, most used first. Only the default
+// variation instance is included, as instance ids aren't stable between
+// runs.
+std::vector<UsageEntry> GetUsageProfile(const Font& pFont);
+
+// A profile is saved as text, one "glyph size mode count" line per entry,
+// so it can be inspected or edited by hand. Loading keeps the file's order;
+// a missing file gives an empty profile, and malformed lines are skipped.
+bool SaveUsageProfile(const Font& pFont, const std::string& pPath);
+std::vector<UsageEntry> LoadUsageProfile(const std::string& pPath);
+
+// Renders the profile's glyphs into the font's glyph cache on a background
+// thread, in profile order, so a fresh process serves its usual glyphs from
+// the cache from the start. Stops early once pTimeBudget has passed or the
+// cache holds pMemoryBudget bytes. Rendering goes through the shared cache,
+// so it is safe alongside other contexts using the font; a glyph they ask
+// for first is simply not rendered twice. The result is the number of
+// glyphs rendered, not counting those already cached.
+std::future<size_t> PrewarmGlyphCache(std::shared_ptr<const Font> pFont, std::vector<UsageEntry> pProfile,
+    const std::chrono::milliseconds pTimeBudget, const size_t pMemoryBudget);
@@ -2,6 +2,7 @@
 #include <assert.h>
 #include <stack>
 #include <cmath>
+#include <cstring>
 
 #include "raster.h"
 
@@ -10,9 +11,11 @@
 Edge::Edge(
 	const fPoint& p0,
 	const fPoint& p1,
-	const BoundingBox& pBB,
-	const float upem
-) : is_active(false), m(0), c(0), sclx(0)
+	const fPoint& pOrigin,
+	const float ppem,
+	const long pOffsetX,
+	const long pOffsetY
+) : m(0), c(0), offsetX(pOffsetX), offsetY(pOffsetY)
 {
 	// classify the points into min & max.
 	if (p0.y > p1.y) {
@@ -32,17 +35,17 @@ Edge::Edge(
 
 	is_vertical = (apex.x == base.x);
 
-	// Translate the outline into the 1st quadrant.
-	apex.x -= pBB.xMin;
-	base.x -= pBB.xMin;
-	apex.y -= pBB.yMin;
-	base.y -= pBB.yMin;
+	// Translate the outline so the origin lands on the bitmap's corner.
+	apex.x -= pOrigin.x;
+	base.x -= pOrigin.x;
+	apex.y -= pOrigin.y;
+	base.y -= pOrigin.y;
 
-	// Scale points into bitmap space.
-	apex.x = DesignToRaster(apex.x, upem);
-	apex.y = DesignToRaster(apex.y, upem);
-	base.x = DesignToRaster(base.x, upem);
-	base.y = DesignToRaster(base.y, upem);
+	// Scale points from ems into bitmap space.
+	apex.x *= ppem;
+	apex.y *= ppem;
+	base.x *= ppem;
+	base.y *= ppem;
 
 	// Calculate gradient & intercept (for non-vertical edges).
 	if (!is_vertical) {
@@ -53,17 +56,9 @@ Edge::Edge(
 
 //
 
-void
-EdgeTable::AddEdge(const fPoint& p0, const fPoint& p1)
-{
-	edges.emplace_back(p0, p1, m_glyphDesc.bb, m_upem);
-}
-
-void
-EdgeTable::AddBezier(const fPoint& p0, const fPoint& ctrl, const fPoint& p1)
+static void
+FlattenBezier(const fPoint& p0, const fPoint& ctrl, const fPoint& p1, const float pTolerance, std::vector<LineSegment>& pSegments)
 {
-	const float kTolerance = 1.0f; // @todo: what value makes sense for this?
-
 	std::stack<Bezier> stack;
 
 	stack.emplace(p0, ctrl, p1);
@@ -80,17 +75,18 @@ EdgeTable::AddBezier(const fPoint& p0, const fPoint& ctrl, const fPoint& p1)
 
 		const float k = (y2 - y1) * x0 - (x2 - x1) * y0 + x2 * y1 - y2 * x1;
 		const float m = std::powf(y2 - y1, 2) + std::powf(x2 - x1, 2);
-		assert(m != 0.0f);
 
-		const float dist = std::fabsf(k) / std::sqrtf(m);
+		// A curve whose ends meet has no chord, so fall back to the
+		// distance between the control point and the end point.
+		const float dist = (m != 0.0f) ? std::fabsf(k) / std::sqrtf(m)
+			: std::sqrtf(std::powf(x0 - x1, 2) + std::powf(y0 - y1, 2));
 
 		// 
-		if (dist <= kTolerance) {
-			AddEdge(curr.p0, curr.p1);
+		if (dist <= pTolerance) {
+			pSegments.emplace_back(curr.p0, curr.p1);
 			continue;
 		}
 
-		// @todo: The divide gets rounded here, do not in font units!
 		auto m0x = 0.5f * (curr.p0.x + curr.ctrl.x);
 		auto m0y = 0.5f * (curr.p0.y + curr.ctrl.y);
 		fPoint m0(m0x, m0y);
@@ -109,153 +105,379 @@ EdgeTable::AddBezier(const fPoint& p0, const fPoint& ctrl, const fPoint& p1)
 }
 
 float
-DesignToRaster(const float value, const float upem)
+GetPixelsPerEm(const float pPointSize)
 {
-	const float pts = 12.0f;
 	const float dpi = 96.0f;
+	const float pointsPerInch = 72.0f;
 
-	return (value / upem) * pts * dpi;
+	return pPointSize * dpi / pointsPerInch;
 }
 
-void
-EdgeTable::Generate(GlyphMesh& pMesh)
+float
+DesignToRaster(const float value, const float upem, const float ppem)
 {
-	for (auto& c : pMesh.contours) {
-		auto& flags = c.flags;
-		auto& xs = c.xs;
-		auto& ys = c.ys;
-
-		assert(OnCurve(flags[0])); // Assume the 1st contour point is on-curve.
-
-		// Create any inferred points.
-		for (size_t i = 0; i < flags.size() - 1; ++i) {
-			if (!OnCurve(flags[i]) && !OnCurve(flags[i + 1])) {
-				const float x = (xs.at(i) + xs.at(i + 1)) / 2.0f;
-				const float y = (ys.at(i) + ys.at(i + 1)) / 2.0f;
-
-				flags.insert(flags.begin() + i + 1, 0xff);
-				xs.insert(xs.begin() + i + 1, x);
-				ys.insert(ys.begin() + i + 1, y);
-			}
+	return (value / upem) * ppem;
+}
+
+// Flattens one contour, given as working copies of its flags and points,
+// into pSegments. Inferred on-curve points are inserted into the copies.
+static void
+FlattenContour(std::vector<uint8_t>& flags, std::vector<float>& xs, std::vector<float>& ys, const float pTolerance, std::vector<LineSegment>& pSegments)
+{
+	assert(OnCurve(flags[0])); // Assume the 1st contour point is on-curve.
+
+	// Create any inferred points.
+	for (size_t i = 0; i < flags.size() - 1; ++i) {
+		if (!OnCurve(flags[i]) && !OnCurve(flags[i + 1])) {
+			const float x = (xs.at(i) + xs.at(i + 1)) / 2.0f;
+			const float y = (ys.at(i) + ys.at(i + 1)) / 2.0f;
+
+			flags.insert(flags.begin() + i + 1, 0xff);
+			xs.insert(xs.begin() + i + 1, x);
+			ys.insert(ys.begin() + i + 1, y);
 		}
+	}
 
-		const auto& pointCount = flags.size();
-		std::vector<size_t> buff;
+	const auto& pointCount = flags.size();
+	std::vector<size_t> buff;
 
-		//
-		for (size_t k = 0; k <= pointCount; ++k) {
-			const auto idx = k % pointCount; // point index into the data buffers.
-			buff.push_back(idx);
+	//
+	for (size_t k = 0; k <= pointCount; ++k) {
+		const auto idx = k % pointCount; // point index into the data buffers.
+		buff.push_back(idx);
 
-			switch (buff.size()) {
-				case 2:
-				{
-					const auto& slt0 = buff[0];
-					const auto& slt1 = buff[1];
+		switch (buff.size()) {
+			case 2:
+			{
+				const auto& slt0 = buff[0];
+				const auto& slt1 = buff[1];
 
-					if (OnCurve(flags[slt0]) && OnCurve(flags[slt1])) {
-						const fPoint p0(xs.at(slt0), ys.at(slt0));
-						const fPoint p1(xs.at(slt1), ys.at(slt1));
+				if (OnCurve(flags[slt0]) && OnCurve(flags[slt1])) {
+					const fPoint p0(xs.at(slt0), ys.at(slt0));
+					const fPoint p1(xs.at(slt1), ys.at(slt1));
 
-						if (p0.y != p1.y) { // filter out horizontal edges
-							AddEdge(p0, p1);
-						}
+					pSegments.emplace_back(p0, p1);
 
-						buff[0] = buff[1];
-						buff.pop_back();
-					}
+					buff[0] = buff[1];
+					buff.pop_back();
 				}
-				break;
+			}
+			break;
 
-				case 3:
-				{
-					const auto& slt0 = buff[0];
-					const auto& slt1 = buff[1];
-					const auto& slt2 = buff[2];
+			case 3:
+			{
+				const auto& slt0 = buff[0];
+				const auto& slt1 = buff[1];
+				const auto& slt2 = buff[2];
 
-					if (OnCurve(flags[slt0]) && !OnCurve(flags[slt1]) && OnCurve(flags[slt2])) {
-						const fPoint p0(xs.at(slt0), ys.at(slt0));
-						const fPoint p1(xs.at(slt1), ys.at(slt1));
-						const fPoint p2(xs.at(slt2), ys.at(slt2));
+				if (OnCurve(flags[slt0]) && !OnCurve(flags[slt1]) && OnCurve(flags[slt2])) {
+					const fPoint p0(xs.at(slt0), ys.at(slt0));
+					const fPoint p1(xs.at(slt1), ys.at(slt1));
+					const fPoint p2(xs.at(slt2), ys.at(slt2));
 
-						AddBezier(p0, p1, p2);
+					FlattenBezier(p0, p1, p2, pTolerance, pSegments);
 
-						buff[0] = buff[2];
-						buff.pop_back();
-						buff.pop_back();
-					}
+					buff[0] = buff[2];
+					buff.pop_back();
+					buff.pop_back();
 				}
-				break;
 			}
+			break;
+		}
+	}
+}
+
+FlattenedOutline
+FlattenOutline(const GlyphDescription& pGlyphDesc, const float pUpem, const float pTolerance)
+{
+	const auto& bb = pGlyphDesc.bb;
+	FlattenedOutline outline(BoundingBox(bb.xMin / pUpem, bb.yMin / pUpem, bb.xMax / pUpem, bb.yMax / pUpem), pTolerance);
+
+	std::vector<uint8_t> flags;
+	std::vector<float> xs, ys;
+
+	for (const auto& c : pGlyphDesc.mesh.contours) {
+		// Work on a copy of the contour in ems, as inferred points are
+		// inserted below and they shouldn't be rounded to font units.
+		flags.assign(c.flags.begin(), c.flags.end());
+		xs.resize(c.xs.size());
+		ys.resize(c.ys.size());
+		for (size_t i = 0; i < xs.size(); ++i) {
+			xs[i] = c.xs[i] / pUpem;
+			ys[i] = c.ys[i] / pUpem;
+		}
+
+		FlattenContour(flags, xs, ys, pTolerance, outline.segments);
+	}
+
+	return outline;
+}
+
+FlattenedOutline
+FlattenOutline(std::span<const Point> pPoints, std::span<const uint8_t> pFlags, std::span<const u16> pContourEnds, const float pTolerance)
+{
+	BoundingBox bb(0, 0, 0, 0);
+	if (!pPoints.empty()) {
+		bb = BoundingBox(pPoints[0].x, pPoints[0].y, pPoints[0].x, pPoints[0].y);
+		for (const auto& p : pPoints) {
+			bb.xMin = std::min(bb.xMin, p.x);
+			bb.yMin = std::min(bb.yMin, p.y);
+			bb.xMax = std::max(bb.xMax, p.x);
+			bb.yMax = std::max(bb.yMax, p.y);
+		}
+	}
+
+	FlattenedOutline outline(bb, pTolerance);
+
+	std::vector<uint8_t> flags;
+	std::vector<float> xs, ys;
+
+	size_t start = 0;
+	for (const u16 end : pContourEnds) {
+		flags.assign(pFlags.begin() + start, pFlags.begin() + end + 1);
+		xs.clear();
+		ys.clear();
+		for (size_t i = start; i <= end; ++i) {
+			xs.push_back(pPoints[i].x);
+			ys.push_back(pPoints[i].y);
+		}
+
+		FlattenContour(flags, xs, ys, pTolerance, outline.segments);
+		start = end + 1;
+	}
+
+	return outline;
+}
+
+FlattenedOutline
+FlattenOutline(const OutlineView& pOutline, const BoundingBox& pBB, const float pUpem, const float pTolerance)
+{
+	FlattenedOutline outline(BoundingBox(pBB.xMin / pUpem, pBB.yMin / pUpem, pBB.xMax / pUpem, pBB.yMax / pUpem), pTolerance);
+
+	std::vector<uint8_t> flags;
+	std::vector<float> xs, ys;
+
+	size_t start = 0;
+	for (const u16 end : pOutline.contourEnds) {
+		flags.assign(pOutline.flags.begin() + start, pOutline.flags.begin() + end + 1);
+		xs.clear();
+		ys.clear();
+		for (size_t i = start; i <= end; ++i) {
+			xs.push_back(pOutline.points[i].x / pUpem);
+			ys.push_back(pOutline.points[i].y / pUpem);
 		}
+
+		FlattenContour(flags, xs, ys, pTolerance, outline.segments);
+		start = end + 1;
 	}
+
+	return outline;
 }
 
 //
 
-const RasterTarget*
-RenderOutline(const GlyphDescription& pGlyphDesc, const float upem)
+EdgeTable::EdgeTable(const GlyphDescription& pGlyphDesc, const float pUpem, const float pPixelsPerEm)
+	: EdgeTable(FlattenOutline(pGlyphDesc, pUpem, kFlattenTolerancePx / pPixelsPerEm), pPixelsPerEm)
 {
-	EdgeTable et(pGlyphDesc, upem);
+}
 
-	// Allocate bitmap memory.
-	const auto xExtent = DesignToRaster(pGlyphDesc.bb.xMax - pGlyphDesc.bb.xMin, upem);
-	const auto yExtent = DesignToRaster(pGlyphDesc.bb.yMax - pGlyphDesc.bb.yMin, upem);
-	const size_t img_width = std::ceil(xExtent);
-	const size_t img_height = std::ceil(yExtent);
+EdgeTable::EdgeTable(const FlattenedOutline& pOutline, const float pPixelsPerEm)
+	: m_ppem(pPixelsPerEm)
+{
+	// Translate the outline into the 1st quadrant.
+	Generate(pOutline, fPoint(pOutline.bb.xMin, pOutline.bb.yMin));
+	GetRasterExtents(pOutline.bb, m_ppem, width, height);
+}
 
-	RasterTarget* target = new RasterTarget(img_width, img_height);
+EdgeTable::EdgeTable(const size_t pWidth, const size_t pHeight, const float pPixelsPerEm)
+	: width(pWidth), height(pHeight), m_ppem(pPixelsPerEm)
+{
+}
 
-	// Rasterise outline.
+void
+EdgeTable::Append(const FlattenedOutline& pOutline, const float pX, const float pY)
+{
+	// Map the outline's origin onto (pX, pY) in bitmap space.
+	Generate(pOutline, fPoint(-pX / m_ppem, -pY / m_ppem));
+}
+
+void
+EdgeTable::AppendAt(const FlattenedOutline& pOutline, const long pLeft, const long pBottom)
+{
+	Generate(pOutline, fPoint(pOutline.bb.xMin, pOutline.bb.yMin), pLeft, pBottom);
+}
+
+void
+EdgeTable::Generate(const FlattenedOutline& pOutline, const fPoint& pOrigin, const long pOffsetX, const long pOffsetY)
+{
+	// This is the only pass over the outline that depends on the pixel
+	// size: each segment is translated and scaled into bitmap space.
+	edges.reserve(edges.size() + pOutline.segments.size());
+
+	for (const auto& s : pOutline.segments) {
+		if (s.p0.y != s.p1.y) { // filter out horizontal edges
+			edges.emplace_back(s.p0, s.p1, pOrigin, m_ppem, pOffsetX, pOffsetY);
+		}
+	}
+}
+
+//
+
+static void
+ScanConvert(const EdgeTable& pEdgeTable, const float pOffsetX, const size_t pWidth, const size_t pHeight, const RowSink& pSink)
+{
+	// Only a single row of coverage is ever live, so peak memory is
+	// proportional to the bitmap width rather than its area.
+	std::vector<uint8_t> row(pWidth);
+
+	// Crossings stay in their edge's own coordinates, with its whole-pixel
+	// offset alongside, so they round just as they would if the outline
+	// were rendered on its own.
+	struct Crossing {
+		float x;
+		long offsetX;
+		double GetX() const { return (double)offsetX + x; }
+	};
+	std::vector<Crossing> crossings;
+
+	const auto& edges = pEdgeTable.edges;
+
+	// Visit edges in order of their lowest point, so each scanline only
+	// looks at the edges spanning it rather than the whole table. This
+	// matters most for tables holding a whole line of glyphs.
+	std::vector<u32> order(edges.size());
+	for (u32 k = 0; k < order.size(); ++k) {
+		order[k] = k;
+	}
+	std::sort(order.begin(), order.end(), [&edges](const u32 a, const u32 b) {
+		return (double)edges[a].base.y + edges[a].offsetY < (double)edges[b].base.y + edges[b].offsetY;
+	});
+
+	std::vector<u32> active;
+	size_t nextEdge = 0;
+
+	// Crossings are evaluated directly from each edge's line equation
+	// rather than stepped incrementally, so the edge table is never
+	// written to and can be shared between renders at different offsets.
 	const float kScanlineDelta = 1.0f;
-	for (float scanline = 0.5f; scanline < target->height; scanline += kScanlineDelta) {
-		std::vector<float> crossings; // @perf: set capacity to avoid allocs?
-
-		for (auto& e : et.edges) {
-			if (e.is_active) {
-				if (e.apex.y <= scanline) {
-					// edge shouldn't be active anymore.
-					e.is_active = false;
-				}
-				else {
-					// edge is still active so update its intersection point.
-					if (!e.is_vertical) { // intersection only changes for non-vertical edges.
-						e.sclx += kScanlineDelta / e.m;
-					}
-					crossings.push_back(e.sclx);
-				}
-			}
-			else {
-				// Note: the scanline can never be on ymax in this
-				// codepath as the edge would be activated from it
-				// passing ymin.
-				if (scanline >= e.base.y && scanline < e.apex.y) {
-					// create new active edge.
-					e.is_active = true;
-					e.sclx = e.is_vertical ? e.base.x : (scanline - e.c) / e.m;
-					crossings.push_back(e.sclx);
-				}
-			}
+	for (float scanline = 0.5f; scanline < pHeight; scanline += kScanlineDelta) {
+		crossings.clear();
+
+		// Note: edges are half-open in y, so a scanline passing
+		// exactly through a vertex shared by two edges is only
+		// counted once.
+		// Scanlines sit on half pixels and offsets are whole, so the
+		// scanline in an edge's own coordinates is exact.
+		while (nextEdge < order.size() && edges[order[nextEdge]].base.y <= scanline - edges[order[nextEdge]].offsetY) {
+			active.push_back(order[nextEdge++]);
+		}
+
+		std::erase_if(active, [&edges, scanline](const u32 idx) { return edges[idx].apex.y <= scanline - edges[idx].offsetY; });
+
+		for (const u32 idx : active) {
+			const Edge& e = edges[idx];
+			const float x = e.is_vertical ? e.base.x : ((scanline - e.offsetY) - e.c) / e.m;
+			crossings.push_back({ x + pOffsetX, e.offsetX });
 		}
 
 		assert(crossings.size() % 2 == 0);
 
-		std::sort(crossings.begin(), crossings.end());
+		std::sort(crossings.begin(), crossings.end(), [](const Crossing& a, const Crossing& b) { return a.GetX() < b.GetX(); });
+
+		std::fill(row.begin(), row.end(), 0);
 
 		for (size_t k = 0; k < crossings.size(); k += 2) {
-			const float xs = crossings[k];
-			const float xe = crossings[k + 1];
+			const Crossing& xs = crossings[k];
+			const Crossing& xe = crossings[k + 1];
 
-			for (int x = xs; x <= xe; x++) {
-				target->store(x, (int)scanline, 0xff);
-			}
+			// Clamp the span to the row, as crossings can land a hair
+			// outside the bitmap due to rounding.
+			const int xFirst = std::max((int)(xs.offsetX + (int)xs.x), 0);
+			const int xLast = std::min((int)(xe.offsetX + (int)std::floor(xe.x)), (int)pWidth - 1);
 
+			for (int x = xFirst; x <= xLast; x++) {
+				row[x] = 0xff;
+			}
 		}
+
+		pSink((size_t)scanline, row.data(), pWidth);
 	}
+}
+
+void
+GetRasterExtents(const BoundingBox& pBB, const float ppem, size_t& pWidth, size_t& pHeight)
+{
+	pWidth = std::ceil((pBB.xMax - pBB.xMin) * ppem);
+	pHeight = std::ceil((pBB.yMax - pBB.yMin) * ppem);
+}
+
+const RasterTarget*
+RenderOutline(const GlyphDescription& pGlyphDesc, const float upem, const float ppem)
+{
+	const EdgeTable et(pGlyphDesc, upem, ppem);
+	return RenderOutline(et, 0.0f);
+}
+
+void
+RenderOutline(const GlyphDescription& pGlyphDesc, const float upem, const float ppem, const RowSink& pSink)
+{
+	const EdgeTable et(pGlyphDesc, upem, ppem);
+	RenderOutline(et, 0.0f, pSink);
+}
+
+static size_t
+GetSubpixelWidth(const EdgeTable& pEdgeTable, const float pSubpixelX)
+{
+	// A fractional offset can push the right-most column one pixel over.
+	return pEdgeTable.width + (pSubpixelX > 0.0f ? 1 : 0);
+}
+
+const RasterTarget*
+RenderOutline(const EdgeTable& pEdgeTable, const float pSubpixelX)
+{
+	assert(pSubpixelX >= 0.0f && pSubpixelX < 1.0f);
+
+	// Allocate bitmap memory.
+	const size_t img_width = GetSubpixelWidth(pEdgeTable, pSubpixelX);
+	const size_t img_height = pEdgeTable.height;
+
+	RasterTarget* target = new RasterTarget(img_width, img_height);
+
+	// Rasterise outline.
+	ScanConvert(pEdgeTable, pSubpixelX, img_width, img_height,
+		[target](const size_t y, const uint8_t* row, const size_t width) {
+			std::memcpy((uint8_t*)target->memory_ + y * target->width, row, width);
+		});
 
 	return target;
 }
 
+void
+RenderOutline(const EdgeTable& pEdgeTable, const float pSubpixelX, const RowSink& pSink)
+{
+	assert(pSubpixelX >= 0.0f && pSubpixelX < 1.0f);
+
+	const size_t width = GetSubpixelWidth(pEdgeTable, pSubpixelX);
+	ScanConvert(pEdgeTable, pSubpixelX, width, pEdgeTable.height, pSink);
+}
+
+void
+SplitPenPosition(const float pX, const u32 pSteps, int& pPixel, float& pPhase)
+{
+	const float pixel = std::floor(pX);
+	const float phase = std::round((pX - pixel) * pSteps);
+
+	// Rounding the phase up to a whole step carries into the next pixel.
+	if (phase >= pSteps) {
+		pPixel = (int)pixel + 1;
+		pPhase = 0.0f;
+	}
+	else {
+		pPixel = (int)pixel;
+		pPhase = phase / pSteps;
+	}
+}
+
 //
 
 RasterTarget::RasterTarget(const size_t width, const size_t height)
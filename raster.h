@@ -1,22 +1,33 @@
 #pragma once
 
 #include <vector>
+#include <functional>
+#include <span>
 #include "outline.h"
 
 #define OnCurve(x) (x & 1)
 
 //
 
+// Maximum distance, in pixels, that a flattened curve may stray from the
+// true curve.
+constexpr float kFlattenTolerancePx = 0.25f;
+
 struct Edge {
-    Edge(const fPoint& p0, const fPoint& p1, const BoundingBox& pBB, const float upem);
+    // pOrigin is the point, in ems, that maps onto the bitmap's (0, 0),
+    // before the edge is shifted by (pOffsetX, pOffsetY) whole pixels.
+    Edge(const fPoint& p0, const fPoint& p1, const fPoint& pOrigin, const float pPixelsPerEm, const long pOffsetX = 0, const long pOffsetY = 0);
 
     //
 
     fPoint apex, base;
-    bool is_active;
     bool is_vertical;
     float m, c;
-    float sclx;
+
+    // Kept apart from the points, and only applied to whole pixel
+    // positions, so an outline scan-converts exactly the same wherever it
+    // is placed.
+    long offsetX, offsetY;
 };
 
 struct Bezier {
@@ -31,24 +42,30 @@ struct Bezier {
 class EdgeTable {
     /* === Methods === */
 public:
-    EdgeTable(const GlyphDescription& pGlyphDesc, const float pRasterUpem)
-        : m_glyphDesc(pGlyphDesc), m_upem(pRasterUpem)
-    {
-        Generate(m_glyphDesc.mesh);
-    }
+    EdgeTable(const GlyphDescription& pGlyphDesc, const float pUpem, const float pPixelsPerEm);
+    EdgeTable(const FlattenedOutline& pOutline, const float pPixelsPerEm);
+
+    // An empty table of fixed extents, for merging several outlines into
+    // one scan conversion with Append.
+    EdgeTable(const size_t pWidth, const size_t pHeight, const float pPixelsPerEm);
+
+    void Append(const FlattenedOutline& pOutline, const float pX, const float pY);
+
+    // As Append, but with the outline's bounding box corner on the whole
+    // pixel (pLeft, pBottom), and its edges exactly where a table of its
+    // own would put them, so it renders the same as it would alone.
+    void AppendAt(const FlattenedOutline& pOutline, const long pLeft, const long pBottom);
 
 private:
-    void Generate(GlyphMesh& pMesh);
-    void AddEdge(const fPoint& p0, const fPoint& p1);
-    void AddBezier(const fPoint& p0, const fPoint& ctrl, const fPoint& p1);
+    void Generate(const FlattenedOutline& pOutline, const fPoint& pOrigin, const long pOffsetX = 0, const long pOffsetY = 0);
 
     /* === Variables === */
 public:
     std::vector<Edge> edges;
+    size_t width, height; // bitmap extents at a zero subpixel offset.
 
 private:
-    GlyphDescription m_glyphDesc;
-    float m_upem;
+    float m_ppem;
 };
 
 struct RasterTarget {
@@ -64,5 +81,33 @@ struct RasterTarget {
     void* memory_;
 };
 
-const RasterTarget* RenderOutline(const GlyphDescription& pGlyphDesc, const float pUpem);
-float DesignToRaster(const float value, const float upem);
\ No newline at end of file
+// Receives each completed scanline, bottom row first. The row buffer is
+// reused between calls, so a sink must copy out anything it wants to keep.
+using RowSink = std::function<void(const size_t pY, const uint8_t* pRow, const size_t pWidth)>;
+
+FlattenedOutline FlattenOutline(const GlyphDescription& pGlyphDesc, const float pUpem, const float pTolerance);
+
+// As above, for points already in ems that needn't lie on the design grid
+// (e.g. hinted outlines). pContourEnds holds each contour's last point.
+FlattenedOutline FlattenOutline(std::span<const Point> pPoints, std::span<const uint8_t> pFlags, std::span<const u16> pContourEnds, const float pTolerance);
+
+// As the first, for an outline decoded ahead of time, within the bounds
+// measured for it.
+FlattenedOutline FlattenOutline(const OutlineView& pOutline, const BoundingBox& pBB, const float pUpem, const float pTolerance);
+
+const RasterTarget* RenderOutline(const GlyphDescription& pGlyphDesc, const float pUpem, const float pPixelsPerEm);
+void RenderOutline(const GlyphDescription& pGlyphDesc, const float pUpem, const float pPixelsPerEm, const RowSink& pSink);
+
+// Scan-converts an already flattened outline shifted right by pSubpixelX,
+// which must lie in [0, 1). The same EdgeTable can be rendered at any
+// number of offsets without being regenerated.
+const RasterTarget* RenderOutline(const EdgeTable& pEdgeTable, const float pSubpixelX);
+void RenderOutline(const EdgeTable& pEdgeTable, const float pSubpixelX, const RowSink& pSink);
+
+// Splits a fractional pen position into a whole pixel and a subpixel
+// phase quantized to one of pSteps positions.
+void SplitPenPosition(const float pX, const u32 pSteps, int& pPixel, float& pPhase);
+
+void GetRasterExtents(const BoundingBox& pBB, const float pPixelsPerEm, size_t& pWidth, size_t& pHeight);
+float GetPixelsPerEm(const float pPointSize);
+float DesignToRaster(const float value, const float upem, const float ppem);
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+
+#include "sdf.h"
+
+//
+
+// Buckets segments into a uniform grid. Every segment is filed under each
+// cell its bounds overlap once grown by the spread, so a pixel only has to
+// consider its own cell: anything further away is beyond the clamp anyway.
+struct SegmentGrid {
+	SegmentGrid(const std::vector<LineSegment>& pSegments, const size_t pWidth, const size_t pHeight, const float pSpread)
+		: cellSize(std::max(2.0f * pSpread, 8.0f))
+	{
+		columns = (size_t)std::ceil(pWidth / cellSize) + 1;
+		rows = (size_t)std::ceil(pHeight / cellSize) + 1;
+
+		// Counting pass, then a fill pass, so each cell's segment list is a
+		// contiguous range of a single index array.
+		cellStarts.assign(columns * rows + 1, 0);
+		ForEachCell(pSegments, pSpread, [this](const size_t cell, const u32) { ++cellStarts[cell + 1]; });
+
+		for (size_t k = 1; k < cellStarts.size(); ++k) {
+			cellStarts[k] += cellStarts[k - 1];
+		}
+
+		indices.resize(cellStarts.back());
+		std::vector<u32> cursor(cellStarts.begin(), cellStarts.end() - 1);
+		ForEachCell(pSegments, pSpread, [this, &cursor](const size_t cell, const u32 idx) { indices[cursor[cell]++] = idx; });
+	}
+
+	template <typename F>
+	void ForEachCell(const std::vector<LineSegment>& pSegments, const float pSpread, F pFunc) const
+	{
+		for (u32 k = 0; k < pSegments.size(); ++k) {
+			const auto& s = pSegments[k];
+
+			const auto cellOf = [this](const float v, const size_t limit) {
+				return (size_t)std::clamp(v / cellSize, 0.0f, (float)(limit - 1));
+			};
+
+			const size_t x0 = cellOf(std::min(s.p0.x, s.p1.x) - pSpread, columns);
+			const size_t x1 = cellOf(std::max(s.p0.x, s.p1.x) + pSpread, columns);
+			const size_t y0 = cellOf(std::min(s.p0.y, s.p1.y) - pSpread, rows);
+			const size_t y1 = cellOf(std::max(s.p0.y, s.p1.y) + pSpread, rows);
+
+			for (size_t y = y0; y <= y1; ++y) {
+				for (size_t x = x0; x <= x1; ++x) {
+					pFunc(y * columns + x, k);
+				}
+			}
+		}
+	}
+
+	//
+
+	float cellSize;
+	size_t columns, rows;
+	std::vector<u32> cellStarts;
+	std::vector<u32> indices;
+};
+
+static float
+DistanceToSegment(const float pX, const float pY, const LineSegment& pSegment)
+{
+	const float dx = pSegment.p1.x - pSegment.p0.x;
+	const float dy = pSegment.p1.y - pSegment.p0.y;
+	const float lengthSq = dx * dx + dy * dy;
+
+	// Project the point onto the segment, clamping to its end points.
+	float t = 0.0f;
+	if (lengthSq > 0.0f) {
+		t = std::clamp(((pX - pSegment.p0.x) * dx + (pY - pSegment.p0.y) * dy) / lengthSq, 0.0f, 1.0f);
+	}
+
+	const float ex = pSegment.p0.x + t * dx - pX;
+	const float ey = pSegment.p0.y + t * dy - pY;
+
+	return std::sqrt(ex * ex + ey * ey);
+}
+
+const RasterTarget*
+RenderSDF(const FlattenedOutline& pOutline, const float pPixelsPerEm, const float pSpread)
+{
+	assert(pSpread > 0.0f);
+
+	const size_t padding = (size_t)std::ceil(pSpread);
+
+	size_t glyphWidth, glyphHeight;
+	GetRasterExtents(pOutline.bb, pPixelsPerEm, glyphWidth, glyphHeight);
+
+	RasterTarget* target = new RasterTarget(glyphWidth + 2 * padding, glyphHeight + 2 * padding);
+
+	// Move the segments into bitmap space, including the padding.
+	std::vector<LineSegment> segments;
+	segments.reserve(pOutline.segments.size());
+	for (const auto& s : pOutline.segments) {
+		const auto toBitmap = [&](const Point& p) {
+			return Point((p.x - pOutline.bb.xMin) * pPixelsPerEm + padding, (p.y - pOutline.bb.yMin) * pPixelsPerEm + padding);
+		};
+		segments.emplace_back(toBitmap(s.p0), toBitmap(s.p1));
+	}
+
+	const SegmentGrid grid(segments, target->width, target->height, pSpread);
+
+	std::vector<float> crossings;
+	for (size_t y = 0; y < target->height; ++y) {
+		const float py = y + 0.5f;
+
+		// Inside-ness uses the same even-odd rule as the rasterizer,
+		// from the row's crossings rather than per-pixel ray casts.
+		crossings.clear();
+		for (const auto& s : segments) {
+			const float yLo = std::min(s.p0.y, s.p1.y);
+			const float yHi = std::max(s.p0.y, s.p1.y);
+
+			if (py >= yLo && py < yHi) {
+				const float t = (py - s.p0.y) / (s.p1.y - s.p0.y);
+				crossings.push_back(s.p0.x + t * (s.p1.x - s.p0.x));
+			}
+		}
+		std::sort(crossings.begin(), crossings.end());
+
+		size_t crossed = 0;
+		for (size_t x = 0; x < target->width; ++x) {
+			const float px = x + 0.5f;
+
+			while (crossed < crossings.size() && crossings[crossed] <= px) {
+				++crossed;
+			}
+			const bool inside = crossed % 2;
+
+			const size_t cellX = std::min((size_t)(px / grid.cellSize), grid.columns - 1);
+			const size_t cellY = std::min((size_t)(py / grid.cellSize), grid.rows - 1);
+			const size_t cell = cellY * grid.columns + cellX;
+
+			float dist = pSpread;
+			for (u32 k = grid.cellStarts[cell]; k < grid.cellStarts[cell + 1]; ++k) {
+				dist = std::min(dist, DistanceToSegment(px, py, segments[grid.indices[k]]));
+			}
+
+			const float signedDist = (inside ? dist : -dist) / pSpread;
+			target->store(x, y, (uint8_t)std::lround(128.0f + signedDist * 127.0f));
+		}
+	}
+
+	return target;
+}
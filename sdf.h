@@ -0,0 +1,13 @@
+#pragma once
+
+#include "outline.h"
+#include "raster.h"
+
+//
+
+// Renders a single-channel signed distance field of a flattened outline.
+// Each pixel stores the distance to the nearest edge, clamped to pSpread
+// pixels and mapped to [0, 255] with 128 on the outline itself and larger
+// values inside. The bitmap is padded by the spread on every side so the
+// falloff outside the glyph isn't cut off.
+const RasterTarget* RenderSDF(const FlattenedOutline& pOutline, const float pPixelsPerEm, const float pSpread);
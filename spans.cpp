@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <assert.h>
+#include <cstring>
+
+#include "spans.h"
+
+//
+
+SpanBitmap::SpanBitmap(const size_t pWidth, const size_t pHeight)
+	: width(pWidth), height(pHeight), left(0), bottom(0)
+{
+	assert(pWidth <= kMaxSpanBitmapWidth); // span fields are 16-bit.
+
+	rows.reserve(pHeight + 1);
+	rows.push_back(0);
+}
+
+SpanBitmap::SpanBitmap(const size_t pWidth, const size_t pHeight, std::span<const u32> pRows, std::span<const Span> pSpans)
+	: width(pWidth), height(pHeight), left(0), bottom(0), m_external(true), m_rowView(pRows), m_spanView(pSpans)
+{
+	assert(pRows.size() == pHeight + 1);
+}
+
+void
+SpanBitmap::AppendRow(const size_t pY, const uint8_t* pRow, const size_t pWidth)
+{
+	assert(!m_external);
+	assert(pY == rows.size() - 1); // rows must arrive in order.
+	assert(pWidth == width);
+
+	size_t x = 0;
+	while (x < pWidth) {
+		const uint8_t coverage = pRow[x];
+
+		size_t runEnd = x + 1;
+		while (runEnd < pWidth && pRow[runEnd] == coverage) {
+			++runEnd;
+		}
+
+		if (coverage) {
+			spans.emplace_back((u16)x, (u16)(runEnd - x), coverage);
+		}
+
+		x = runEnd;
+	}
+
+	rows.push_back((u32)spans.size());
+}
+
+void
+SpanBitmap::Blit(RasterTarget& pTarget, const long pX, const long pY) const
+{
+	const std::span<const u32> rows = GetRows();
+	const std::span<const Span> spans = GetSpans();
+	const long rowCount = (long)rows.size() - 1;
+	const long targetWidth = (long)pTarget.width;
+
+	// Rows below the target are skipped rather than drawn.
+	for (long y = std::max(0L, -pY); y < rowCount && pY + y < (long)pTarget.height; ++y) {
+		uint8_t* dst = (uint8_t*)pTarget.memory_ + (pY + y) * pTarget.width;
+
+		for (u32 k = rows[y]; k < rows[y + 1]; ++k) {
+			const Span& s = spans[k];
+
+			long xStart = pX + s.x;
+			long xEnd = xStart + s.length;
+			if (xStart >= targetWidth) {
+				break; // spans are sorted, so the rest of the row is clipped too.
+			}
+			if (xEnd <= 0) {
+				continue;
+			}
+
+			// Trim whatever hangs off either side.
+			xStart = std::max(xStart, 0L);
+			xEnd = std::min(xEnd, targetWidth);
+			const size_t length = xEnd - xStart;
+
+			if (s.coverage == 0xff) { // solid runs are the common case.
+				std::memset(dst + xStart, 0xff, length);
+				continue;
+			}
+
+			for (size_t x = xStart; x < xStart + length; ++x) {
+				dst[x] = s.coverage + (dst[x] * (0xff - s.coverage)) / 0xff;
+			}
+		}
+	}
+}
+
+size_t
+SpanBitmap::GetMemoryUsage() const
+{
+	// External spans aren't on the heap, so only the bitmap itself counts.
+	return sizeof(*this) + rows.capacity() * sizeof(u32) + spans.capacity() * sizeof(Span);
+}
+
+//
+
+const SpanBitmap*
+RenderOutlineSpans(const GlyphDescription& pGlyphDesc, const float pUpem, const float pPixelsPerEm)
+{
+	return RenderOutlineSpans(FlattenOutline(pGlyphDesc, pUpem, kFlattenTolerancePx / pPixelsPerEm), pPixelsPerEm);
+}
+
+const SpanBitmap*
+RenderOutlineSpans(const FlattenedOutline& pOutline, const float pPixelsPerEm)
+{
+	const EdgeTable et(pOutline, pPixelsPerEm);
+
+	// Wider spans would have their fields truncated.
+	if (et.width > kMaxSpanBitmapWidth) {
+		return nullptr;
+	}
+
+	SpanBitmap* bitmap = new SpanBitmap(et.width, et.height);
+	bitmap->left = pOutline.bb.xMin * pPixelsPerEm;
+	bitmap->bottom = pOutline.bb.yMin * pPixelsPerEm;
+
+	RenderOutline(et, 0.0f,
+		[bitmap](const size_t y, const uint8_t* row, const size_t width) {
+			bitmap->AppendRow(y, row, width);
+		});
+
+	bitmap->spans.shrink_to_fit();
+
+	return bitmap;
+}
+
+const SpanBitmap*
+EncodeSpans(const RasterTarget& pTarget, const float pLeft, const float pBottom)
+{
+	if (pTarget.width > kMaxSpanBitmapWidth) {
+		return nullptr;
+	}
+
+	SpanBitmap* bitmap = new SpanBitmap(pTarget.width, pTarget.height);
+	bitmap->left = pLeft;
+	bitmap->bottom = pBottom;
+
+	for (size_t y = 0; y < pTarget.height; ++y) {
+		bitmap->AppendRow(y, (const uint8_t*)pTarget.memory_ + y * pTarget.width, pTarget.width);
+	}
+
+	bitmap->spans.shrink_to_fit();
+
+	return bitmap;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include "base.h"
+#include "raster.h"
+
+//
+
+// A horizontal run of pixels sharing a single coverage value.
+struct Span {
+    Span(const u16 pX, const u16 pLength, const u8 pCoverage)
+        : x(pX), length(pLength), coverage(pCoverage)
+    {
+    }
+
+    //
+
+    u16 x;
+    u16 length;
+    u8 coverage;
+};
+
+// Widest bitmap spans can describe, as their fields are 16-bit.
+constexpr size_t kMaxSpanBitmapWidth = UINT16_MAX;
+
+// Run-length encoded alternative to RasterTarget. Rows are stored bottom
+// first, as with RasterTarget, and zero-coverage runs are not stored at all.
+struct SpanBitmap {
+    SpanBitmap(const size_t pWidth, const size_t pHeight);
+
+    // A bitmap whose spans are stored elsewhere (e.g. in a mapped cache
+    // file) and not copied; the storage must outlive the bitmap, and rows
+    // can't be appended.
+    SpanBitmap(const size_t pWidth, const size_t pHeight, std::span<const u32> pRows, std::span<const Span> pSpans);
+
+    void AppendRow(const size_t pY, const uint8_t* pRow, const size_t pWidth);
+
+    std::span<const u32> GetRows() const { return m_external ? m_rowView : std::span<const u32>(rows); }
+    std::span<const Span> GetSpans() const { return m_external ? m_spanView : std::span<const Span>(spans); }
+
+    // Composites the spans over pTarget, with the bitmap's bottom-left
+    // pixel landing on (pX, pY), which may lie outside pTarget on any side.
+    // Anything outside pTarget is clipped.
+    void Blit(RasterTarget& pTarget, const long pX, const long pY) const;
+
+    size_t GetMemoryUsage() const;
+
+    //
+
+    size_t width, height;
+    float left, bottom; // offset of the bitmap's corner from the glyph origin, in pixels.
+    std::vector<u32> rows; // index of each row's first span, plus an end marker.
+    std::vector<Span> spans;
+
+private:
+    bool m_external = false;
+    std::span<const u32> m_rowView;
+    std::span<const Span> m_spanView;
+};
+
+// Both fail, returning nullptr, for bitmaps wider than kMaxSpanBitmapWidth.
+const SpanBitmap* RenderOutlineSpans(const GlyphDescription& pGlyphDesc, const float pUpem, const float pPixelsPerEm);
+const SpanBitmap* RenderOutlineSpans(const FlattenedOutline& pOutline, const float pPixelsPerEm);
+
+// Run-length encodes an existing bitmap whose corner sits at (pLeft, pBottom)
+// from the glyph origin; nullptr if it is too wide, as above.
+const SpanBitmap* EncodeSpans(const RasterTarget& pTarget, const float pLeft, const float pBottom);
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "libfnt.h"
+
+// Stress test for sharing one Font between threads: each thread renders an
+// overlapping set of glyphs, hinted and unhinted at several sizes, through
+// its own RenderContext, and every bitmap must match the one a single
+// thread renders from a separate copy of the font. Each thread also hints
+// every glyph itself, bypassing the glyph cache, so the hinters all run
+// over the font's shared HintingProgram at once. Build from the
+// repository root with the library sources, e.g.
+//     g++ -std=c++20 -O2 -I. tests/render_threads.cpp <library .cpp files> -lpthread
+// and run as
+//     render_threads <font.ttf> [threads]
+// It prints the number of mismatches and exits non-zero if there are any.
+
+struct Job {
+	GlyphID glyphID;
+	float pointSize;
+	bool hinted;
+};
+
+static const SpanBitmap*
+Render(RenderContext& pContext, const Job& pJob)
+{
+	return pJob.hinted ? pContext.RenderHintedGlyphSpans(pJob.glyphID, pJob.pointSize)
+		: pContext.RenderGlyphSpans(pJob.glyphID, pJob.pointSize);
+}
+
+// Hints without the glyph cache, so the context's own interpreter always
+// runs; null if the glyph's program fails.
+static const SpanBitmap*
+HintUncached(RenderContext& pContext, const Job& pJob)
+{
+	const float ppem = GetPixelsPerEm(pJob.pointSize);
+	FlattenedOutline outline(BoundingBox(0, 0, 0, 0), 0.0f);
+	if (!pContext.hinter->HintGlyph(pJob.glyphID, ppem, kFlattenTolerancePx / ppem, outline)) {
+		return nullptr;
+	}
+
+	return RenderOutlineSpans(outline, ppem);
+}
+
+// Spans are compared field by field, as their padding isn't initialized.
+static bool
+IsSameBitmap(const SpanBitmap& pA, const SpanBitmap& pB)
+{
+	if (pA.width != pB.width || pA.height != pB.height || pA.left != pB.left || pA.bottom != pB.bottom) {
+		return false;
+	}
+
+	const std::span<const u32> rowsA = pA.GetRows(), rowsB = pB.GetRows();
+	const std::span<const Span> spansA = pA.GetSpans(), spansB = pB.GetSpans();
+	if (!std::equal(rowsA.begin(), rowsA.end(), rowsB.begin(), rowsB.end()) || spansA.size() != spansB.size()) {
+		return false;
+	}
+
+	for (size_t k = 0; k < spansA.size(); ++k) {
+		if (spansA[k].x != spansB[k].x || spansA[k].length != spansB[k].length || spansA[k].coverage != spansB[k].coverage) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int
+main(int argc, char** argv)
+{
+	if (argc < 2) {
+		std::fprintf(stderr, "usage: %s <font.ttf> [threads]\n", argv[0]);
+		return 2;
+	}
+
+	const size_t threadCount = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 16;
+
+	// Printable ASCII at a spread of sizes, in both modes.
+	std::vector<Job> jobs;
+	{
+		library lib(argv[1]);
+		for (const float pointSize : { 7.0f, 9.0f, 10.5f, 12.0f, 16.0f, 24.0f }) {
+			for (CharCode c = 0x21; c < 0x7f; ++c) {
+				const GlyphID glyphID = lib.GetGlyphID(c);
+				jobs.push_back({ glyphID, pointSize, false });
+				jobs.push_back({ glyphID, pointSize, true });
+			}
+		}
+	}
+
+	// The reference comes from a font of its own, so none of its bitmaps
+	// are shared with the threads' cache.
+	auto referenceFont = std::make_shared<const Font>(argv[1]);
+	RenderContext reference(referenceFont);
+
+	auto font = std::make_shared<const Font>(argv[1]);
+	std::vector<std::vector<const SpanBitmap*>> results(threadCount), uncached(threadCount);
+	std::vector<std::thread> threads;
+
+	// Each thread starts at its own offset and covers two thirds of the
+	// jobs, so every glyph is asked for by several threads at once.
+	for (size_t t = 0; t < threadCount; ++t) {
+		threads.emplace_back([&, t]() {
+			RenderContext context(font);
+			results[t].resize(jobs.size(), nullptr);
+			uncached[t].resize(jobs.size(), nullptr);
+
+			const size_t count = jobs.size() * 2 / 3;
+			for (size_t k = 0; k < count; ++k) {
+				const size_t index = (t * jobs.size() / threadCount + k) % jobs.size();
+				results[t][index] = Render(context, jobs[index]);
+				if (jobs[index].hinted) {
+					uncached[t][index] = HintUncached(context, jobs[index]);
+				}
+			}
+		});
+	}
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	size_t checked = 0, mismatches = 0;
+	for (size_t k = 0; k < jobs.size(); ++k) {
+		const SpanBitmap* expected = Render(reference, jobs[k]);
+		const SpanBitmap* expectedUncached = jobs[k].hinted ? HintUncached(reference, jobs[k]) : nullptr;
+
+		for (size_t t = 0; t < threadCount; ++t) {
+			if (results[t][k]) {
+				++checked;
+				mismatches += !IsSameBitmap(*expected, *results[t][k]);
+			}
+
+			if (uncached[t][k]) {
+				++checked;
+				mismatches += !expectedUncached || !IsSameBitmap(*expectedUncached, *uncached[t][k]);
+				delete uncached[t][k];
+			}
+		}
+
+		delete expectedUncached;
+	}
+
+	std::printf("%zu threads, %zu bitmaps checked, %zu mismatches\n", threadCount, checked, mismatches);
+
+	return mismatches ? 1 : 0;
+}
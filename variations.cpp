@@ -0,0 +1,474 @@
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+
+#include "variations.h"
+
+//
+
+#define sharedPointNumbersMask 0x8000
+#define tupleCountMask 0x0fff
+#define embeddedPeakTupleMask 0x8000
+#define intermediateRegionMask 0x4000
+#define privatePointNumbersMask 0x2000
+#define tupleIndexMask 0x0fff
+
+#define pointsAreWordsMask 0x80
+#define pointRunCountMask 0x7f
+#define deltasAreZeroMask 0x80
+#define deltasAreWordsMask 0x40
+#define deltaRunCountMask 0x3f
+
+// Each glyph has four phantom points after its outline points (origin,
+// advance, top and bottom), which "all points" tuples also cover.
+#define phantomPointCount 4
+
+static float
+GetF2DOT14(const u8* pData)
+{
+	return Stream::GetField<s16>(pData) / (float)16384;
+}
+
+static float
+GetFixed(Stream& pData)
+{
+	return pData.GetField<s32>() / (float)65536;
+}
+
+void
+GlyphVariations::Load(Stream pFvar, Stream pGvar)
+{
+	const u8* fvarTop = (const u8*)pFvar.get();
+
+	pFvar.Skip(4); // skip version
+	const u16 axesArrayOffset = pFvar.GetField<u16>();
+	pFvar.SkipField<u16>(); // skip reserved
+	const u16 axisCount = pFvar.GetField<u16>();
+	const u16 axisSize = pFvar.GetField<u16>();
+
+	for (size_t k = 0; k < axisCount; ++k) {
+		Stream record(fvarTop + axesArrayOffset + k * axisSize);
+
+		VariationAxis axis;
+		axis.tag = record.GetField<u32>();
+		axis.minValue = GetFixed(record);
+		axis.defaultValue = GetFixed(record);
+		axis.maxValue = GetFixed(record);
+		m_axes.push_back(axis);
+	}
+
+	m_gvar = (const u8*)pGvar.get();
+
+	pGvar.Skip(4); // skip version
+	const u16 gvarAxisCount = pGvar.GetField<u16>();
+	assert(gvarAxisCount == axisCount);
+
+	m_sharedTupleCount = pGvar.GetField<u16>();
+	m_sharedTuples = m_gvar + pGvar.GetField<u32>();
+	m_glyphCount = pGvar.GetField<u16>();
+	m_longOffsets = pGvar.GetField<u16>() & 1;
+	m_variationData = m_gvar + pGvar.GetField<u32>();
+	m_offsets = (const u8*)pGvar.get();
+
+	// Instance 0 is the default, which has no deltas to apply.
+	m_instanceCoords.emplace_back(axisCount, 0.0f);
+}
+
+void
+GlyphVariations::LoadAxisMapping(Stream pAvar)
+{
+	pAvar.Skip(4); // skip version
+	pAvar.SkipField<u16>(); // skip reserved
+	const u16 axisCount = pAvar.GetField<u16>();
+	assert(axisCount == m_axes.size());
+
+	m_axisMaps.resize(axisCount);
+	for (auto& map : m_axisMaps) {
+		const u16 mapCount = pAvar.GetField<u16>();
+		for (size_t k = 0; k < mapCount; ++k) {
+			const float from = pAvar.GetField<s16>() / (float)16384;
+			const float to = pAvar.GetField<s16>() / (float)16384;
+			map.emplace_back(from, to);
+		}
+	}
+}
+
+float
+GlyphVariations::Normalize(const size_t pAxis, const float pValue) const
+{
+	const VariationAxis& axis = m_axes[pAxis];
+	const float value = std::clamp(pValue, axis.minValue, axis.maxValue);
+
+	float n = 0.0f;
+	if (value < axis.defaultValue) {
+		n = (value - axis.defaultValue) / (axis.defaultValue - axis.minValue);
+	}
+	else if (value > axis.defaultValue) {
+		n = (value - axis.defaultValue) / (axis.maxValue - axis.defaultValue);
+	}
+
+	// avar remaps the default normalization piecewise linearly.
+	if (pAxis < m_axisMaps.size() && m_axisMaps[pAxis].size() >= 2) {
+		const auto& map = m_axisMaps[pAxis];
+		for (size_t k = 1; k < map.size(); ++k) {
+			if (n <= map[k].x) {
+				const Point& p0 = map[k - 1];
+				const Point& p1 = map[k];
+				n = (p1.x == p0.x) ? p1.y : p0.y + (n - p0.x) * (p1.y - p0.y) / (p1.x - p0.x);
+				break;
+			}
+		}
+	}
+
+	// Coordinates are defined at F2DOT14 precision.
+	return std::roundf(n * 16384) / 16384;
+}
+
+VariationInstance
+GlyphVariations::CreateInstance(std::span<const float> pCoords) const
+{
+	VariationInstance instance;
+	if (!m_gvar) {
+		return instance;
+	}
+
+	instance.coords.assign(m_axes.size(), 0.0f);
+	for (size_t k = 0; k < std::min(instance.coords.size(), pCoords.size()); ++k) {
+		instance.coords[k] = Normalize(k, pCoords[k]);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_instanceLock);
+
+		const size_t id = std::find(m_instanceCoords.begin(), m_instanceCoords.end(), instance.coords) - m_instanceCoords.begin();
+		if (id == m_instanceCoords.size()) {
+			assert(id < 0xffff);
+			m_instanceCoords.push_back(instance.coords);
+		}
+		instance.id = (u16)id;
+	}
+
+	if (instance.IsDefault()) {
+		return VariationInstance();
+	}
+
+	instance.sharedScalars.reserve(m_sharedTupleCount);
+	for (size_t k = 0; k < m_sharedTupleCount; ++k) {
+		const u8* peak = m_sharedTuples + k * m_axes.size() * sizeof(u16);
+		instance.sharedScalars.push_back(GetScalar(instance.coords, peak, nullptr, nullptr));
+	}
+
+	return instance;
+}
+
+float
+GlyphVariations::GetScalar(const std::vector<float>& pCoords, const u8* pPeak, const u8* pStart, const u8* pEnd) const
+{
+	float scalar = 1.0f;
+
+	for (size_t k = 0; k < pCoords.size(); ++k) {
+		const float peak = GetF2DOT14(pPeak + k * sizeof(u16));
+		const float v = pCoords[k];
+
+		if (peak == 0.0f) {
+			continue; // the tuple doesn't depend on this axis.
+		}
+		if (v == 0.0f) {
+			return 0.0f;
+		}
+
+		if (pStart) {
+			const float start = GetF2DOT14(pStart + k * sizeof(u16));
+			const float end = GetF2DOT14(pEnd + k * sizeof(u16));
+			if (start > peak || peak > end || (start < 0.0f && end > 0.0f)) {
+				continue; // invalid regions are ignored.
+			}
+			if (v < start || v > end) {
+				return 0.0f;
+			}
+
+			if (v < peak) {
+				scalar *= (v - start) / (peak - start);
+			}
+			else if (v > peak) {
+				scalar *= (end - v) / (end - peak);
+			}
+		}
+		else {
+			if (v < std::min(0.0f, peak) || v > std::max(0.0f, peak)) {
+				return 0.0f;
+			}
+
+			scalar *= v / peak;
+		}
+	}
+
+	return scalar;
+}
+
+// Returns false when the tuple applies to every point.
+static bool
+ReadPointNumbers(Stream& pData, std::vector<u16>& pNumbers)
+{
+	pNumbers.clear();
+
+	u16 count = *pData;
+	if (count == 0) {
+		return false;
+	}
+	if (count & pointsAreWordsMask) {
+		count = ((count & pointRunCountMask) << 8) | *pData;
+	}
+
+	// Point numbers are stored as runs of differences.
+	u16 number = 0;
+	while (pNumbers.size() < count) {
+		const u8 control = *pData;
+		const size_t runCount = (control & pointRunCountMask) + 1;
+
+		for (size_t k = 0; k < runCount && pNumbers.size() < count; ++k) {
+			number += (control & pointsAreWordsMask) ? pData.GetField<u16>() : *pData;
+			pNumbers.push_back(number);
+		}
+	}
+
+	return true;
+}
+
+static void
+ReadDeltas(Stream& pData, const size_t pCount, std::vector<s16>& pDeltas)
+{
+	pDeltas.clear();
+
+	while (pDeltas.size() < pCount) {
+		const u8 control = *pData;
+		const size_t runCount = std::min<size_t>((control & deltaRunCountMask) + 1, pCount - pDeltas.size());
+
+		for (size_t k = 0; k < runCount; ++k) {
+			if (control & deltasAreZeroMask) {
+				pDeltas.push_back(0);
+			}
+			else if (control & deltasAreWordsMask) {
+				pDeltas.push_back(pData.GetField<s16>());
+			}
+			else {
+				pDeltas.push_back(pData.GetField<s8>());
+			}
+		}
+	}
+}
+
+static float
+InterpolateDelta(const float c, float c1, float c2, float d1, float d2)
+{
+	if (c1 == c2) {
+		return (d1 == d2) ? d1 : 0.0f;
+	}
+	if (c1 > c2) {
+		std::swap(c1, c2);
+		std::swap(d1, d2);
+	}
+
+	if (c <= c1) {
+		return d1;
+	}
+	if (c >= c2) {
+		return d2;
+	}
+
+	return d1 + (c - c1) * (d2 - d1) / (c2 - c1);
+}
+
+// Infers the deltas of the points a tuple leaves out from the nearest
+// touched points either side of them on the same contour.
+static void
+InterpolateUntouched(
+	std::span<const Point> pOriginal,
+	std::span<const u16> pContourEnds,
+	const std::vector<bool>& pTouched,
+	std::vector<Point>& pDeltas)
+{
+	size_t start = 0;
+	for (const u16 end : pContourEnds) {
+		const auto wrap = [&](const size_t k) { return (k > end) ? start : k; };
+
+		size_t first = start;
+		while (first <= end && !pTouched[first]) {
+			++first;
+		}
+
+		// Contours without any touched point don't move.
+		if (first <= end) {
+			size_t prev = first;
+			do {
+				size_t next = wrap(prev + 1);
+				while (!pTouched[next]) {
+					next = wrap(next + 1);
+				}
+
+				for (size_t k = wrap(prev + 1); k != next; k = wrap(k + 1)) {
+					pDeltas[k].x = InterpolateDelta(pOriginal[k].x, pOriginal[prev].x, pOriginal[next].x, pDeltas[prev].x, pDeltas[next].x);
+					pDeltas[k].y = InterpolateDelta(pOriginal[k].y, pOriginal[prev].y, pOriginal[next].y, pDeltas[prev].y, pDeltas[next].y);
+				}
+
+				prev = next;
+			} while (prev != first);
+		}
+
+		start = end + 1;
+	}
+}
+
+bool
+GlyphVariations::GetDeltas(
+	const GlyphID pGlyphID,
+	const VariationInstance& pInstance,
+	std::span<const Point> pOriginal,
+	std::span<const u16> pContourEnds,
+	std::vector<Point>& pDeltas) const
+{
+	if (pInstance.IsDefault() || pGlyphID >= m_glyphCount) {
+		return false;
+	}
+
+	const u32 dataStart = m_longOffsets ? Stream::GetField<u32>(m_offsets + pGlyphID * 4)
+		: Stream::GetField<u16>(m_offsets + pGlyphID * 2) * 2;
+	const u32 dataEnd = m_longOffsets ? Stream::GetField<u32>(m_offsets + (pGlyphID + 1) * 4)
+		: Stream::GetField<u16>(m_offsets + (pGlyphID + 1) * 2) * 2;
+
+	if (dataStart == dataEnd) {
+		return false; // the glyph doesn't vary.
+	}
+
+	const size_t axisBytes = m_axes.size() * sizeof(u16);
+	const size_t pointCount = pOriginal.size();
+
+	const u8* glyphData = m_variationData + dataStart;
+	Stream header(glyphData);
+	const u16 tupleCountField = header.GetField<u16>();
+	Stream serialized(glyphData + header.GetField<u16>());
+
+	std::vector<u16> sharedPoints;
+	bool sharedPointsExplicit = false;
+	if (tupleCountField & sharedPointNumbersMask) {
+		sharedPointsExplicit = ReadPointNumbers(serialized, sharedPoints);
+	}
+
+	pDeltas.assign(pointCount, Point());
+
+	std::vector<u16> privatePoints;
+	std::vector<s16> xDeltas, yDeltas;
+	std::vector<Point> tupleDeltas;
+	std::vector<bool> touched;
+
+	const size_t tupleCount = tupleCountField & tupleCountMask;
+	for (size_t t = 0; t < tupleCount; ++t) {
+		const u16 dataSize = header.GetField<u16>();
+		const u16 tupleIndex = header.GetField<u16>();
+
+		const u8* peak = m_sharedTuples + (tupleIndex & tupleIndexMask) * axisBytes;
+		if (tupleIndex & embeddedPeakTupleMask) {
+			peak = (const u8*)header.get();
+			header.Skip(axisBytes);
+		}
+
+		const u8* intermediateStart = nullptr;
+		const u8* intermediateEnd = nullptr;
+		if (tupleIndex & intermediateRegionMask) {
+			intermediateStart = (const u8*)header.get();
+			intermediateEnd = intermediateStart + axisBytes;
+			header.Skip(2 * axisBytes);
+		}
+
+		Stream tupleData(serialized);
+		serialized.Skip(dataSize);
+
+		const bool usesSharedScalar = !(tupleIndex & (embeddedPeakTupleMask | intermediateRegionMask));
+		const float scalar = usesSharedScalar ? pInstance.sharedScalars[tupleIndex & tupleIndexMask]
+			: GetScalar(pInstance.coords, peak, intermediateStart, intermediateEnd);
+
+		if (scalar == 0.0f) {
+			continue;
+		}
+
+		bool pointsExplicit = sharedPointsExplicit;
+		const std::vector<u16>* points = &sharedPoints;
+		if (tupleIndex & privatePointNumbersMask) {
+			pointsExplicit = ReadPointNumbers(tupleData, privatePoints);
+			points = &privatePoints;
+		}
+
+		const size_t deltaCount = pointsExplicit ? points->size() : pointCount + phantomPointCount;
+		ReadDeltas(tupleData, deltaCount, xDeltas);
+		ReadDeltas(tupleData, deltaCount, yDeltas);
+
+		if (!pointsExplicit) {
+			for (size_t k = 0; k < pointCount; ++k) {
+				pDeltas[k].x += scalar * xDeltas[k];
+				pDeltas[k].y += scalar * yDeltas[k];
+			}
+			continue;
+		}
+
+		tupleDeltas.assign(pointCount, Point());
+		touched.assign(pointCount, false);
+		for (size_t k = 0; k < deltaCount; ++k) {
+			const u16 point = (*points)[k];
+			if (point < pointCount) { // skip phantom points.
+				tupleDeltas[point] = Point(xDeltas[k], yDeltas[k]);
+				touched[point] = true;
+			}
+		}
+
+		InterpolateUntouched(pOriginal, pContourEnds, touched, tupleDeltas);
+
+		for (size_t k = 0; k < pointCount; ++k) {
+			pDeltas[k].x += scalar * tupleDeltas[k].x;
+			pDeltas[k].y += scalar * tupleDeltas[k].y;
+		}
+	}
+
+	return true;
+}
+
+void
+GlyphVariations::Apply(const GlyphID pGlyphID, const VariationInstance& pInstance, std::vector<Contour>& pContours) const
+{
+	std::vector<Point> original;
+	std::vector<u16> contourEnds;
+	for (const auto& c : pContours) {
+		for (size_t k = 0; k < c.getTotalPtCount(); ++k) {
+			original.emplace_back(c.xs[k], c.ys[k]);
+		}
+		contourEnds.push_back((u16)(original.size() - 1));
+	}
+
+	std::vector<Point> deltas;
+	if (!GetDeltas(pGlyphID, pInstance, original, contourEnds, deltas)) {
+		return;
+	}
+
+	// The spec rounds halves towards positive infinity.
+	size_t i = 0;
+	for (auto& c : pContours) {
+		for (size_t k = 0; k < c.getTotalPtCount(); ++k, ++i) {
+			c.xs[k] = (s16)std::floor(original[i].x + deltas[i].x + 0.5f);
+			c.ys[k] = (s16)std::floor(original[i].y + deltas[i].y + 0.5f);
+		}
+	}
+}
+
+void
+GlyphVariations::ApplyToComponents(const GlyphID pGlyphID, const VariationInstance& pInstance, std::vector<Point>& pOffsets) const
+{
+	// Component offsets aren't interpolated: untouched components stay put.
+	std::vector<Point> deltas;
+	if (!GetDeltas(pGlyphID, pInstance, pOffsets, {}, deltas)) {
+		return;
+	}
+
+	for (size_t k = 0; k < pOffsets.size(); ++k) {
+		pOffsets[k].x = std::floor(pOffsets[k].x + deltas[k].x + 0.5f);
+		pOffsets[k].y = std::floor(pOffsets[k].y + deltas[k].y + 0.5f);
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <mutex>
+
+#include "base.h"
+#include "stream.h"
+#include "outline.h"
+#include "encodings.h"
+
+//
+
+// A design axis from fvar, in user coordinates (e.g. weight 100-900).
+struct VariationAxis {
+    u32 tag;
+    float minValue, defaultValue, maxValue;
+};
+
+// One set of axis coordinates, resolved for applying deltas. Instances are
+// numbered per font in the order their coordinates were first selected, so
+// the same coordinates always get the same id; id 0 is the default, which
+// has no deltas.
+struct VariationInstance {
+    u16 id = 0;
+    std::vector<float> coords; // normalized, one per axis.
+    std::vector<float> sharedScalars; // one per shared tuple.
+
+    //
+
+    bool IsDefault() const { return id == 0; }
+};
+
+// Glyph outline variations from fvar/gvar (and avar, when present). The
+// scalar of each shared tuple depends only on the instance, so it is
+// computed once by CreateInstance rather than for every glyph. Nothing here
+// changes after loading apart from the instance numbering, which takes a
+// lock, so deltas can be applied from any number of threads at once.
+class GlyphVariations {
+    /* === Methods === */
+public:
+    GlyphVariations() = default;
+
+    void Load(Stream pFvar, Stream pGvar);
+    void LoadAxisMapping(Stream pAvar);
+
+    const std::vector<VariationAxis>& GetAxes() const { return m_axes; }
+
+    // The instance at the given user coordinates, one per axis in fvar
+    // order. Missing trailing axes stay at their default.
+    VariationInstance CreateInstance(std::span<const float> pCoords) const;
+
+    // Moves a simple glyph's points by the instance's deltas, interpolating
+    // untouched points (IUP) within each contour.
+    void Apply(const GlyphID pGlyphID, const VariationInstance& pInstance, std::vector<Contour>& pContours) const;
+
+    // Moves a compound glyph's component offsets, one per component.
+    void ApplyToComponents(const GlyphID pGlyphID, const VariationInstance& pInstance, std::vector<Point>& pOffsets) const;
+
+private:
+    float Normalize(const size_t pAxis, const float pValue) const;
+
+    // pStart and pEnd are null unless the tuple has an intermediate region.
+    float GetScalar(const std::vector<float>& pCoords, const u8* pPeak, const u8* pStart, const u8* pEnd) const;
+
+    // Sums the current instance's deltas for each of pOriginal's points. IUP
+    // is only applied when contour end points are given.
+    bool GetDeltas(const GlyphID pGlyphID, const VariationInstance& pInstance, std::span<const Point> pOriginal, std::span<const u16> pContourEnds, std::vector<Point>& pDeltas) const;
+
+    /* === Variables === */
+private:
+    std::vector<VariationAxis> m_axes;
+    std::vector<std::vector<Point>> m_axisMaps; // avar segment maps, (from, to) pairs.
+
+    const u8* m_gvar = nullptr;
+    const u8* m_sharedTuples = nullptr;
+    u16 m_sharedTupleCount = 0;
+    u16 m_glyphCount = 0;
+    bool m_longOffsets = false;
+    const u8* m_offsets = nullptr;
+    const u8* m_variationData = nullptr;
+
+    // Normalized coordinates of each numbered instance, by id.
+    mutable std::mutex m_instanceLock;
+    mutable std::vector<std::vector<float>> m_instanceCoords;
+};